@@ -10,6 +10,13 @@
 #include "footswitch.h"
 #include "usb_midi_host.h"
 #include "uart_midi_out.h"
+#include "uart_midi_in.h"
+#include "midi_out.h"
+#include "midi_sched.h"
+#include "midi_clock.h"
+#include "midi_state.h"
+#include "midi_scene.h"
+#include "midi_sysex.h"
 #include "expfs.h"
 #include "display_uart.h"
 
@@ -56,6 +63,7 @@ static void bootstrap_task(void *arg)
 
     // 3) usb midi host
     ESP_LOGI(TAG, "usb_midi_host_init()");
+    usb_midi_set_ump(config_store_get_usb_ump() != 0);
     usb_midi_host_init();
     vTaskDelay(pdMS_TO_TICKS(50));
 
@@ -64,11 +72,38 @@ static void bootstrap_task(void *arg)
     uart_midi_out_init();
     vTaskDelay(pdMS_TO_TICKS(20));
 
+    // 3.2) midi out dispatcher (owns usb + uart sending) + receiver state mirror
+    ESP_LOGI(TAG, "midi_state_init()");
+    midi_state_init();
+    ESP_LOGI(TAG, "midi_out_init()");
+    midi_out_init();
+
+    // 3.2.1) DIN MIDI IN -> thru/merge through the dispatcher
+    ESP_LOGI(TAG, "uart_midi_in_init()");
+    uart_midi_in_set_thru(config_store_get_din_thru());
+    uart_midi_in_init();
+
+    // 3.3) timer wheel for delayed actions
+    ESP_LOGI(TAG, "midi_sched_init()");
+    midi_sched_init();
+
+    // 3.4) midi clock master (gptimer)
+    ESP_LOGI(TAG, "midi_clock_init()");
+    midi_clock_init();
+
     // 4) captive portal
     ESP_LOGI(TAG, "portal_wifi_start()");
     portal_wifi_start();
     vTaskDelay(pdMS_TO_TICKS(50));
 
+    // 4.1) scenes (files live on SPIFFS, mounted by the portal)
+    ESP_LOGI(TAG, "midi_scene_init()");
+    midi_scene_init();
+
+    // 4.2) sysex payload pool (also on SPIFFS)
+    ESP_LOGI(TAG, "midi_sysex_init()");
+    midi_sysex_init();
+
     // 5) footswitch
     ESP_LOGI(TAG, "footswitch_start()");
     footswitch_start();
@@ -22,6 +22,8 @@
 
 #include "config_store.h"
 #include "display_uart.h"
+#include "midi_prog.h"
+#include "midi_sysex.h"
 
 static const char *TAG = "CFG";
 
@@ -52,6 +54,18 @@ static uint8_t s_ab_led_sel[MAX_BANKS][NUM_BTNS];
 // ---- current bank persisted ----
 static uint8_t s_cur_bank = 0;
 
+// ---- midi suppression (0/1) ----
+static uint8_t s_midi_suppress = 0;
+
+// ---- usb resync on attach (0/1) ----
+static uint8_t s_usb_resync = 0;
+
+// ---- usb MIDI 2.0 (UMP) alt setting when offered (0/1) ----
+static uint8_t s_usb_ump = 1;
+
+// ---- DIN IN thru/merge (0/1) ----
+static uint8_t s_din_thru = 1;
+
 // ---- exp/fs stored separately (blob) ----
 static expfs_port_cfg_t s_expfs[EXPFS_PORT_COUNT];
 
@@ -230,12 +244,29 @@ static void set_default_action(action_t *a)
 {
     if (!a) return;
     a->type = ACT_NONE;
+    a->rsv  = 0;
+    a->cables = 0;
     a->ch   = 1;
     a->a    = 0;
     a->b    = 0;
     a->c    = 0;
 }
 
+// list action: CC / PC / DELAY / SYSEX survive, everything else -> NONE
+static void sanitize_action(action_t *a)
+{
+    if (a->type != ACT_CC && a->type != ACT_PC && a->type != ACT_DELAY && a->type != ACT_SYSEX) set_default_action(a);
+    if (a->type == ACT_SYSEX) a->a = (uint8_t)clampi((int)a->a, 0, MIDI_SYSEX_SLOTS - 1);
+
+    a->ch = (uint8_t)clampi((int)a->ch, 1, 16);
+    a->a  = (uint8_t)clampi((int)a->a, 0, 127);
+    a->b  = (uint8_t)clampi((int)a->b, 0, 127);
+    a->c  = (a->type == ACT_DELAY) ? 0 : (uint8_t)(a->c & ACTION_F_MASK);
+    if (ACTION_F_ROUTE_OF(a->c) > ACTION_ROUTE_DIN) a->c &= (uint8_t)~ACTION_F_ROUTE_MASK;   // 3 = unused -> every transport
+    a->rsv = 0;
+    if (a->type == ACT_DELAY) { a->ch = 1; a->cables = 0; }
+}
+
 static void safe_set_name(char dst[NAME_LEN], const char *src, const char *fallback)
 {
     const char *s = (src && src[0]) ? src : fallback;
@@ -282,6 +313,146 @@ static esp_err_t nvs_save_led_brightness(uint8_t v)
     return e;
 }
 
+// ---- usb resync NVS helpers ----
+static esp_err_t nvs_load_usb_resync(uint8_t *out)
+{
+    if (!out) return ESP_ERR_INVALID_ARG;
+    if (!s_nvs_ok) return ESP_ERR_INVALID_STATE;
+
+    nvs_handle_t h;
+    esp_err_t e = nvs_open("footsw", NVS_READONLY, &h);
+    if (e != ESP_OK) return e;
+
+    uint8_t v = 0;
+    e = nvs_get_u8(h, "usb_resync", &v);
+    nvs_close(h);
+
+    if (e != ESP_OK) return e;
+    *out = v ? 1u : 0u;
+    return ESP_OK;
+}
+
+static esp_err_t nvs_save_usb_resync(uint8_t v)
+{
+    if (!s_nvs_ok) return ESP_ERR_INVALID_STATE;
+
+    nvs_handle_t h;
+    esp_err_t e = nvs_open("footsw", NVS_READWRITE, &h);
+    if (e != ESP_OK) return e;
+
+    e = nvs_set_u8(h, "usb_resync", v ? 1u : 0u);
+    if (e == ESP_OK) e = nvs_commit(h);
+    nvs_close(h);
+
+    if (e != ESP_OK) ESP_LOGE(TAG, "nvs_save_usb_resync failed: %s", esp_err_to_name(e));
+    return e;
+}
+
+// ---- usb ump NVS helpers ----
+static esp_err_t nvs_load_usb_ump(uint8_t *out)
+{
+    if (!out) return ESP_ERR_INVALID_ARG;
+    if (!s_nvs_ok) return ESP_ERR_INVALID_STATE;
+
+    nvs_handle_t h;
+    esp_err_t e = nvs_open("footsw", NVS_READONLY, &h);
+    if (e != ESP_OK) return e;
+
+    uint8_t v = 0;
+    e = nvs_get_u8(h, "usb_ump", &v);
+    nvs_close(h);
+
+    if (e != ESP_OK) return e;
+    *out = v ? 1u : 0u;
+    return ESP_OK;
+}
+
+static esp_err_t nvs_save_usb_ump(uint8_t v)
+{
+    if (!s_nvs_ok) return ESP_ERR_INVALID_STATE;
+
+    nvs_handle_t h;
+    esp_err_t e = nvs_open("footsw", NVS_READWRITE, &h);
+    if (e != ESP_OK) return e;
+
+    e = nvs_set_u8(h, "usb_ump", v ? 1u : 0u);
+    if (e == ESP_OK) e = nvs_commit(h);
+    nvs_close(h);
+
+    if (e != ESP_OK) ESP_LOGE(TAG, "nvs_save_usb_ump failed: %s", esp_err_to_name(e));
+    return e;
+}
+
+// ---- din thru NVS helpers ----
+static esp_err_t nvs_load_din_thru(uint8_t *out)
+{
+    if (!out) return ESP_ERR_INVALID_ARG;
+    if (!s_nvs_ok) return ESP_ERR_INVALID_STATE;
+
+    nvs_handle_t h;
+    esp_err_t e = nvs_open("footsw", NVS_READONLY, &h);
+    if (e != ESP_OK) return e;
+
+    uint8_t v = 0;
+    e = nvs_get_u8(h, "din_thru", &v);
+    nvs_close(h);
+
+    if (e != ESP_OK) return e;
+    *out = v ? 1u : 0u;
+    return ESP_OK;
+}
+
+static esp_err_t nvs_save_din_thru(uint8_t v)
+{
+    if (!s_nvs_ok) return ESP_ERR_INVALID_STATE;
+
+    nvs_handle_t h;
+    esp_err_t e = nvs_open("footsw", NVS_READWRITE, &h);
+    if (e != ESP_OK) return e;
+
+    e = nvs_set_u8(h, "din_thru", v ? 1u : 0u);
+    if (e == ESP_OK) e = nvs_commit(h);
+    nvs_close(h);
+
+    if (e != ESP_OK) ESP_LOGE(TAG, "nvs_save_din_thru failed: %s", esp_err_to_name(e));
+    return e;
+}
+
+// ---- midi suppression NVS helpers ----
+static esp_err_t nvs_load_midi_suppress(uint8_t *out)
+{
+    if (!out) return ESP_ERR_INVALID_ARG;
+    if (!s_nvs_ok) return ESP_ERR_INVALID_STATE;
+
+    nvs_handle_t h;
+    esp_err_t e = nvs_open("footsw", NVS_READONLY, &h);
+    if (e != ESP_OK) return e;
+
+    uint8_t v = 0;
+    e = nvs_get_u8(h, "midi_sup", &v);
+    nvs_close(h);
+
+    if (e != ESP_OK) return e;
+    *out = v ? 1u : 0u;
+    return ESP_OK;
+}
+
+static esp_err_t nvs_save_midi_suppress(uint8_t v)
+{
+    if (!s_nvs_ok) return ESP_ERR_INVALID_STATE;
+
+    nvs_handle_t h;
+    esp_err_t e = nvs_open("footsw", NVS_READWRITE, &h);
+    if (e != ESP_OK) return e;
+
+    e = nvs_set_u8(h, "midi_sup", v ? 1u : 0u);
+    if (e == ESP_OK) e = nvs_commit(h);
+    nvs_close(h);
+
+    if (e != ESP_OK) ESP_LOGE(TAG, "nvs_save_midi_suppress failed: %s", esp_err_to_name(e));
+    return e;
+}
+
 // ---- current bank NVS helpers ----
 static esp_err_t nvs_load_cur_bank(uint8_t *out)
 {
@@ -454,17 +625,8 @@ static void expfs_sanitize_btn(expfs_btncfg_t *m)
         action_t *sa = &m->short_actions[i];
         action_t *la = &m->long_actions[i];
 
-        if (sa->type != ACT_CC && sa->type != ACT_PC) set_default_action(sa);
-        if (la->type != ACT_CC && la->type != ACT_PC) set_default_action(la);
-
-        sa->ch = (uint8_t)clampi((int)sa->ch, 1, 16);
-        la->ch = (uint8_t)clampi((int)la->ch, 1, 16);
-        sa->a  = (uint8_t)clampi((int)sa->a, 0, 127);
-        sa->b  = (uint8_t)clampi((int)sa->b, 0, 127);
-        sa->c  = 0;
-        la->a  = (uint8_t)clampi((int)la->a, 0, 127);
-        la->b  = (uint8_t)clampi((int)la->b, 0, 127);
-        la->c  = 0;
+        sanitize_action(sa);
+        sanitize_action(la);
     }
 }
 
@@ -550,22 +712,11 @@ static void sanitize_cfg(foot_config_t *cfg)
                 action_t *sa = &m->short_actions[i];
                 action_t *la = &m->long_actions[i];
 
-                if (sa->type != ACT_CC && sa->type != ACT_PC) set_default_action(sa);
-                if (la->type != ACT_CC && la->type != ACT_PC) set_default_action(la);
-
-                sa->ch = (uint8_t)clampi((int)sa->ch, 1, 16);
-                la->ch = (uint8_t)clampi((int)la->ch, 1, 16);
-                sa->a  = (uint8_t)clampi((int)sa->a, 0, 127);
-                sa->b  = (uint8_t)clampi((int)sa->b, 0, 127);
-                sa->c  = 0;
-                la->a  = (uint8_t)clampi((int)la->a, 0, 127);
-                la->b  = (uint8_t)clampi((int)la->b, 0, 127);
-                la->c  = 0;
+                sanitize_action(sa);
+                sanitize_action(la);
             }
 
-            int pm = (int)m->press_mode;
-            if (pm == 4) pm = 0; // migrate old tap tempo -> short
-            m->press_mode  = (btn_press_mode_t)clampi(pm, 0, 3);
+            m->press_mode  = (btn_press_mode_t)clampi((int)m->press_mode, 0, BTN_TAP_TEMPO);
             m->cc_behavior = (cc_behavior_t)clampi((int)m->cc_behavior, 0, 2);
 
             cfg->switch_name[b][k][NAME_LEN - 1] = 0;
@@ -687,7 +838,9 @@ static void migrate_v3_to_v4(const legacy_foot_config_v3_t *old, foot_config_t *
                 // short
                 const legacy_action_t *osa = &om->short_actions[i];
                 action_t *nsa = &nm->short_actions[i];
-                nsa->type = osa->type;
+                nsa->type = (uint8_t)osa->type;
+                nsa->rsv = 0;
+                nsa->cables = 0;
                 nsa->ch = osa->ch;
                 nsa->a = osa->a;
                 nsa->b = osa->b;
@@ -696,7 +849,9 @@ static void migrate_v3_to_v4(const legacy_foot_config_v3_t *old, foot_config_t *
                 // long
                 const legacy_action_t *ola = &om->long_actions[i];
                 action_t *nla = &nm->long_actions[i];
-                nla->type = ola->type;
+                nla->type = (uint8_t)ola->type;
+                nla->rsv = 0;
+                nla->cables = 0;
                 nla->ch = ola->ch;
                 nla->a = ola->a;
                 nla->b = ola->b;
@@ -866,6 +1021,26 @@ void config_store_init(void)
             ESP_LOGW(TAG, "No ab led sel saved, default=B");
         }
 
+        // midi suppression (default off: resend everything, as before)
+        uint8_t sup = 0;
+        if (nvs_load_midi_suppress(&sup) == ESP_OK) s_midi_suppress = sup;
+        else s_midi_suppress = 0;
+
+        // usb resync on attach (default off)
+        uint8_t rs = 0;
+        if (nvs_load_usb_resync(&rs) == ESP_OK) s_usb_resync = rs;
+        else s_usb_resync = 0;
+
+        // usb MIDI 2.0 (default on)
+        uint8_t um = 1;
+        if (nvs_load_usb_ump(&um) == ESP_OK) s_usb_ump = um;
+        else s_usb_ump = 1;
+
+        // DIN IN thru (default on)
+        uint8_t dt = 1;
+        if (nvs_load_din_thru(&dt) == ESP_OK) s_din_thru = dt;
+        else s_din_thru = 1;
+
         // current bank
         uint8_t cb = 0;
         e = nvs_load_cur_bank(&cb);
@@ -898,6 +1073,9 @@ void config_store_init(void)
         sanitize_cfg(s_cfg);
         expfs_sanitize_all();
     }
+
+    // ✅ compiled action programs (rebuilt on every config edit below)
+    midi_prog_rebuild_all();
 }
 
 // ---- helpers ----
@@ -1008,6 +1186,8 @@ esp_err_t config_store_set_layout_json(const char *json)
 
     if (s_cfg_lock) xSemaphoreGive(s_cfg_lock);
 
+    midi_prog_rebuild_all();
+
     // persist current bank asynchronously (small NVS), but do not block UI
     if (s_nvs_ok) (void)nvs_save_cur_bank(s_cur_bank);
 
@@ -1124,15 +1304,24 @@ static bool parse_action(cJSON *o, action_t *a)
     }
 
     a->ch = (uint8_t)clampi((int)ch->valueint, 1, 16);
+    a->rsv = 0;
+
+    // CC/PC: USB cable mask (bit n = cable n, optional)
+    const cJSON *cab = cJSON_GetObjectItem(o, "cables");
+    a->cables = cJSON_IsNumber(cab) ? (uint16_t)clampi(cab->valueint, 0, 0xFFFF) : 0;
 
     int cv = 0;
     if (cJSON_IsNumber(cc)) cv = cc->valueint;
 
+    // list actions carry ACTION_F_* in c ("flags" wins over "c")
+    const cJSON *fl = cJSON_GetObjectItem(o, "flags");
+
     if (strcmp(type->valuestring, "cc") == 0) {
         a->type = ACT_CC;
         a->a = (uint8_t)clampi((int)aa->valueint, 0, 127);
         a->b = (uint8_t)clampi((int)bb->valueint, 0, 127);
         a->c = (uint8_t)clampi(cv, 0, 127);
+        if (cJSON_IsNumber(fl)) a->c = (uint8_t)clampi(fl->valueint, 0, 255);
         return true;
     }
 
@@ -1141,6 +1330,32 @@ static bool parse_action(cJSON *o, action_t *a)
         a->a = (uint8_t)clampi((int)aa->valueint, 0, 127);
         a->b = (uint8_t)clampi((int)bb->valueint, 0, 127); // used by EXP (val2) / otherwise 0
         a->c = 0;
+        if (cJSON_IsNumber(fl)) a->c = (uint8_t)clampi(fl->valueint, 0, 255);
+        return true;
+    }
+
+    // sysex: a = pool slot
+    if (strcmp(type->valuestring, "sysex") == 0) {
+        a->type = ACT_SYSEX;
+        a->a = (uint8_t)clampi((int)aa->valueint, 0, MIDI_SYSEX_SLOTS - 1);
+        a->b = 0;
+        a->c = 0;
+        if (cJSON_IsNumber(fl)) a->c = (uint8_t)clampi(fl->valueint, 0, 255);
+        return true;
+    }
+
+    // delay: "ms" (0..16383) or raw a/b (ms = a + b*128)
+    if (strcmp(type->valuestring, "delay") == 0) {
+        const cJSON *ms = cJSON_GetObjectItem(o, "ms");
+        int v = cJSON_IsNumber(ms) ? ms->valueint
+                                   : clampi((int)aa->valueint, 0, 127) + (clampi((int)bb->valueint, 0, 127) << 7);
+        v = clampi(v, 0, 16383);
+        a->type = ACT_DELAY;
+        a->cables = 0;
+        a->ch = 1;
+        a->a = (uint8_t)(v & 0x7F);
+        a->b = (uint8_t)(v >> 7);
+        a->c = 0;
         return true;
     }
 
@@ -1155,6 +1370,8 @@ static void action_to_json(cJSON *arr, const action_t *a)
     const char *t = NULL;
     if (a->type == ACT_CC) t = "cc";
     if (a->type == ACT_PC) t = "pc";
+    if (a->type == ACT_DELAY) t = "delay";
+    if (a->type == ACT_SYSEX) t = "sysex";
     if (!t) return;
 
     cJSON *o = cJSON_CreateObject();
@@ -1163,6 +1380,11 @@ static void action_to_json(cJSON *arr, const action_t *a)
     cJSON_AddNumberToObject(o, "a",  a->a);
     cJSON_AddNumberToObject(o, "b",  a->b);
     cJSON_AddNumberToObject(o, "c",  a->c);
+    if (a->type == ACT_DELAY) cJSON_AddNumberToObject(o, "ms", ACTION_DELAY_MS(a));
+    else {
+        cJSON_AddNumberToObject(o, "flags", a->c);
+        cJSON_AddNumberToObject(o, "cables", ACTION_CABLES(a));
+    }
     cJSON_AddItemToArray(arr, o);
 }
 
@@ -1230,7 +1452,7 @@ esp_err_t config_store_set_btn_json(int bank, int btn, const char *json)
 
     btn_map_t *m = &s_cfg->map[bank][btn];
 
-    int pressMode = clampi(pm->valueint, 0, 3);
+    int pressMode = clampi(pm->valueint, 0, BTN_TAP_TEMPO);
     int ccBeh     = clampi(cb->valueint, 0, 2);
     m->press_mode  = (btn_press_mode_t)pressMode;
     m->cc_behavior = (cc_behavior_t)ccBeh;
@@ -1267,6 +1489,7 @@ esp_err_t config_store_set_btn_json(int bank, int btn, const char *json)
 
     cJSON_Delete(root);
     sanitize_cfg(s_cfg);
+    midi_prog_rebuild_btn(bank, btn);
 
     request_async_save();
     (void)nvs_save_ab_led_sel();
@@ -1309,6 +1532,54 @@ esp_err_t config_store_set_ab_led_sel(int bank, int btn, uint8_t sel)
     return nvs_save_ab_led_sel();
 }
 
+// ---- midi suppression public API ----
+uint8_t config_store_get_midi_suppress(void)
+{
+    return s_midi_suppress;
+}
+
+esp_err_t config_store_set_midi_suppress(uint8_t enable)
+{
+    s_midi_suppress = enable ? 1u : 0u;
+    return nvs_save_midi_suppress(s_midi_suppress);
+}
+
+// ---- usb resync public API ----
+uint8_t config_store_get_usb_resync(void)
+{
+    return s_usb_resync;
+}
+
+esp_err_t config_store_set_usb_resync(uint8_t enable)
+{
+    s_usb_resync = enable ? 1u : 0u;
+    return nvs_save_usb_resync(s_usb_resync);
+}
+
+// ---- usb MIDI 2.0 public API ----
+uint8_t config_store_get_usb_ump(void)
+{
+    return s_usb_ump;
+}
+
+esp_err_t config_store_set_usb_ump(uint8_t enable)
+{
+    s_usb_ump = enable ? 1u : 0u;
+    return nvs_save_usb_ump(s_usb_ump);
+}
+
+// ---- DIN IN thru public API ----
+uint8_t config_store_get_din_thru(void)
+{
+    return s_din_thru;
+}
+
+esp_err_t config_store_set_din_thru(uint8_t enable)
+{
+    s_din_thru = enable ? 1u : 0u;
+    return nvs_save_din_thru(s_din_thru);
+}
+
 // ---- current bank persistence public API ----
 uint8_t config_store_get_current_bank(void)
 {
@@ -1503,6 +1774,7 @@ esp_err_t config_store_set_expfs_json(int port, const char *json)
     // store then sanitize all
     s_expfs[port] = tmp;
     expfs_sanitize_all();
+    for (int p = 0; p < EXPFS_PORT_COUNT; p++) midi_prog_rebuild_expfs(p);
 
     if (s_nvs_ok) return nvs_save_expfs();
     return ESP_ERR_INVALID_STATE;
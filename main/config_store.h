@@ -16,10 +16,18 @@ typedef enum {
 
     // legacy types (จะถูก sanitize ให้เป็น NONE ตอน boot)
     ACT_NOTE,
+
+    // ✅ wait before the next actions in the list: ms = a + b*128 (0..16383)
     ACT_DELAY,
+
     ACT_BANK_PC,
+
+    // ✅ send a SysEx payload from the pool (midi_sysex.h): a = slot, c = flags, cables
+    ACT_SYSEX,
 } action_type_t;
 
+#define ACTION_DELAY_MS(act) ((uint32_t)(act)->a + ((uint32_t)(act)->b << 7))
+
 typedef enum {
     BTN_SHORT           = 0,
     BTN_SHORT_LONG      = 1,
@@ -27,6 +35,9 @@ typedef enum {
 
     // ✅ group (ใช้เฉพาะ footswitch 8 ปุ่มหลัก)
     BTN_SHORT_GROUP_LED = 3,
+
+    // ✅ tap tempo for the MIDI clock (tap = tempo, hold = start/stop; footswitch only)
+    BTN_TAP_TEMPO       = 4,
 } btn_press_mode_t;
 
 typedef enum {
@@ -35,14 +46,50 @@ typedef enum {
     CC_MOMENTARY = 2,
 } cc_behavior_t;
 
+// 8 bytes, same layout as v4: type was a 4-byte enum (little-endian, values < 256)
+// so its upper bytes were always 0 -> old configs load with cables = 0
 typedef struct {
-    action_type_t type;
+    uint8_t  type;    // action_type_t
+    uint8_t  rsv;
+    uint16_t cables;  // list CC/PC: USB-MIDI cable mask (bit n = cable n, 0 = cable 0 only)
     uint8_t ch;      // 1..16
     uint8_t a;
     uint8_t b;
-    uint8_t c;
+    uint8_t c;       // exp cmd: val2 / list CC,PC: ACTION_F_* flags
 } action_t;
 
+_Static_assert(sizeof(action_t) == 8, "action_t is stored in NVS: layout must not change");
+
+#define ACTION_CABLES_DEFAULT  0x0001u
+#define ACTION_CABLES(act)     ((uint16_t)((act)->cables ? (act)->cables : ACTION_CABLES_DEFAULT))
+
+// list action flags (action_t.c of CC/PC in short/long lists; JSON "flags")
+#define ACTION_F_ALWAYS   0x01   // send even if the receiver already has this value
+#define ACTION_F_MASK     0xFF   // bits a user may set (always + USB device mask + DIN port mask + route)
+
+// USB device mask (bits 1-3, bit per usb_midi_host slot): 0 = every device
+#define ACTION_F_USB_SHIFT    1
+#define ACTION_F_USB_MASK     0x0E
+#define ACTION_F_USB_DEV(d)   ((uint8_t)(1u << (ACTION_F_USB_SHIFT + (d))))
+#define ACTION_F_USB_DEVS(f)  ((uint8_t)(((f) & ACTION_F_USB_MASK) >> ACTION_F_USB_SHIFT))
+
+// DIN port mask (bits 4-5, bit per uart_midi_out port): 0 = every port
+#define ACTION_F_DIN_SHIFT    4
+#define ACTION_F_DIN_MASK     0x30
+#define ACTION_F_DIN_PORT(p)  ((uint8_t)(1u << (ACTION_F_DIN_SHIFT + (p))))
+#define ACTION_F_DIN_PORTS(f) ((uint8_t)(((f) & ACTION_F_DIN_MASK) >> ACTION_F_DIN_SHIFT))
+
+// transport route (bits 6-7): 0 = every transport, 1 = USB only, 2 = DIN only
+#define ACTION_F_ROUTE_SHIFT  6
+#define ACTION_F_ROUTE_MASK   0xC0
+#define ACTION_ROUTE_ALL      0
+#define ACTION_ROUTE_USB      1
+#define ACTION_ROUTE_DIN      2
+#define ACTION_F_ROUTE(r)     ((uint8_t)(((r) & 0x03) << ACTION_F_ROUTE_SHIFT))
+#define ACTION_F_ROUTE_OF(f)  ((uint8_t)(((f) & ACTION_F_ROUTE_MASK) >> ACTION_F_ROUTE_SHIFT))
+#define ACTION_F_TO_USB(f)    (ACTION_F_ROUTE_OF(f) != ACTION_ROUTE_DIN)
+#define ACTION_F_TO_DIN(f)    (ACTION_F_ROUTE_OF(f) != ACTION_ROUTE_USB)
+
 typedef struct {
     btn_press_mode_t press_mode;
     cc_behavior_t cc_behavior;
@@ -124,6 +171,22 @@ esp_err_t config_store_set_led_brightness(uint8_t percent);
 uint8_t  config_store_get_ab_led_sel(int bank, int btn);
 esp_err_t config_store_set_ab_led_sel(int bank, int btn, uint8_t sel);
 
+// ---- redundant CC/PC suppression (global, 0/1; see midi_state.h) ----
+uint8_t  config_store_get_midi_suppress(void);
+esp_err_t config_store_set_midi_suppress(uint8_t enable);
+
+// ---- replay toggle / A/B state to a USB device on attach (0/1; see midi_actions.h) ----
+uint8_t  config_store_get_usb_resync(void);
+esp_err_t config_store_set_usb_resync(uint8_t enable);
+
+// ---- use a device's MIDI 2.0 (UMP) alt setting when it has one (0/1, default 1) ----
+uint8_t  config_store_get_usb_ump(void);
+esp_err_t config_store_set_usb_ump(uint8_t enable);
+
+// ---- DIN IN merged into DIN OUT + USB (0/1, default 1; see uart_midi_in.h) ----
+uint8_t  config_store_get_din_thru(void);
+esp_err_t config_store_set_din_thru(uint8_t enable);
+
 // ---- current bank persistence ----
 uint8_t  config_store_get_current_bank(void);
 esp_err_t config_store_set_current_bank(uint8_t bank);
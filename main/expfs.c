@@ -12,8 +12,8 @@
 
 #include "config_store.h"
 #include "midi_actions.h"
+#include "midi_out.h"
 #include "usb_midi_host.h"
-#include "uart_midi_out.h"
 
 #include "expfs.h"
 
@@ -28,6 +28,8 @@ static const char *TAG = "EXPFS";
 #define EXP_IIR_SHIFT          (1)     // 2^3 = 8  (ยิ่งมากยิ่งเนียน)
 #define EXP_FORCE_DELTA        (1)     // diff >= 4 ส่งทันที (รู้สึกตอบสนอง)
 #define EXP_CURVE_GAMMA        (1.0f)  // 1.0 = linear LUT (ยังคง LUT ไว้เผื่อปรับภายหลัง)
+#define EXP_HR_THROTTLE_MS     (5)     // MIDI 2.0: ส่งถี่กว่าได้ (ค่าเปลี่ยนทีละนิด)
+#define EXP_HR_FORCE_DELTA     (32)    // 12-bit steps (~1 step ของ 7-bit) ส่งทันที
 
 
 // -------------------- pin map (ตามที่กำหนดให้) --------------------
@@ -63,6 +65,11 @@ static int32_t  s_raw_filt[EXPFS_PORT_COUNT]; // filtered raw (0..4095)
 static uint8_t  s_pending_mapped[EXPFS_PORT_COUNT];
 static uint32_t s_pending_since_ms[EXPFS_PORT_COUNT];
 
+// hi-res (MIDI 2.0 device present): gate on 12-bit steps instead of 7-bit
+static uint16_t s_last_hr[EXPFS_PORT_COUNT];     // 0xFFFF = none
+static uint16_t s_pending_hr[EXPFS_PORT_COUNT];
+static uint32_t s_pending_hr_since_ms[EXPFS_PORT_COUNT];
+
 static uint8_t  s_curve_lut[128];
 static uint8_t  s_curve_inited;
 
@@ -201,6 +208,9 @@ static void adc_init_once(void)
         s_raw_filt[p] = 0;
         s_pending_mapped[p] = 0xFF;
         s_pending_since_ms[p] = 0;
+        s_last_hr[p] = 0xFFFF;
+        s_pending_hr[p] = 0xFFFF;
+        s_pending_hr_since_ms[p] = 0;
     }
 
     // fs init
@@ -235,16 +245,23 @@ static int adc_read_raw_port(int port, int *out_raw)
     return 1;
 }
 
-static inline void send_cc_all(uint8_t ch, uint8_t cc, uint8_t val)
+// queue only: dispatcher task (midi_out.c) owns USB/UART
+// exp CC = continuous: a value still waiting on a busy DIN port gets replaced, not queued behind
+// false = not queued (nothing up / queue full): the caller keeps its last-sent
+// value so the next poll sends the position again
+static inline bool send_cc_all(uint8_t ch, uint8_t cc, uint8_t val)
+{
+    return midi_out_ready_fast() && midi_out_cc_cont(MIDI_SRC_EXPFS, ch, cc, val, 0, 0) == ESP_OK;
+}
+
+static inline bool send_cc_hr_all(uint8_t ch, uint8_t cc, uint8_t val7, uint32_t val32, bool only_hr)
 {
-    if (usb_midi_ready_fast()) (void)usb_midi_send_cc(ch, cc, val);
-    if (uart_midi_out_ready_fast()) (void)uart_midi_send_cc(ch, cc, val);
+    return midi_out_ready_fast() && midi_out_cc_hr(MIDI_SRC_EXPFS, ch, cc, val7, val32, only_hr, 0, 0) == ESP_OK;
 }
 
-static inline void send_pc_all(uint8_t ch, uint8_t pc)
+static inline bool send_pc_all(uint8_t ch, uint8_t pc)
 {
-    if (usb_midi_ready_fast()) (void)usb_midi_send_pc(ch, pc);
-    if (uart_midi_out_ready_fast()) (void)uart_midi_send_pc(ch, pc);
+    return midi_out_ready_fast() && midi_out_pc(MIDI_SRC_EXPFS, ch, pc, 0, 0) == ESP_OK;
 }
 
 static uint8_t map_exp_value(const expfs_port_cfg_t *cfg, uint16_t raw)
@@ -300,6 +317,75 @@ static uint8_t map_exp_value(const expfs_port_cfg_t *cfg, uint16_t raw)
     return clamp7(out);
 }
 
+// same mapping as map_exp_value (CC only) in 16.16 fixed point, curve LUT
+// interpolated -> full 32-bit MIDI 2.0 range (v1..v2 scaled to 0..0xFFFFFFFF)
+static uint32_t map_exp_value32(const expfs_port_cfg_t *cfg, uint16_t raw)
+{
+    if (!cfg || cfg->exp_action.type != ACT_CC) return 0;
+
+    int lo = (int)cfg->cal_min;
+    int hi = (int)cfg->cal_max;
+    int32_t denom = (int32_t)hi - (int32_t)lo;
+    if (denom > -8 && denom < 8) return 0;
+
+    int mn = (lo < hi) ? lo : hi;
+    int mx = (lo < hi) ? hi : lo;
+    int r = clampi_local((int)raw, mn, mx);
+
+    const int64_t one = 127LL << 16;
+    int64_t n16 = (int64_t)((int32_t)r - (int32_t)lo) * one / (int64_t)denom;
+    if (n16 < 0) n16 = 0;
+    if (n16 > one) n16 = one;
+
+    // curve LUT, linear between entries
+    int i = (int)(n16 >> 16);
+    int32_t fr = (int32_t)(n16 & 0xFFFF);
+    int32_t c0 = s_curve_lut[i];
+    int32_t c1 = s_curve_lut[(i < 127) ? i + 1 : 127];
+    int64_t c16 = ((int64_t)c0 << 16) + (int64_t)(c1 - c0) * fr;
+
+    // invert: down decreases (เหมือน map_exp_value)
+    c16 = one - c16;
+
+    int v1 = cfg->exp_action.b;
+    int v2 = cfg->exp_action.c;
+    int64_t out16;
+    if (v2 >= v1) out16 = ((int64_t)v1 << 16) + c16 * (v2 - v1) / 127;
+    else          out16 = ((int64_t)v1 << 16) - c16 * (v1 - v2) / 127;
+    if (out16 < 0) out16 = 0;
+    if (out16 > one) out16 = one;
+
+    return (uint32_t)((uint64_t)out16 * 0xFFFFFFFFULL / (uint64_t)one);
+}
+
+// MIDI 2.0 device on USB: every 12-bit step goes out as a 32-bit CC,
+// MIDI 1.0 receivers still only see changes of the 7-bit value
+static void send_exp_hr(int port, const expfs_port_cfg_t *cfg, uint16_t raw_f, uint8_t mapped, uint32_t t)
+{
+    uint32_t v32 = map_exp_value32(cfg, raw_f);
+    uint16_t q = (uint16_t)(v32 >> 20);
+
+    if (q != s_pending_hr[port]) {
+        s_pending_hr[port] = q;
+        s_pending_hr_since_ms[port] = t;
+    }
+
+    int diff = (s_last_hr[port] == 0xFFFF) ? 4096 : iabs_local((int)q - (int)s_last_hr[port]);
+    bool stable_ok = (t - s_pending_hr_since_ms[port]) >= EXP_SEND_STABLE_MS;
+    bool throttle_ok = (t - s_last_send_ms[port]) >= EXP_HR_THROTTLE_MS;
+
+    if (q == s_last_hr[port] || !throttle_ok || !(stable_ok || diff >= EXP_HR_FORCE_DELTA)) return;
+
+    s_last_send_ms[port] = t;
+
+    uint8_t ch = (uint8_t)clampi_local((int)cfg->exp_action.ch, 1, 16);
+    uint8_t cc = clamp7(cfg->exp_action.a);
+    bool only_hr = (mapped == s_last_mapped[port]);
+    if (!send_cc_hr_all(ch, cc, mapped, v32, only_hr)) return;
+    s_last_hr[port] = q;
+    s_last_mapped[port] = mapped;
+}
+
 static void handle_exp_port(int port, const expfs_port_cfg_t *cfg)
 {
     // EXP mode:
@@ -347,6 +433,12 @@ static void handle_exp_port(int port, const expfs_port_cfg_t *cfg)
 
     uint32_t t = now_ms();
 
+    if (cfg->exp_action.type == ACT_CC && usb_midi_ump_mask()) {
+        send_exp_hr(port, cfg, raw_f, mapped, t);
+        return;
+    }
+    s_last_hr[port] = 0xFFFF;
+
     // stable window: ต้องนิ่งซักพักก่อนส่ง เพื่อตัดอาการแกว่ง +/-1
     if (mapped != s_pending_mapped[port]) {
         s_pending_mapped[port] = mapped;
@@ -360,26 +452,27 @@ static void handle_exp_port(int port, const expfs_port_cfg_t *cfg)
 
     if (mapped != s_last_mapped[port] && throttle_ok && (stable_ok || diff >= EXP_FORCE_DELTA || s_last_mapped[port] == 0xFF)) {
         s_last_send_ms[port] = t;
-        s_last_mapped[port] = mapped;
 
         uint8_t ch = (uint8_t)clampi_local((int)cfg->exp_action.ch, 1, 16);
+        bool sent = true;
 
         if (cfg->exp_action.type == ACT_CC) {
             uint8_t cc = clamp7(cfg->exp_action.a);
-            send_cc_all(ch, cc, mapped);
+            sent = send_cc_all(ch, cc, mapped);
         } else if (cfg->exp_action.type == ACT_PC) {
-            send_pc_all(ch, mapped);
+            sent = send_pc_all(ch, mapped);
         }
+        if (sent) s_last_mapped[port] = mapped;
     }
 }
 
 static void run_actions_trigger_list(const action_t *list, cc_behavior_t cc_beh)
 {
-    midi_actions_run(list, MAX_ACTIONS, cc_beh, MIDI_EVT_TRIGGER);
+    midi_actions_run(list, MAX_ACTIONS, cc_beh, MIDI_EVT_TRIGGER, MIDI_SRC_EXPFS);
 }
 static void run_actions_down_up_list(const action_t *list, cc_behavior_t cc_beh, int event)
 {
-    midi_actions_run(list, MAX_ACTIONS, cc_beh, event);
+    midi_actions_run(list, MAX_ACTIONS, cc_beh, event, MIDI_SRC_EXPFS);
 }
 
 static void handle_fs_one(int port, int which /*0 tip, 1 ring*/, gpio_num_t pin, const expfs_btncfg_t *m)
@@ -503,6 +596,9 @@ static void expfs_task(void *arg)
             }
         }
 
+        // exp CC ของทั้ง 2 พอร์ตออกไปใน transfer เดียว
+        midi_out_commit(MIDI_SRC_EXPFS);
+
         vTaskDelay(pdMS_TO_TICKS(10));
     }
 }
@@ -9,11 +9,15 @@
 #include "driver/ledc.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_heap_caps.h"
 
 #include "footswitch.h"
 #include "config_store.h"
 #include "midi_actions.h"
+#include "midi_sched.h"
+#include "midi_clock.h"
+#include "usb_midi_host.h"
 
 static const char *TAG = "FOOTSW";
 
@@ -23,6 +27,38 @@ static const gpio_num_t sw_pins[8] = {
     (gpio_num_t)4,  (gpio_num_t)5,  (gpio_num_t)6,  (gpio_num_t)7
 };
 
+// -------------------- switch input (edge ISR) --------------------
+// any-edge ISR -> timestamp into a ring, task woken by notify. debounce works on
+// the timestamps: the first edge after a quiet pin is accepted right away (the
+// pin is read once more in the task, so a spike that is already gone is ignored),
+// then edges are ignored for FOOT_DEBOUNCE_US and the pin is compared again after
+#define FOOT_EVT_RING       64          // edges (power of 2)
+#define FOOT_DEBOUNCE_US    5000
+#define FOOT_TICK_MS        10          // housekeeping (LEDs, long press, combo release)
+#define FOOT_LONG_MS        400
+
+typedef struct {
+    uint32_t t_us;      // esp_timer, low 32 bits (differences only)
+    uint8_t  idx;
+} foot_evt_t;
+
+typedef struct {
+    uint8_t  level;       // debounced pin level: 0 = pressed (pull-up), 1 = released
+    uint8_t  recheck;     // edges inside the lockout -> compare with the pin when it ends
+    uint8_t  burst;       // edge_us valid
+    uint32_t edge_us;     // first edge of the current bounce burst
+    uint32_t last_us;     // last edge seen
+    uint32_t lock_us;     // accepted change at .. (lockout = lock_us + FOOT_DEBOUNCE_US)
+} foot_in_t;
+
+static foot_evt_t s_evt[FOOT_EVT_RING];
+static volatile uint32_t s_evt_head = 0;    // ISR
+static volatile uint32_t s_evt_tail = 0;    // foot task
+static TaskHandle_t s_foot_task = NULL;
+
+static foot_in_t s_in[8];                   // foot task only
+static footswitch_input_stats_t s_in_stats;
+
 // -------------------- leds --------------------
 static const gpio_num_t led_pins[8] = {
     (gpio_num_t)8,  (gpio_num_t)3,  (gpio_num_t)9,  (gpio_num_t)10,
@@ -42,7 +78,7 @@ static inline int wrapi(int v, int max)
     return r;
 }
 
-static inline int pressed(int idx) { return gpio_get_level(sw_pins[idx]) == 0; } // pull-up: pressed=0
+static inline int pressed(int idx) { return s_in[idx].level == 0; } // debounced, pull-up: pressed=0
 
 // -------------------- led (PWM) helpers --------------------
 static const ledc_mode_t  LEDC_MODE  = LEDC_LOW_SPEED_MODE;
@@ -104,12 +140,12 @@ static inline void led_off(int idx) { led_write_raw(idx, 0); }
 // -------------------- run helpers --------------------
 static void run_actions_trigger_list(const action_t *list, cc_behavior_t cc_beh)
 {
-    midi_actions_run(list, MAX_ACTIONS, cc_beh, MIDI_EVT_TRIGGER);
+    midi_actions_run(list, MAX_ACTIONS, cc_beh, MIDI_EVT_TRIGGER, MIDI_SRC_FOOT);
 }
 
 static void run_actions_down_up_list(const action_t *list, cc_behavior_t cc_beh, int event)
 {
-    midi_actions_run(list, MAX_ACTIONS, cc_beh, event);
+    midi_actions_run(list, MAX_ACTIONS, cc_beh, event, MIDI_SRC_FOOT);
 }
 
 footswitch_state_t footswitch_get_state(void) { return s_state; }
@@ -121,10 +157,21 @@ void footswitch_set_bank(int bank)
 
     s_state.bank = (uint8_t)bank;
 
+    // new bank -> sequences still waiting from the old one are dropped
+    midi_sched_cancel(MIDI_SRC_FOOT);
+
     // ✅ persist current bank (so reboot stays here)
     (void)config_store_set_current_bank((uint8_t)bank);
 }
 
+// hold on a tap-tempo button: clock start <-> stop (the hold's own tap is discarded)
+static void clock_toggle_run(void)
+{
+    midi_clock_tap_reset();
+    if (midi_clock_running()) (void)midi_clock_stop();
+    else (void)midi_clock_start();
+}
+
 // -------------------- combo / nav lock --------------------
 // combo:
 // 5&6 -> bank--
@@ -240,6 +287,30 @@ static void dyn_state_init_once(void)
     s_dyn.inited = 1;
 }
 
+// ✅ scenes (midi_scene.c): copy the whole A/B + group state out / back in
+void footswitch_dyn_export(uint8_t *ab, uint8_t *grp)
+{
+    dyn_state_init_once();
+    const size_t ab_bytes = (size_t)MAX_BANKS * (size_t)NUM_BTNS;
+
+    if (ab) {
+        if (s_dyn.ab_state) memcpy(ab, s_dyn.ab_state, ab_bytes);
+        else memset(ab, 0, ab_bytes);
+    }
+    if (grp) {
+        if (s_dyn.group_sel) memcpy(grp, s_dyn.group_sel, MAX_BANKS);
+        else memset(grp, 0xFF, MAX_BANKS);
+    }
+}
+
+void footswitch_dyn_import(const uint8_t *ab, const uint8_t *grp)
+{
+    dyn_state_init_once();
+
+    if (ab && s_dyn.ab_state) memcpy(s_dyn.ab_state, ab, (size_t)MAX_BANKS * (size_t)NUM_BTNS);
+    if (grp && s_dyn.group_sel) memcpy(s_dyn.group_sel, grp, MAX_BANKS);
+}
+
 static inline uint8_t dyn_get_ab(int bank, int btn)
 {
     if (!s_dyn.ab_state) return 0;
@@ -270,23 +341,323 @@ static inline int is_nav_candidate_btn(int i)
     return (i >= 4 && i <= 7);
 }
 
-static void foot_task(void *arg)
+
+// -------------------- switch input --------------------
+static void IRAM_ATTR sw_isr(void *arg)
 {
-    (void)arg;
+    const uint32_t t = (uint32_t)esp_timer_get_time();
+    const uint32_t h = s_evt_head;
+
+    // single producer (GPIO ISR service runs the handlers one after another)
+    if (h - s_evt_tail < FOOT_EVT_RING) {
+        s_evt[h & (FOOT_EVT_RING - 1)].t_us = t;
+        s_evt[h & (FOOT_EVT_RING - 1)].idx = (uint8_t)(uintptr_t)arg;
+        __atomic_store_n(&s_evt_head, h + 1, __ATOMIC_RELEASE);
+    } else {
+        s_in_stats.dropped++;
+    }
 
-    dyn_state_init_once();
+    BaseType_t woken = pdFALSE;
+    if (s_foot_task) vTaskNotifyGiveFromISR(s_foot_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static bool evt_pop(foot_evt_t *out)
+{
+    const uint32_t t = s_evt_tail;
+    if (t == __atomic_load_n(&s_evt_head, __ATOMIC_ACQUIRE)) return false;
+    *out = s_evt[t & (FOOT_EVT_RING - 1)];
+    __atomic_store_n(&s_evt_tail, t + 1, __ATOMIC_RELEASE);
+    return true;
+}
 
-    // inputs
+static void sw_input_init(void)
+{
     gpio_config_t io = {
         .pin_bit_mask = 0,
         .mode = GPIO_MODE_INPUT,
         .pull_up_en = 1,
         .pull_down_en = 0,
-        .intr_type = GPIO_INTR_DISABLE,
+        .intr_type = GPIO_INTR_ANYEDGE,
     };
     for (int i = 0; i < 8; i++) io.pin_bit_mask |= (1ULL << sw_pins[i]);
     gpio_config(&io);
 
+    memset(s_in, 0, sizeof(s_in));
+    for (int i = 0; i < 8; i++) s_in[i].level = (uint8_t)gpio_get_level(sw_pins[i]);
+
+    // shared service (ESP_ERR_INVALID_STATE = someone else installed it already)
+    esp_err_t e = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+    if (e != ESP_OK && e != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "gpio isr service failed: %s", esp_err_to_name(e));
+        return;
+    }
+    for (int i = 0; i < 8; i++) {
+        e = gpio_isr_handler_add(sw_pins[i], sw_isr, (void *)(uintptr_t)i);
+        if (e != ESP_OK) ESP_LOGE(TAG, "isr add sw%d failed: %s", i + 1, esp_err_to_name(e));
+    }
+}
+
+// debounced change of pin i -> handled right away by the caller
+typedef struct {
+    uint8_t  idx;
+    uint8_t  level;
+    uint32_t t_us;
+} sw_change_t;
+
+// drain the edge ring into debounced changes (at most one per pin per call)
+static int sw_input_poll(sw_change_t *out)
+{
+    int n = 0;
+    foot_evt_t ev;
+    uint8_t hit = 0;
+
+    while (evt_pop(&ev)) {
+        s_in_stats.edges++;
+        if (ev.idx >= 8) continue;
+        foot_in_t *p = &s_in[ev.idx];
+
+        p->last_us = ev.t_us;
+        if (p->lock_us && (uint32_t)(ev.t_us - p->lock_us) < FOOT_DEBOUNCE_US) {
+            p->recheck = 1;
+            continue;
+        }
+        p->lock_us = 0;
+        if (!p->burst || (uint32_t)(ev.t_us - p->edge_us) > FOOT_DEBOUNCE_US) {
+            p->edge_us = ev.t_us;
+            p->burst = 1;
+        }
+        hit |= (uint8_t)(1u << ev.idx);
+    }
+
+    const uint32_t now = (uint32_t)esp_timer_get_time();
+
+    for (int i = 0; i < 8; i++) {
+        foot_in_t *p = &s_in[i];
+
+        // lockout over: an edge inside it may have left the pin somewhere else
+        if (p->lock_us && (uint32_t)(now - p->lock_us) >= FOOT_DEBOUNCE_US) {
+            p->lock_us = 0;
+            if (p->recheck) {
+                p->recheck = 0;
+                const uint8_t lv = (uint8_t)gpio_get_level(sw_pins[i]);
+                if (lv != p->level) {
+                    p->level = lv;
+                    p->lock_us = p->last_us;
+                    s_in_stats.accepted++;
+                    out[n++] = (sw_change_t){ (uint8_t)i, lv, p->last_us };
+                }
+            }
+            continue;
+        }
+
+        if (!(hit & (1u << i))) continue;
+
+        const uint8_t lv = (uint8_t)gpio_get_level(sw_pins[i]);
+        if (lv == p->level) {
+            // already back (spike, or mid-bounce: the next edge comes soon)
+            s_in_stats.glitches++;
+            continue;
+        }
+        p->level = lv;
+        p->lock_us = p->edge_us;
+        p->burst = 0;
+        s_in_stats.accepted++;
+        out[n++] = (sw_change_t){ (uint8_t)i, lv, p->edge_us };
+    }
+    return n;
+}
+
+// -------------------- buttons --------------------
+// per-button state, foot task only. hold time = timestamps (edge .. now / release edge)
+static uint8_t  s_last[8];
+static uint32_t s_down_us[8];
+static uint8_t  s_long_fired[8];
+
+static inline uint32_t held_ms(int i, uint32_t t_us)
+{
+    return (uint32_t)(t_us - s_down_us[i]) / 1000u;
+}
+
+// one button: now = pin level (0 pressed), t_us = when it got there (edge) or the
+// current time (housekeeping pass)
+static void btn_step(const foot_config_t *cfg, int bank, int i, int now, uint32_t t_us)
+{
+    const btn_map_t *m = &cfg->map[bank][i];
+
+    // ✅ NEW: ระหว่าง nav lock ห้ามปุ่มอื่นยิงค่าใด ๆ
+    // ต้องกดใหม่หลังปลดล็อกเท่านั้น
+    if (s_nav_lock && !(s_nav_hold_mask & (1u << i))) {
+        s_last[i] = (uint8_t)now;
+        s_down_us[i] = t_us;
+        s_long_fired[i] = 0;
+        return;
+    }
+
+    // ✅ ปุ่มที่ถูกใช้เป็นคอมโบแล้ว: ห้ามยิง action ใด ๆ
+    if (s_nav_consumed_mask & (1u << i)) {
+        s_last[i] = (uint8_t)now;
+        s_down_us[i] = t_us;
+        s_long_fired[i] = 0;
+        return;
+    }
+
+    // (กันปุ่มคอมโบไว้เหมือนเดิม)
+    if (s_combo_mask & (1u << i)) {
+        s_last[i] = (uint8_t)now;
+        s_down_us[i] = t_us;
+        s_long_fired[i] = 0;
+        return;
+    }
+
+    const action_t *listA = m->short_actions;
+    const action_t *listB = m->long_actions;
+
+    // ✅ NEW: ปุ่ม 5-8 ทำเป็น "defer" เพื่อกันยิง CC ก่อนจะเข้าคอมโบ
+    if (is_nav_candidate_btn(i)) {
+        // edge: down -> mark pending (ยังไม่ยิงอะไร)
+        if (s_last[i] == 1 && now == 0) {
+            s_nav_pending_mask |= (1u << i);
+            s_down_us[i] = t_us;
+            s_long_fired[i] = 0;
+            s_last[i] = (uint8_t)now;
+            return;
+        }
+
+        // edge: up -> ถ้า pending และไม่ได้ถูก consume เป็นคอมโบ -> ยิงตอนปล่อย
+        // (hold = down .. up timestamps, ตัดสิน short/long ตรงนี้)
+        if (s_last[i] == 0 && now == 1) {
+            if (s_nav_pending_mask & (1u << i)) {
+                // clear pending ก่อน
+                s_nav_pending_mask &= (uint8_t)~(1u << i);
+                const uint32_t hold = held_ms(i, t_us);
+
+                // ทำงาน "ตอนปล่อย" เท่านั้น (กันกรณีคอมโบ)
+                if (m->press_mode == BTN_TAP_TEMPO) {
+                    if (hold >= FOOT_LONG_MS) clock_toggle_run();
+                    else midi_clock_tap();
+                } else if (m->press_mode == BTN_SHORT_GROUP_LED) {
+                    run_actions_trigger_list(listA, m->cc_behavior);
+                    dyn_set_group(bank, (uint8_t)i);
+                } else if (m->press_mode == BTN_TOGGLE) {
+                    uint8_t st = dyn_get_ab(bank, i) ? 1 : 0;
+                    run_actions_trigger_list(st ? listB : listA, m->cc_behavior);
+                    dyn_set_ab(bank, i, (uint8_t)!st);
+                } else if (m->press_mode == BTN_SHORT_LONG) {
+                    if (hold >= FOOT_LONG_MS) run_actions_trigger_list(listB, m->cc_behavior);
+                    else run_actions_trigger_list(listA, m->cc_behavior);
+                } else {
+                    // BTN_SHORT หรืออื่น ๆ -> short
+                    run_actions_trigger_list(listA, m->cc_behavior);
+                }
+
+                s_long_fired[i] = 0;
+                s_last[i] = (uint8_t)now;
+                return;
+            }
+        }
+
+        s_last[i] = (uint8_t)now;
+        return;
+    }
+
+    // -------------------- NORMAL buttons (1-4) --------------------
+    // tap tempo: tap on press-down, hold = clock start/stop (no actions)
+    if (m->press_mode == BTN_TAP_TEMPO) {
+        if (s_last[i] == 1 && now == 0) {
+            s_down_us[i] = t_us;
+            s_long_fired[i] = 0;
+            midi_clock_tap();
+        }
+        if (now == 0) {
+            if (!s_long_fired[i] && held_ms(i, t_us) >= FOOT_LONG_MS) {
+                clock_toggle_run();
+                s_long_fired[i] = 1;
+            }
+        }
+        if (s_last[i] == 0 && now == 1) {
+            s_long_fired[i] = 0;
+        }
+        s_last[i] = (uint8_t)now;
+        return;
+    }
+
+    // edge: down
+    if (s_last[i] == 1 && now == 0) {
+        s_down_us[i] = t_us;
+        s_long_fired[i] = 0;
+
+        // momentary: DOWN
+        if (m->cc_behavior == CC_MOMENTARY) {
+            if (m->press_mode == BTN_TOGGLE) {
+                uint8_t st = dyn_get_ab(bank, i) ? 1 : 0;
+                s_dyn.pressed_sel[i] = st;
+                run_actions_down_up_list(st ? listB : listA, m->cc_behavior, MIDI_EVT_DOWN);
+            } else {
+                run_actions_down_up_list(listA, m->cc_behavior, MIDI_EVT_DOWN);
+            }
+        }
+
+        // group: trigger + select
+        if (m->press_mode == BTN_SHORT_GROUP_LED) {
+            run_actions_trigger_list(listA, m->cc_behavior);
+            dyn_set_group(bank, (uint8_t)i);
+        }
+
+        // toggle: trigger + flip A/B
+        if (m->press_mode == BTN_TOGGLE) {
+            uint8_t st = dyn_get_ab(bank, i) ? 1 : 0;
+            run_actions_trigger_list(st ? listB : listA, m->cc_behavior);
+            dyn_set_ab(bank, i, (uint8_t)!st);
+        }
+    }
+
+    // hold
+    if (now == 0) {
+        if (m->press_mode == BTN_SHORT_LONG && !s_long_fired[i] && held_ms(i, t_us) >= FOOT_LONG_MS) {
+            run_actions_trigger_list(listB, m->cc_behavior);
+            s_long_fired[i] = 1;
+        }
+    }
+
+    // edge: up
+    if (s_last[i] == 0 && now == 1) {
+        if (m->cc_behavior == CC_MOMENTARY) {
+            if (m->press_mode == BTN_TOGGLE) {
+                uint8_t sel = s_dyn.pressed_sel[i] ? 1 : 0;
+                run_actions_down_up_list(sel ? listB : listA, m->cc_behavior, MIDI_EVT_UP);
+            } else {
+                run_actions_down_up_list(listA, m->cc_behavior, MIDI_EVT_UP);
+            }
+        }
+
+        // short: fire on release
+        if (m->press_mode == BTN_SHORT) {
+            run_actions_trigger_list(listA, m->cc_behavior);
+        }
+
+        if (m->press_mode == BTN_SHORT_LONG) {
+            if (!s_long_fired[i] && held_ms(i, t_us) < FOOT_LONG_MS) {
+                run_actions_trigger_list(listA, m->cc_behavior);
+            }
+        }
+
+        s_long_fired[i] = 0;
+    }
+
+    s_last[i] = (uint8_t)now;
+}
+
+static void foot_task(void *arg)
+{
+    (void)arg;
+
+    dyn_state_init_once();
+
+    // inputs (edge ISR -> this task)
+    s_foot_task = xTaskGetCurrentTaskHandle();
+    sw_input_init();
+
     // ledc timer + channels
     ledc_timer_config_t tc = {
         .speed_mode       = LEDC_MODE,
@@ -320,20 +691,43 @@ static void foot_task(void *arg)
     for (int i = 0; i < 8; i++) s_led_on[i] = 1;
     led_apply_all();
 
-    uint8_t last[8];
-    for (int i = 0; i < 8; i++) last[i] = 1;
+    for (int i = 0; i < 8; i++) s_last[i] = 1;
+    memset(s_down_us, 0, sizeof(s_down_us));
+    memset(s_long_fired, 0, sizeof(s_long_fired));
 
-    const int LONG_MS = 400;
+    uint8_t last_bri = s_brightness;
 
-    int hold_ms[8] = {0};
-    uint8_t long_fired[8] = {0};
+    // USB slot generations already seen (a change = device (re)attached)
+    uint32_t usb_gen[USB_MIDI_MAX_DEVS] = {0};
 
-    uint8_t last_bri = s_brightness;
+    sw_change_t chg[8];
 
     while (1) {
+        // ✅ edge -> woken right away; otherwise one housekeeping pass per tick
+        (void)ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FOOT_TICK_MS));
+
+        const foot_config_t *cfg = config_store_get();
+        int bank = (int)s_state.bank;
+
+        // 1) debounced edges first (press -> actions queued before anything else)
+        const int nchg = sw_input_poll(chg);
+        for (int k = 0; k < nchg; k++) {
+            apply_combo_logic();
+            bank = (int)s_state.bank;
+            if (!cfg) continue;
+
+            btn_step(cfg, bank, chg[k].idx, chg[k].level, chg[k].t_us);
+
+            // edge .. actions handed to the dispatcher
+            uint32_t us = (uint32_t)esp_timer_get_time() - chg[k].t_us;
+            s_in_stats.lat_last_us = us;
+            if (us > s_in_stats.lat_max_us) s_in_stats.lat_max_us = us;
+        }
+
+        // 2) housekeeping: combo release, long press, brightness, usb resync, LEDs
         apply_combo_logic();
+        bank = (int)s_state.bank;
 
-        // live brightness update
         uint8_t bri = config_store_get_led_brightness();
         if (bri > 100) bri = 100;
         if (bri != last_bri) {
@@ -341,181 +735,37 @@ static void foot_task(void *arg)
             led_set_brightness(bri);
         }
 
-        const foot_config_t *cfg = config_store_get();
-        int bank = (int)s_state.bank;
-
         if (!cfg) {
             for (int i = 0; i < 8; i++) {
-                int now = gpio_get_level(sw_pins[i]);
+                int now = s_in[i].level;
                 if (now == 0) led_off(i);
                 else led_on(i);
-                last[i] = (uint8_t)now;
-                hold_ms[i] = 0;
-                long_fired[i] = 0;
+                s_last[i] = (uint8_t)now;
+                s_long_fired[i] = 0;
             }
-            vTaskDelay(pdMS_TO_TICKS(10));
             continue;
         }
 
-        for (int i = 0; i < 8; i++) {
-            int now = gpio_get_level(sw_pins[i]); // 0 pressed, 1 released
-            const btn_map_t *m = &cfg->map[bank][i];
-
-            // ✅ NEW: ระหว่าง nav lock ห้ามปุ่มอื่นยิงค่าใด ๆ
-            // ต้องกดใหม่หลังปลดล็อกเท่านั้น
-            if (s_nav_lock && !(s_nav_hold_mask & (1u << i))) {
-                last[i] = (uint8_t)now;
-                hold_ms[i] = 0;
-                long_fired[i] = 0;
-                continue;
-            }
+        // ✅ USB device came back -> optionally bring it in line with what the LEDs show
+        for (int d = 0; d < USB_MIDI_MAX_DEVS; d++) {
+            uint32_t gen = usb_midi_conn_gen(d);
+            if (gen == usb_gen[d]) continue;
+            usb_gen[d] = gen;
+            if (!config_store_get_usb_resync()) continue;
 
-            // ✅ ปุ่มที่ถูกใช้เป็นคอมโบแล้ว: ห้ามยิง action ใด ๆ
-            if (s_nav_consumed_mask & (1u << i)) {
-                last[i] = (uint8_t)now;
-                hold_ms[i] = 0;
-                long_fired[i] = 0;
-                continue;
-            }
-
-            // (กันปุ่มคอมโบไว้เหมือนเดิม)
-            if (s_combo_mask & (1u << i)) {
-                last[i] = (uint8_t)now;
-                hold_ms[i] = 0;
-                long_fired[i] = 0;
-                continue;
-            }
-
-            const action_t *listA = m->short_actions;
-            const action_t *listB = m->long_actions;
-
-            // ✅ NEW: ปุ่ม 5-8 ทำเป็น "defer" เพื่อกันยิง CC ก่อนจะเข้าคอมโบ
-            if (is_nav_candidate_btn(i)) {
-                // edge: down -> mark pending (ยังไม่ยิงอะไร)
-                if (last[i] == 1 && now == 0) {
-                    s_nav_pending_mask |= (1u << i);
-                    hold_ms[i] = 0;
-                    long_fired[i] = 0;
-                    last[i] = (uint8_t)now;
-                    continue;
-                }
-
-                // hold (เก็บเวลาไว้ตัดสิน short/long ตอนปล่อย)
-                if (now == 0) {
-                    if (s_nav_pending_mask & (1u << i)) {
-                        hold_ms[i] += 10;
-                        last[i] = (uint8_t)now;
-                        continue;
-                    }
-                }
-
-                // edge: up -> ถ้า pending และไม่ได้ถูก consume เป็นคอมโบ -> ยิงตอนปล่อย
-                if (last[i] == 0 && now == 1) {
-                    if (s_nav_pending_mask & (1u << i)) {
-                        // clear pending ก่อน
-                        s_nav_pending_mask &= (uint8_t)~(1u << i);
-
-                        // ทำงาน "ตอนปล่อย" เท่านั้น (กันกรณีคอมโบ)
-                        if (m->press_mode == BTN_SHORT_GROUP_LED) {
-                            run_actions_trigger_list(listA, m->cc_behavior);
-                            dyn_set_group(bank, (uint8_t)i);
-                        } else if (m->press_mode == BTN_TOGGLE) {
-                            uint8_t st = dyn_get_ab(bank, i) ? 1 : 0;
-                            run_actions_trigger_list(st ? listB : listA, m->cc_behavior);
-                            dyn_set_ab(bank, i, (uint8_t)!st);
-                        } else if (m->press_mode == BTN_SHORT_LONG) {
-                            if (hold_ms[i] >= LONG_MS) run_actions_trigger_list(listB, m->cc_behavior);
-                            else run_actions_trigger_list(listA, m->cc_behavior);
-                        } else {
-                            // BTN_SHORT หรืออื่น ๆ -> short
-                            run_actions_trigger_list(listA, m->cc_behavior);
-                        }
-
-                        hold_ms[i] = 0;
-                        long_fired[i] = 0;
-                        last[i] = (uint8_t)now;
-                        continue;
-                    }
-                }
-
-                last[i] = (uint8_t)now;
-                continue;
-            }
-
-            // -------------------- NORMAL buttons (1-4) --------------------
-            // edge: down
-            if (last[i] == 1 && now == 0) {
-                hold_ms[i] = 0;
-                long_fired[i] = 0;
-
-                // momentary: DOWN
-                if (m->cc_behavior == CC_MOMENTARY) {
-                    if (m->press_mode == BTN_TOGGLE) {
-                        uint8_t st = dyn_get_ab(bank, i) ? 1 : 0;
-                        s_dyn.pressed_sel[i] = st;
-                        run_actions_down_up_list(st ? listB : listA, m->cc_behavior, MIDI_EVT_DOWN);
-                    } else {
-                        run_actions_down_up_list(listA, m->cc_behavior, MIDI_EVT_DOWN);
-                    }
-                }
-
-                // group: trigger + select
-                if (m->press_mode == BTN_SHORT_GROUP_LED) {
-                    run_actions_trigger_list(listA, m->cc_behavior);
-                    dyn_set_group(bank, (uint8_t)i);
-                }
-
-                // toggle: trigger + flip A/B
-                if (m->press_mode == BTN_TOGGLE) {
-                    uint8_t st = dyn_get_ab(bank, i) ? 1 : 0;
-                    run_actions_trigger_list(st ? listB : listA, m->cc_behavior);
-                    dyn_set_ab(bank, i, (uint8_t)!st);
-                }
-            }
-
-            // hold
-            if (now == 0) {
-                hold_ms[i] += 10;
-
-                if (m->press_mode == BTN_SHORT_LONG && !long_fired[i] && hold_ms[i] >= LONG_MS) {
-                    run_actions_trigger_list(listB, m->cc_behavior);
-                    long_fired[i] = 1;
-                }
-            }
-
-            // edge: up
-            if (last[i] == 0 && now == 1) {
-                if (m->cc_behavior == CC_MOMENTARY) {
-                    if (m->press_mode == BTN_TOGGLE) {
-                        uint8_t sel = s_dyn.pressed_sel[i] ? 1 : 0;
-                        run_actions_down_up_list(sel ? listB : listA, m->cc_behavior, MIDI_EVT_UP);
-                    } else {
-                        run_actions_down_up_list(listA, m->cc_behavior, MIDI_EVT_UP);
-                    }
-                }
-
-                // short: fire on release
-                if (m->press_mode == BTN_SHORT) {
-                    run_actions_trigger_list(listA, m->cc_behavior);
-                }
-
-                if (m->press_mode == BTN_SHORT_LONG) {
-                    if (!long_fired[i] && hold_ms[i] < LONG_MS) {
-                        run_actions_trigger_list(listA, m->cc_behavior);
-                    }
-                }
-
-                hold_ms[i] = 0;
-                long_fired[i] = 0;
-            }
-
-            last[i] = (uint8_t)now;
+            uint8_t ab[NUM_BTNS];
+            for (int i = 0; i < NUM_BTNS; i++) ab[i] = dyn_get_ab(bank, i);
+            (void)midi_actions_resync_usb(d, cfg, bank, ab);
         }
 
+        // long press while held (no edge to report it)
+        const uint32_t t_now = (uint32_t)esp_timer_get_time();
+        for (int i = 0; i < 8; i++) btn_step(cfg, bank, i, s_in[i].level, t_now);
+
         // -------------------- LED render pass --------------------
         for (int i = 0; i < 8; i++) {
             const btn_map_t *m = &cfg->map[bank][i];
-            int is_down = (gpio_get_level(sw_pins[i]) == 0);
+            int is_down = (s_in[i].level == 0);
 
             // group mode
             if (m->press_mode == BTN_SHORT_GROUP_LED) {
@@ -526,6 +776,14 @@ static void foot_task(void *arg)
                 continue;
             }
 
+            // tap tempo: flash on every beat while the clock runs
+            if (m->press_mode == BTN_TAP_TEMPO) {
+                int on = midi_clock_running() ? midi_clock_beat_led() : 1;
+                if (is_down) on = 0;
+                if (on) led_on(i); else led_off(i);
+                continue;
+            }
+
             // toggle: a+b led select (0=A,1=B)
             if (m->press_mode == BTN_TOGGLE) {
                 uint8_t ledsel = config_store_get_ab_led_sel(bank, i); // 0=A,1=B
@@ -541,8 +799,6 @@ static void foot_task(void *arg)
             if (is_down) led_off(i);
             else led_on(i);
         }
-
-        vTaskDelay(pdMS_TO_TICKS(10));
     }
 }
 
@@ -551,5 +807,11 @@ void footswitch_start(void)
     // ✅ restore last bank (persisted)
     footswitch_set_bank((int)config_store_get_current_bank());
 
-    xTaskCreatePinnedToCore(foot_task, "footswitch", 4096, NULL, 6, NULL, 1);
+    // 7: above expfs / display (6) so a press is handled as soon as its edge arrives
+    xTaskCreatePinnedToCore(foot_task, "footswitch", 4096, NULL, 7, NULL, 1);
+}
+
+void footswitch_get_input_stats(footswitch_input_stats_t *out)
+{
+    if (out) *out = s_in_stats;
 }
@@ -10,3 +10,19 @@ void footswitch_start(void);
 
 footswitch_state_t footswitch_get_state(void);
 void footswitch_set_bank(int bank);
+
+// A/B toggle state [MAX_BANKS][NUM_BTNS] and group selection [MAX_BANKS] (scenes)
+void footswitch_dyn_export(uint8_t *ab, uint8_t *grp);
+void footswitch_dyn_import(const uint8_t *ab, const uint8_t *grp);
+
+// switch input (edge ISR + timestamp debounce)
+typedef struct {
+    uint32_t edges;        // ISR edges (bounce included)
+    uint32_t accepted;     // debounced press / release
+    uint32_t glitches;     // edges whose pin was already back when read
+    uint32_t dropped;      // edge ring full
+    uint32_t lat_last_us;  // edge .. actions queued for the dispatcher
+    uint32_t lat_max_us;
+} footswitch_input_stats_t;
+
+void footswitch_get_input_stats(footswitch_input_stats_t *out);
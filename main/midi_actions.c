@@ -9,13 +9,26 @@
 #include "esp_heap_caps.h"
 
 #include "midi_actions.h"
+#include "midi_out.h"
+#include "midi_prog.h"
+#include "midi_sched.h"
 #include "usb_midi_host.h"
 #include "uart_midi_out.h"
 
 static const char *TAG = "MIDI_ACT";
 
 // ✅ moved toggle table to heap (PSRAM first) to save internal DRAM (.bss)
+// entry: 0 = off, TOG_ON | value = on (value = what went out, for resync)
 static uint8_t *s_toggle = NULL; // size = 16*128
+#define TOG_ON  0x80u
+
+// -------------------- resync on USB attach --------------------
+#define RESYNC_SETTLE_MS   20   // device finishes its own power-up first
+#define RESYNC_BATCH       8    // messages per step
+#define RESYNC_STEP_MS     4    // -> at most ~2000 msg/s
+#define RESYNC_MAX         64   // burst cap (shares the scheduler pool with ACT_DELAY)
+
+static midi_resync_stats_t s_resync;
 
 static inline uint8_t clamp7(int v)  { if (v < 0) return 0; if (v > 127) return 127; return (uint8_t)v; }
 static inline uint8_t clampCh(int v) { if (v < 1) return 1; if (v > 16) return 16; return (uint8_t)v; }
@@ -42,35 +55,66 @@ static void toggle_init_once(void)
     }
 }
 
-static inline void send_cc_all(uint8_t ch, uint8_t cc, uint8_t val)
+// queue only: dispatcher task (midi_out.c) owns USB/UART
+// delay_ms > 0 (after an ACT_DELAY) -> timer wheel, never waits here
+// a = the action (flags in c, USB cable mask)
+static inline void send_cc_all(midi_src_t src, uint32_t delay_ms, const action_t *a, uint8_t ch, uint8_t cc, uint8_t val)
 {
-    if (usb_midi_ready_fast()) (void)usb_midi_send_cc(ch, cc, val);
-    if (uart_midi_out_ready_fast()) (void)uart_midi_send_cc(ch, cc, val);
+    if (delay_ms) (void)midi_sched_cc(delay_ms, src, ch, cc, val, a->c, a->cables);
+    else (void)midi_out_cc(src, ch, cc, val, a->c, a->cables);
 }
 
-static inline void send_pc_all(uint8_t ch, uint8_t pc)
+static inline void send_sysex(midi_src_t src, uint32_t delay_ms, const action_t *a)
 {
-    if (usb_midi_ready_fast()) (void)usb_midi_send_pc(ch, pc);
-    if (uart_midi_out_ready_fast()) (void)uart_midi_send_pc(ch, pc);
+    if (delay_ms) (void)midi_sched_sysex(delay_ms, src, a->a, a->c, a->cables);
+    else (void)midi_out_sysex(src, a->a, a->c, a->cables);
 }
 
-void midi_actions_run(const action_t *actions, int n, cc_behavior_t cc_behavior, int event)
+static inline void send_pc_all(midi_src_t src, uint32_t delay_ms, const action_t *a, uint8_t ch, uint8_t pc)
 {
-    const int usb_ok  = usb_midi_ready_fast();
-    const int uart_ok = uart_midi_out_ready_fast();
+    if (delay_ms) (void)midi_sched_pc(delay_ms, src, ch, pc, a->c, a->cables);
+    else (void)midi_out_pc(src, ch, pc, a->c, a->cables);
+}
 
+void midi_actions_run(const action_t *actions, int n, cc_behavior_t cc_behavior, int event, midi_src_t src)
+{
     // ✅ ถ้าไม่มีทางส่งออกเลย -> drop
-    if (!usb_ok && !uart_ok) return;
+    if (!midi_out_ready_fast()) return;
+
+    // ✅ fast path: list compiled at config time -> one queue entry, no per-action work
+    if (cc_behavior == CC_NORMAL && event == MIDI_EVT_TRIGGER && n == MAX_ACTIONS) {
+        const midi_prog_t *p = midi_prog_lookup(actions);
+        if (p) {
+            // (n / usb_n / din_len read without the seqlock: a hint, the copy below is exact)
+            if (p->n == 0) return;
+            // routed to transports that are all down -> not worth a queue slot
+            if (!((p->usb_n && usb_midi_ready_fast()) || (p->din_len && uart_midi_out_ready_fast()))) return;
+            if (midi_out_prog(src, p) == ESP_OK) {
+                midi_out_commit(src);
+                return;
+            }
+            // slot mid-rebuild / no program copy free -> interpreted below, never dropped
+        }
+    }
 
     // only allocate when we might need it
     if (cc_behavior == CC_TOGGLE) {
         toggle_init_once();
     }
 
+    // sum of ACT_DELAY seen so far (actions after it go out that much later)
+    uint32_t delay_ms = 0;
+
     for (int i = 0; i < n; i++) {
         const action_t *a = &actions[i];
         if (a->type == ACT_NONE) continue;
 
+        if (a->type == ACT_DELAY) {
+            delay_ms += ACTION_DELAY_MS(a);
+            if (delay_ms > MIDI_SCHED_MAX_MS) delay_ms = MIDI_SCHED_MAX_MS;
+            continue;
+        }
+
         uint8_t ch = clampCh(a->ch);
 
         if (a->type == ACT_CC) {
@@ -80,28 +124,28 @@ void midi_actions_run(const action_t *actions, int n, cc_behavior_t cc_behavior,
 
             if (cc_behavior == CC_NORMAL) {
                 if (event != MIDI_EVT_TRIGGER) continue;
-                send_cc_all(ch, cc, valA);
+                send_cc_all(src, delay_ms, a, ch, cc, valA);
 
             } else if (cc_behavior == CC_TOGGLE) {
                 if (event != MIDI_EVT_TRIGGER) continue;
 
                 // if no toggle table available -> behave like NORMAL (no crash)
                 if (!s_toggle) {
-                    send_cc_all(ch, cc, valA);
+                    send_cc_all(src, delay_ms, a, ch, cc, valA);
                     continue;
                 }
 
                 uint8_t *st = &s_toggle[tog_idx(ch, cc)];
-                *st = (uint8_t)!(*st);
+                *st = (*st & TOG_ON) ? 0 : (uint8_t)(TOG_ON | valA);
 
-                uint8_t outv = (*st) ? valA : valB;
-                send_cc_all(ch, cc, outv);
+                uint8_t outv = (*st & TOG_ON) ? valA : valB;
+                send_cc_all(src, delay_ms, a, ch, cc, outv);
 
             } else if (cc_behavior == CC_MOMENTARY) {
                 if (event == MIDI_EVT_DOWN) {
-                    send_cc_all(ch, cc, valA);
+                    send_cc_all(src, delay_ms, a, ch, cc, valA);
                 } else if (event == MIDI_EVT_UP) {
-                    send_cc_all(ch, cc, valB);
+                    send_cc_all(src, delay_ms, a, ch, cc, valB);
                 }
             }
             continue;
@@ -111,8 +155,104 @@ void midi_actions_run(const action_t *actions, int n, cc_behavior_t cc_behavior,
 
         if (a->type == ACT_PC) {
             uint8_t pc = clamp7(a->a);
-            send_pc_all(ch, pc);
+            send_pc_all(src, delay_ms, a, ch, pc);
             continue;
         }
+
+        if (a->type == ACT_SYSEX) {
+            send_sysex(src, delay_ms, a);
+            continue;
+        }
+    }
+
+    // ✅ whole list -> dispatcher sends it as one batch (one bulk transfer up to 16 events)
+    midi_out_commit(src);
+}
+
+// -------------------- resync on USB attach --------------------
+typedef struct {
+    int dev;
+    int n;
+    uint8_t seen[16 * 128 / 8];         // ch/cc already in the burst
+} resync_t;
+
+static resync_t s_rs;                   // footswitch task only
+
+static bool hits_usb_dev(const action_t *a, int dev)
+{
+    if (!ACTION_F_TO_USB(a->c)) return false;
+    const uint8_t devs = ACTION_F_USB_DEVS(a->c);
+    return devs == 0 || (devs & (1u << dev));
+}
+
+static void resync_cc(resync_t *r, const action_t *a, uint8_t ch, uint8_t cc, uint8_t val)
+{
+    const size_t i = tog_idx(ch, cc);
+    if (r->seen[i >> 3] & (1u << (i & 7))) return;
+    r->seen[i >> 3] |= (uint8_t)(1u << (i & 7));
+
+    if (r->n >= RESYNC_MAX) { s_resync.capped++; return; }
+
+    // RESYNC_BATCH messages per step, steps RESYNC_STEP_MS apart
+    const uint32_t delay = RESYNC_SETTLE_MS + (uint32_t)(r->n / RESYNC_BATCH) * RESYNC_STEP_MS;
+
+    // this device only (same cables as the action); ALWAYS: its mirror was just reset anyway
+    const uint8_t flags = (uint8_t)((a->c & ~(ACTION_F_USB_MASK | ACTION_F_ROUTE_MASK)) |
+                                    ACTION_F_ALWAYS |
+                                    ACTION_F_ROUTE(ACTION_ROUTE_USB) |
+                                    ACTION_F_USB_DEV(r->dev));
+    if (midi_sched_cc(delay, MIDI_SRC_SCHED, ch, cc, val, flags, a->cables) == ESP_OK) r->n++;
+}
+
+int midi_actions_resync_usb(int dev, const foot_config_t *cfg, int bank, const uint8_t *ab)
+{
+    if (!cfg || dev < 0 || dev >= USB_MIDI_MAX_DEVS || bank < 0 || bank >= MAX_BANKS) return 0;
+
+    resync_t *r = &s_rs;
+    memset(r, 0, sizeof(*r));
+    r->dev = dev;
+
+    // 1) current bank, A/B buttons: ab = 1 -> list A was the last one sent
+    for (int i = 0; ab && i < NUM_BTNS; i++) {
+        const btn_map_t *m = &cfg->map[bank][i];
+        if (m->press_mode != BTN_TOGGLE || m->cc_behavior != CC_NORMAL || !ab[i]) continue;
+
+        for (int k = 0; k < MAX_ACTIONS; k++) {
+            const action_t *a = &m->short_actions[k];
+            if (a->type != ACT_CC || !hits_usb_dev(a, dev)) continue;
+            resync_cc(r, a, clampCh(a->ch), clamp7(a->a), clamp7(a->b));
+        }
     }
+
+    // 2) CC toggles that are on (the table is global -> every bank)
+    for (int b = 0; s_toggle && b < cfg->bank_count && b < MAX_BANKS; b++) {
+        for (int i = 0; i < NUM_BTNS; i++) {
+            const btn_map_t *m = &cfg->map[b][i];
+            if (m->cc_behavior != CC_TOGGLE) continue;
+
+            for (int k = 0; k < MAX_ACTIONS * 2; k++) {
+                const action_t *a = (k < MAX_ACTIONS) ? &m->short_actions[k] : &m->long_actions[k - MAX_ACTIONS];
+                if (a->type != ACT_CC || !hits_usb_dev(a, dev)) continue;
+
+                const uint8_t ch = clampCh(a->ch);
+                const uint8_t cc = clamp7(a->a);
+                const uint8_t st = s_toggle[tog_idx(ch, cc)];
+                if (st & TOG_ON) resync_cc(r, a, ch, cc, (uint8_t)(st & 0x7F));
+            }
+        }
+    }
+
+    s_resync.bursts++;
+    s_resync.msgs += (uint32_t)r->n;
+    s_resync.last_msgs = (uint32_t)r->n;
+    s_resync.last_dev = (uint8_t)dev;
+
+    ESP_LOGI(TAG, "usb dev%d attached: resync %d CC over ~%d ms", dev, r->n,
+             r->n ? RESYNC_SETTLE_MS + ((r->n - 1) / RESYNC_BATCH) * RESYNC_STEP_MS : 0);
+    return r->n;
+}
+
+void midi_actions_get_resync_stats(midi_resync_stats_t *out)
+{
+    if (out) *out = s_resync;
 }
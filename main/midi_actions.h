@@ -1,10 +1,28 @@
 ﻿// ===== FILE: main/midi_actions.h =====
 #pragma once
 #include "config_store.h"
+#include "midi_out.h"
 
 // event:
 #define MIDI_EVT_TRIGGER 0  // one-shot (short/long/immediate)
 #define MIDI_EVT_DOWN    1  // press-down
 #define MIDI_EVT_UP      2  // release
 
-void midi_actions_run(const action_t *actions, int n, cc_behavior_t cc_behavior, int event);
+// queues the list on src's output queue (see midi_out.h); never blocks on USB/UART
+void midi_actions_run(const action_t *actions, int n, cc_behavior_t cc_behavior, int event, midi_src_t src);
+
+// ✅ resync: USB device dev just (re)attached -> schedule a short, rate-limited CC
+// burst (to that device only) that restores what the board shows:
+// CC toggles that are on + A/B buttons of the current bank whose list A was sent last.
+// ab = A/B state of bank [NUM_BTNS]. returns messages scheduled
+int midi_actions_resync_usb(int dev, const foot_config_t *cfg, int bank, const uint8_t *ab);
+
+typedef struct {
+    uint32_t bursts;       // attaches replayed
+    uint32_t msgs;         // CC scheduled (all bursts)
+    uint32_t last_msgs;
+    uint32_t capped;       // left out: burst cap reached
+    uint8_t  last_dev;
+} midi_resync_stats_t;
+
+void midi_actions_get_resync_stats(midi_resync_stats_t *out);
@@ -0,0 +1,231 @@
+// ===== FILE: main/midi_clock.c =====
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "driver/gptimer.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "midi_clock.h"
+#include "midi_out.h"
+
+static const char *TAG = "MIDI_CLOCK";
+
+// ---- config ----
+#define CLOCK_PPQN          24
+#define CLOCK_TIMER_HZ      1000000    // 1 us per count
+#define TAP_MAX_TAPS        5          // average over the last 4 intervals
+#define TAP_TIMEOUT_US      2000000    // pause longer than this -> new tap sequence
+
+static gptimer_handle_t s_timer = NULL;
+static volatile int s_running = 0;
+static float s_bpm = MIDI_CLOCK_BPM_DEFAULT;
+static uint32_t s_period_us = 0;
+
+// tap tempo (footswitch task only)
+static int64_t s_tap_t[TAP_MAX_TAPS];
+static int s_tap_n = 0;
+
+// jitter (dispatcher task writes, portal reads -> plain snapshot is fine)
+static midi_clock_stats_t s_st;
+static int64_t s_prev_sent_us = 0;
+static uint64_t s_jit_sum_us = 0;
+
+static inline uint32_t bpm_to_period_us(float bpm)
+{
+    return (uint32_t)((60.0f * 1000000.0f) / (bpm * (float)CLOCK_PPQN) + 0.5f);
+}
+
+// ✅ ISR: only pushes 0xF8 into the realtime lane (dispatcher wakes right away)
+static bool IRAM_ATTR clock_on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx)
+{
+    (void)timer; (void)edata; (void)user_ctx;
+
+    BaseType_t woken = pdFALSE;
+    if (midi_out_rt_from_isr(0xF8, &woken) != ESP_OK) s_st.isr_dropped++;
+    return woken == pdTRUE;
+}
+
+static esp_err_t apply_period(void)
+{
+    gptimer_alarm_config_t al = {
+        .alarm_count = s_period_us,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    return gptimer_set_alarm_action(s_timer, &al);
+}
+
+// interval stats only: ticks is the beat phase the receivers count (only FA/FB restart it)
+static void jitter_reset(void)
+{
+    s_prev_sent_us = 0;
+    s_jit_sum_us = 0;
+    s_st.samples = 0;
+    s_st.last_us = 0;
+    s_st.min_us = 0;
+    s_st.max_us = 0;
+    s_st.avg_jitter_us = 0;
+    s_st.max_jitter_us = 0;
+}
+
+// -------------------- public --------------------
+void midi_clock_init(void)
+{
+    if (s_timer) {
+        ESP_LOGW(TAG, "already inited");
+        return;
+    }
+
+    memset(&s_st, 0, sizeof(s_st));
+    s_period_us = bpm_to_period_us(s_bpm);
+
+    gptimer_config_t cfg = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = CLOCK_TIMER_HZ,
+    };
+    esp_err_t e = gptimer_new_timer(&cfg, &s_timer);
+    if (e != ESP_OK) {
+        ESP_LOGE(TAG, "gptimer_new_timer failed: %s -> no MIDI clock", esp_err_to_name(e));
+        s_timer = NULL;
+        return;
+    }
+
+    gptimer_event_callbacks_t cbs = { .on_alarm = clock_on_alarm };
+    if (gptimer_register_event_callbacks(s_timer, &cbs, NULL) != ESP_OK ||
+        apply_period() != ESP_OK ||
+        gptimer_enable(s_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "gptimer setup failed -> no MIDI clock");
+        s_timer = NULL;
+        return;
+    }
+
+    ESP_LOGI(TAG, "MIDI clock ready (bpm=%.1f period=%uus)", (double)s_bpm, (unsigned)s_period_us);
+}
+
+esp_err_t midi_clock_set_bpm(float bpm)
+{
+    if (bpm < MIDI_CLOCK_BPM_MIN) bpm = MIDI_CLOCK_BPM_MIN;
+    if (bpm > MIDI_CLOCK_BPM_MAX) bpm = MIDI_CLOCK_BPM_MAX;
+
+    s_bpm = bpm;
+    s_period_us = bpm_to_period_us(bpm);
+    jitter_reset();
+
+    if (!s_timer) return ESP_ERR_INVALID_STATE;
+    return apply_period();
+}
+
+float midi_clock_get_bpm(void)
+{
+    return s_bpm;
+}
+
+static esp_err_t transport(uint8_t rt, bool run)
+{
+    if (!s_timer) return ESP_ERR_INVALID_STATE;
+
+    if (!run) {
+        if (s_running) (void)gptimer_stop(s_timer);
+        s_running = 0;
+        return midi_out_rt(rt);
+    }
+
+    if (s_running) (void)gptimer_stop(s_timer);
+
+    // FA/FB first, first 0xF8 one full period later
+    esp_err_t e = midi_out_rt(rt);
+    jitter_reset();
+    s_st.ticks = 0;
+    (void)gptimer_set_raw_count(s_timer, 0);
+    if (gptimer_start(s_timer) != ESP_OK) {
+        s_running = 0;
+        return ESP_FAIL;
+    }
+    s_running = 1;
+    return e;
+}
+
+esp_err_t midi_clock_start(void)    { return transport(0xFA, true); }
+esp_err_t midi_clock_continue(void) { return transport(0xFB, true); }
+esp_err_t midi_clock_stop(void)     { return transport(0xFC, false); }
+
+int midi_clock_running(void)
+{
+    return s_running;
+}
+
+void midi_clock_tap(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (s_tap_n > 0 && (now - s_tap_t[s_tap_n - 1]) > TAP_TIMEOUT_US) s_tap_n = 0;
+
+    if (s_tap_n == TAP_MAX_TAPS) {
+        memmove(&s_tap_t[0], &s_tap_t[1], sizeof(s_tap_t[0]) * (TAP_MAX_TAPS - 1));
+        s_tap_n--;
+    }
+    s_tap_t[s_tap_n++] = now;
+
+    if (s_tap_n < 2) return;
+
+    // mean beat over the kept taps
+    int64_t span = s_tap_t[s_tap_n - 1] - s_tap_t[0];
+    float beat_us = (float)span / (float)(s_tap_n - 1);
+    if (beat_us <= 0.0f) return;
+
+    (void)midi_clock_set_bpm(60.0f * 1000000.0f / beat_us);
+    ESP_LOGI(TAG, "tap tempo: %.1f bpm (%d taps)", (double)s_bpm, s_tap_n);
+}
+
+void midi_clock_tap_reset(void)
+{
+    s_tap_n = 0;
+}
+
+int midi_clock_beat_led(void)
+{
+    // ticks counts from start/continue -> tick 0 of every 24 = beat
+    return (s_st.ticks % CLOCK_PPQN) < 3;
+}
+
+void midi_clock_on_tick_sent(int64_t now_us)
+{
+    s_st.ticks++;
+
+    if (s_prev_sent_us != 0) {
+        uint32_t iv = (uint32_t)(now_us - s_prev_sent_us);
+        uint32_t nom = s_period_us;
+        uint32_t jit = (iv > nom) ? (iv - nom) : (nom - iv);
+
+        s_st.samples++;
+        s_st.last_us = iv;
+        if (s_st.samples == 1 || iv < s_st.min_us) s_st.min_us = iv;
+        if (iv > s_st.max_us) s_st.max_us = iv;
+        if (jit > s_st.max_jitter_us) s_st.max_jitter_us = jit;
+        s_jit_sum_us += jit;
+        s_st.avg_jitter_us = (uint32_t)(s_jit_sum_us / s_st.samples);
+    }
+    s_prev_sent_us = now_us;
+}
+
+void midi_clock_get_stats(midi_clock_stats_t *out)
+{
+    if (!out) return;
+    *out = s_st;
+    out->bpm = s_bpm;
+    out->period_us = s_period_us;
+    out->running = s_running;
+}
+
+void midi_clock_reset_stats(void)
+{
+    jitter_reset();
+    s_st.isr_dropped = 0;
+}
@@ -0,0 +1,51 @@
+// ===== FILE: main/midi_clock.h =====
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+// MIDI clock master: 24 PPQN 0xF8 from a hardware gptimer (ISR -> midi_out realtime lane)
+#define MIDI_CLOCK_BPM_MIN      20.0f
+#define MIDI_CLOCK_BPM_MAX      300.0f
+#define MIDI_CLOCK_BPM_DEFAULT  120.0f
+
+void midi_clock_init(void);
+
+// tempo (clamped to MIN..MAX); applied from the next tick while running
+esp_err_t midi_clock_set_bpm(float bpm);
+float     midi_clock_get_bpm(void);
+
+// transport: start = 0xFA + ticks from beat 1, stop = 0xFC + ticks halt,
+// continue = 0xFB + ticks resume
+esp_err_t midi_clock_start(void);
+esp_err_t midi_clock_stop(void);
+esp_err_t midi_clock_continue(void);
+int       midi_clock_running(void);
+
+// tap tempo: call on every tap (averages the recent taps; a long pause starts over)
+void midi_clock_tap(void);
+void midi_clock_tap_reset(void);
+
+// 1 during the first ticks of each beat while running (LED metronome)
+int  midi_clock_beat_led(void);
+
+// dispatcher hook: one 0xF8 of our running clock just went out to the transports
+// (jitter instrumentation + beat phase; forwarded external clock is not reported)
+void midi_clock_on_tick_sent(int64_t now_us);
+
+typedef struct {
+    float    bpm;
+    uint32_t period_us;        // nominal tick interval
+    int      running;
+    uint32_t ticks;            // 0xF8 sent since start/continue
+    uint32_t samples;          // intervals measured
+    uint32_t last_us;          // last measured interval
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t avg_jitter_us;    // mean |interval - nominal|
+    uint32_t max_jitter_us;    // worst |interval - nominal|
+    uint32_t isr_dropped;      // ticks lost (realtime lane full)
+} midi_clock_stats_t;
+
+void midi_clock_get_stats(midi_clock_stats_t *out);
+// interval / jitter counters only: ticks (beat phase) keeps counting
+void midi_clock_reset_stats(void);
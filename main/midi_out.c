@@ -0,0 +1,905 @@
+// ===== FILE: main/midi_out.c =====
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_heap_caps.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "midi_out.h"
+#include "midi_prog.h"
+#include "midi_clock.h"
+#include "midi_state.h"
+#include "midi_sysex.h"
+#include "usb_midi_host.h"
+#include "uart_midi_out.h"
+
+static const char *TAG = "MIDI_OUT";
+
+_Static_assert(MIDI_PORT_USB_COUNT == USB_MIDI_MAX_DEVS, "one state mirror per USB device slot");
+_Static_assert(MIDI_PORT_DIN_COUNT == UART_MIDI_PORTS, "one state mirror per DIN port");
+
+// ---- config ----
+#define MIDI_OUT_Q_LEN      64     // messages per producer queue (power of 2)
+#define MIDI_OUT_BURST      16     // max messages taken from one queue per round (fairness)
+#define MIDI_OUT_IDLE_MS    10     // safety wake-up if a producer forgot to commit
+#define MIDI_OUT_RT_LEN     32     // realtime lane (bytes, power of 2)
+#define MIDI_OUT_SX_USB_PKTS 16    // sysex: packets per device per step (one transfer)
+#define MIDI_OUT_SX_DIN_STEP 96    // sysex: bytes into a DIN port's ring per step (~30 ms of wire)
+#define MIDI_OUT_PROG_LEN   4      // program copies per producer queue (power of 2)
+
+// wire message (status already carries the channel)
+// status 0 = compiled program (prog -> the producer's copy in its program pool), sent as one block per transport
+// status F0 = sysex, d1 = pool slot
+// hr != 0 = hi-res CC: v32 for MIDI 2.0 devices, d2 (= v32 >> 25) for the rest
+typedef struct {
+    uint8_t status;
+    uint8_t d1;
+    uint8_t d2;
+    uint8_t flags;  // ACTION_F_* (config_store.h)
+    uint16_t cables; // USB cable mask (0 = cable 0)
+    uint8_t hr;     // MSG_HR_*
+    uint8_t mf;     // MSG_F_*
+    union {
+        const midi_prog_t *prog;
+        uint32_t v32;
+    };
+} midi_out_msg_t;
+
+#define MSG_HR_NONE  0
+#define MSG_HR_WITH7 1   // 7-bit value changed too -> MIDI 1.0 receivers get it
+#define MSG_HR_ONLY  2   // only the low bits moved -> MIDI 2.0 devices only
+
+#define MSG_F_THRU   0x01   // DIN IN thru (v32 = arrival time, us)
+#define MSG_F_CONT   0x02   // continuous CC: DIN keeps only the latest queued value
+
+// single-producer / single-consumer ring:
+// - head written only by the producer, tail only by the dispatcher
+// - slot write happens-before head release, slot read happens-before tail release
+typedef struct {
+    midi_out_msg_t slot[MIDI_OUT_Q_LEN];
+    uint32_t head;
+    uint32_t tail;
+
+    uint32_t enqueued;
+    uint32_t dropped;
+    uint32_t high_water;
+} midi_out_q_t;
+
+static midi_out_q_t s_q[MIDI_SRC_COUNT];
+
+// program copies, one pool per producer queue: taken at enqueue (producer task) so
+// the dispatcher never waits on a slot being rebuilt. same spsc rule as the queue,
+// released in queue order once the program went out
+typedef struct {
+    midi_prog_t *slot;                  // MIDI_OUT_PROG_LEN copies (PSRAM first)
+    uint32_t head;
+    uint32_t tail;
+} midi_out_pool_t;
+
+static midi_out_pool_t s_pool[MIDI_SRC_COUNT];
+static TaskHandle_t s_task = NULL;
+static uint32_t s_usb_gen[USB_MIDI_MAX_DEVS];
+static uint32_t s_usb_loss[USB_MIDI_MAX_DEVS];
+static uint32_t s_din_gen[UART_MIDI_PORTS];
+
+// realtime lane: any task or ISR may push -> short spinlock instead of spsc
+static portMUX_TYPE s_rt_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t  s_rt[MIDI_OUT_RT_LEN];
+static uint32_t s_rt_head = 0;
+static uint32_t s_rt_tail = 0;
+static uint32_t s_rt_sent = 0;
+static uint32_t s_rt_dropped = 0;
+
+// sysex stream (dispatcher task only): one at a time, a few packets/bytes per round
+typedef struct {
+    bool active;
+    uint8_t *buf;                       // payload copy (PSRAM first), MIDI_SYSEX_MAX_LEN
+    uint16_t len;
+    uint16_t cables;
+    uint8_t usb_mask;                   // devices still being fed
+    uint8_t usb_wait;                   // devices fed completely, waiting for idle
+    uint16_t usb_off[USB_MIDI_MAX_DEVS];
+    uint8_t din_mask;                   // DIN ports still being fed
+    uint8_t din_wait;                   // DIN ports fed completely, waiting for their ring to drain
+    uint16_t din_off[UART_MIDI_PORTS];
+    int64_t t0;
+} sx_stream_t;
+
+static sx_stream_t s_sx;
+static midi_out_sysex_stats_t s_sx_stats;
+
+static midi_out_thru_stats_t s_thru_stats;
+
+static inline uint8_t clamp7(int v)  { if (v < 0) return 0; if (v > 127) return 127; return (uint8_t)v; }
+static inline uint8_t clampCh(int v) { if (v < 1) return 1; if (v > 16) return 16; return (uint8_t)v; }
+
+// -------------------- spsc queue --------------------
+static bool q_push(midi_out_q_t *q, const midi_out_msg_t *m)
+{
+    uint32_t h = q->head;
+    uint32_t t = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+    if ((h - t) >= MIDI_OUT_Q_LEN) {
+        q->dropped++;
+        return false;
+    }
+
+    q->slot[h & (MIDI_OUT_Q_LEN - 1)] = *m;
+    __atomic_store_n(&q->head, h + 1, __ATOMIC_RELEASE);
+
+    q->enqueued++;
+    uint32_t depth = h + 1 - t;
+    if (depth > q->high_water) q->high_water = depth;
+    return true;
+}
+
+static bool q_peek(midi_out_q_t *q, midi_out_msg_t *out)
+{
+    uint32_t t = q->tail;
+    uint32_t h = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    if (t == h) return false;
+
+    *out = q->slot[t & (MIDI_OUT_Q_LEN - 1)];
+    return true;
+}
+
+static bool q_pop(midi_out_q_t *q, midi_out_msg_t *out)
+{
+    uint32_t t = q->tail;
+    uint32_t h = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    if (t == h) return false;
+
+    *out = q->slot[t & (MIDI_OUT_Q_LEN - 1)];
+    __atomic_store_n(&q->tail, t + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// -------------------- realtime lane --------------------
+static bool IRAM_ATTR rt_push(uint8_t b)
+{
+    bool ok;
+    portENTER_CRITICAL_SAFE(&s_rt_mux);
+    ok = (s_rt_head - s_rt_tail) < MIDI_OUT_RT_LEN;
+    if (ok) {
+        s_rt[s_rt_head & (MIDI_OUT_RT_LEN - 1)] = b;
+        s_rt_head++;
+    } else {
+        s_rt_dropped++;
+    }
+    portEXIT_CRITICAL_SAFE(&s_rt_mux);
+    return ok;
+}
+
+static bool rt_pop(uint8_t *out)
+{
+    bool ok;
+    portENTER_CRITICAL(&s_rt_mux);
+    ok = (s_rt_tail != s_rt_head);
+    if (ok) {
+        *out = s_rt[s_rt_tail & (MIDI_OUT_RT_LEN - 1)];
+        s_rt_tail++;
+    }
+    portEXIT_CRITICAL(&s_rt_mux);
+    return ok;
+}
+
+// send everything waiting in the realtime lane (every transport sends it right away)
+static void rt_drain(uint8_t usb_ok, uint8_t din_ok)
+{
+    uint8_t b;
+    while (rt_pop(&b)) {
+        // our own clock only: F8 forwarded from DIN IN (clock stopped) is not ours to count
+        if (b == 0xF8 && midi_clock_running()) midi_clock_on_tick_sent(esp_timer_get_time());
+        if (usb_ok) (void)usb_midi_send_rt(b);
+        if (din_ok) (void)uart_midi_send_rt(din_ok, b);
+        s_rt_sent++;
+    }
+}
+
+// -------------------- dispatcher --------------------
+// USB devices a message goes to: flags device mask (0 = all) & ready, minus the
+// ones whose state mirror says it is redundant.
+// the mirror models cable 0 only: other cables are separate receivers -> always sent.
+// a mask with cable 0 and others still goes out whole, but cable 0's mirror takes the value
+static uint8_t usb_targets(uint8_t usb_ok, uint8_t status, uint8_t d1, uint8_t d2, uint8_t flags, uint16_t cables)
+{
+    uint8_t devs = ACTION_F_USB_DEVS(flags);
+    if (devs == 0) devs = USB_MIDI_DEV_ALL;
+    devs &= usb_ok;
+
+    const uint16_t cab = cables ? cables : ACTION_CABLES_DEFAULT;
+    if (!(cab & ACTION_CABLES_DEFAULT)) return devs;
+    const bool others = (cab & (uint16_t)~ACTION_CABLES_DEFAULT) != 0;
+    if (others) flags |= ACTION_F_ALWAYS;
+
+    uint8_t out = 0;
+    for (int d = 0; d < USB_MIDI_MAX_DEVS; d++) {
+        if (!(devs & (1u << d))) continue;
+        if (midi_state_pass(MIDI_PORT_USB_DEV(d), status, d1, d2, flags)) out |= (uint8_t)(1u << d);
+    }
+    return out;
+}
+
+// DIN ports a message goes to: flags port mask (0 = all) & ready, minus the ones
+// whose state mirror says it is redundant
+static uint8_t din_targets(uint8_t din_ok, uint8_t status, uint8_t d1, uint8_t d2, uint8_t flags)
+{
+    uint8_t ports = ACTION_F_DIN_PORTS(flags);
+    if (ports == 0) ports = UART_MIDI_PORT_ALL;
+    ports &= din_ok;
+
+    uint8_t out = 0;
+    for (int p = 0; p < UART_MIDI_PORTS; p++) {
+        if (!(ports & (1u << p))) continue;
+        if (midi_state_pass(MIDI_PORT_DIN_N(p), status, d1, d2, flags)) out |= (uint8_t)(1u << p);
+    }
+    return out;
+}
+
+// targets passed the mirror but the send failed (ring full, device gone) ->
+// those receivers may not have it: mirror back to unknown so a resend is not suppressed
+static void usb_forget(uint8_t devs, uint8_t status, uint8_t d1)
+{
+    for (int d = 0; d < USB_MIDI_MAX_DEVS; d++) {
+        if (devs & (1u << d)) midi_state_forget(MIDI_PORT_USB_DEV(d), status, d1);
+    }
+}
+
+static void din_forget(uint8_t ports, uint8_t status, uint8_t d1)
+{
+    for (int p = 0; p < UART_MIDI_PORTS; p++) {
+        if (ports & (1u << p)) midi_state_forget(MIDI_PORT_DIN_N(p), status, d1);
+    }
+}
+
+static void dispatch_prog(const midi_prog_t *p, uint8_t usb_ok, uint8_t din_ok)
+{
+    // dispatcher task only
+    static uint8_t usb[USB_MIDI_MAX_DEVS][MIDI_PROG_USB_MAX * 4];
+    static uint8_t din[UART_MIDI_PORTS][MAX_ACTIONS * 3];
+
+    // transport already resolved at compile time (route): a message only has
+    // packets / bytes for the transports it goes to.
+    // state mirror per message + device; whatever survives still goes out as one block
+    int nu[USB_MIDI_MAX_DEVS] = {0};
+    int nd[UART_MIDI_PORTS] = {0};
+    uint8_t to_u[MAX_ACTIONS] = {0};   // per message: who passed the mirror (undo on a failed send)
+    uint8_t to_d[MAX_ACTIONS] = {0};
+    if (!p->usb_n) usb_ok = 0;
+    if (!p->din_len) din_ok = 0;
+    for (int i = 0; i < p->n; i++) {
+        const int npk = p->usb_off[i + 1] - p->usb_off[i];   // one packet per cable
+        if (npk && usb_ok) {
+            const uint8_t *pkt = &p->usb[p->usb_off[i] * 4];
+            const uint8_t to = usb_targets(usb_ok, pkt[1], pkt[2], pkt[3], p->flags[i], p->cables[i]);
+            to_u[i] = to;
+            for (int d = 0; d < USB_MIDI_MAX_DEVS; d++) {
+                if (!(to & (1u << d))) continue;
+                memcpy(&usb[d][nu[d] * 4], pkt, (size_t)npk * 4);
+                nu[d] += npk;
+            }
+        }
+
+        const int len = p->din_off[i + 1] - p->din_off[i];
+        if (len && din_ok) {
+            const uint8_t *b = &p->din[p->din_off[i]];
+            const uint8_t tod = din_targets(din_ok, b[0], b[1], (len > 2) ? b[2] : 0, p->flags[i]);
+            to_d[i] = tod;
+            for (int k = 0; k < UART_MIDI_PORTS; k++) {
+                if (!(tod & (1u << k))) continue;
+                memcpy(&din[k][nd[k]], b, (size_t)len);
+                nd[k] += len;
+            }
+        }
+    }
+
+    // devices that take the whole program -> the prebuilt buffer, one call
+    uint8_t full = 0, ufail = 0;
+    for (int d = 0; d < USB_MIDI_MAX_DEVS; d++) {
+        if (nu[d] == p->usb_n) full |= (uint8_t)(1u << d);
+        else if (nu[d] && usb_midi_send_packets((uint8_t)(1u << d), usb[d], nu[d]) != ESP_OK) ufail |= (uint8_t)(1u << d);
+    }
+    if (full && p->usb_n && usb_midi_send_packets(full, p->usb, p->usb_n) != ESP_OK) ufail |= full;
+
+    // same for DIN ports
+    uint8_t dfull = 0, dfail = 0;
+    for (int k = 0; k < UART_MIDI_PORTS; k++) {
+        if (nd[k] == p->din_len) dfull |= (uint8_t)(1u << k);
+        else if (nd[k] && uart_midi_send_stream((uint8_t)(1u << k), din[k], nd[k]) != ESP_OK) dfail |= (uint8_t)(1u << k);
+    }
+    if (dfull && p->din_len && uart_midi_send_stream(dfull, p->din, p->din_len) != ESP_OK) dfail |= dfull;
+
+    // a multi-target call only reports the first error -> every target of it is undone
+    for (int i = 0; (ufail || dfail) && i < p->n; i++) {
+        if (to_u[i] & ufail) {
+            const uint8_t *pkt = &p->usb[p->usb_off[i] * 4];
+            usb_forget((uint8_t)(to_u[i] & ufail), pkt[1], pkt[2]);
+        }
+        if (to_d[i] & dfail) {
+            const uint8_t *b = &p->din[p->din_off[i]];
+            din_forget((uint8_t)(to_d[i] & dfail), b[0], b[1]);
+        }
+    }
+}
+
+// hi-res CC: MIDI 2.0 (UMP) devices get every step as a 32-bit value, their mirror
+// keeps the 7-bit view; MIDI 1.0 devices + DIN only see 7-bit changes
+static void dispatch_cc_hr(const midi_out_msg_t *m, uint8_t usb_ok, uint8_t din_ok)
+{
+    const uint8_t ch = (uint8_t)((m->status & 0x0F) + 1);
+
+    uint8_t devs = ACTION_F_USB_DEVS(m->flags);
+    if (devs == 0) devs = USB_MIDI_DEV_ALL;
+    const uint8_t ump = ACTION_F_TO_USB(m->flags) ? (uint8_t)(devs & usb_ok & usb_midi_ump_mask()) : 0;
+
+    if (ump) {
+        for (int d = 0; d < USB_MIDI_MAX_DEVS; d++) {
+            if (ump & (1u << d)) (void)midi_state_pass(MIDI_PORT_USB_DEV(d), m->status, m->d1, m->d2, ACTION_F_ALWAYS);
+        }
+        if (usb_midi_send_cc32(ump, m->cables, ch, m->d1, m->v32) != ESP_OK) usb_forget(ump, m->status, m->d1);
+    }
+    if (m->hr == MSG_HR_ONLY) return;
+
+    const uint8_t to_usb = ACTION_F_TO_USB(m->flags)
+        ? usb_targets((uint8_t)(usb_ok & ~ump), m->status, m->d1, m->d2, m->flags, m->cables) : 0;
+    const uint8_t to_din = ACTION_F_TO_DIN(m->flags) ? din_targets(din_ok, m->status, m->d1, m->d2, m->flags) : 0;
+
+    if (to_usb && usb_midi_send_cc(to_usb, m->cables, ch, m->d1, m->d2) != ESP_OK) usb_forget(to_usb, m->status, m->d1);
+    if (to_din && uart_midi_send_cc_cont(to_din, ch, m->d1, m->d2) != ESP_OK) din_forget(to_din, m->status, m->d1);
+}
+
+// USB-MIDI code index for a channel voice / system common status
+static uint8_t usb_cin(uint8_t st)
+{
+    if (st < 0xF0) return (uint8_t)(st >> 4);
+    switch (st) {
+    case 0xF2: return 0x3;
+    case 0xF6: return 0x5;
+    default:   return 0x2;   // F1, F3
+    }
+}
+
+static int msg_len(uint8_t st)
+{
+    if (st < 0xF0) {
+        uint8_t hi = (uint8_t)(st & 0xF0);
+        return (hi == 0xC0 || hi == 0xD0) ? 2 : 3;
+    }
+    return (st == 0xF6) ? 1 : (st == 0xF2) ? 3 : 2;
+}
+
+// DIN IN thru: merged with our own output on every transport (cable 0).
+// CC/PC update the mirrors (the receivers did get them) but are never suppressed
+static void dispatch_thru(const midi_out_msg_t *m, uint8_t usb_ok, uint8_t din_ok)
+{
+    const uint8_t st = m->status;
+    const int len = msg_len(st);
+    const uint8_t b[3] = { st, (len > 1) ? m->d1 : 0, (len > 2) ? m->d2 : 0 };
+    const uint8_t flags = (uint8_t)(m->flags | ACTION_F_ALWAYS);
+
+    const uint8_t to_usb = usb_targets(usb_ok, st, b[1], b[2], flags, ACTION_CABLES_DEFAULT);
+    const uint8_t to_din = din_targets(din_ok, st, b[1], b[2], flags);
+
+    if (to_usb) {
+        const uint8_t pkt[4] = { usb_cin(st), b[0], b[1], b[2] };
+        if (usb_midi_send_packets(to_usb, pkt, 1) != ESP_OK) usb_forget(to_usb, st, b[1]);
+    }
+    if (to_din && uart_midi_send_stream(to_din, b, len) != ESP_OK) din_forget(to_din, st, b[1]);
+
+    const uint32_t us = (uint32_t)esp_timer_get_time() - m->v32;
+    s_thru_stats.msgs++;
+    s_thru_stats.last_us = us;
+    if (us > s_thru_stats.max_us) s_thru_stats.max_us = us;
+    s_thru_stats.avg_us = s_thru_stats.avg_us
+        ? (uint32_t)(((int64_t)s_thru_stats.avg_us * 15 + us) / 16) : us;
+}
+
+static void dispatch_one(const midi_out_msg_t *m, uint8_t usb_ok, uint8_t din_ok)
+{
+    if (m->status == 0) {
+        dispatch_prog(m->prog, usb_ok, din_ok);
+        return;
+    }
+    if (m->hr) {
+        dispatch_cc_hr(m, usb_ok, din_ok);
+        return;
+    }
+    if (m->mf & MSG_F_THRU) {
+        dispatch_thru(m, usb_ok, din_ok);
+        return;
+    }
+
+    uint8_t ch = (uint8_t)((m->status & 0x0F) + 1);
+
+    // route + redundant for a receiver (state mirror) -> skip that transport only
+    const uint8_t to_usb = ACTION_F_TO_USB(m->flags) ? usb_targets(usb_ok, m->status, m->d1, m->d2, m->flags, m->cables) : 0;
+    const uint8_t to_din = ACTION_F_TO_DIN(m->flags) ? din_targets(din_ok, m->status, m->d1, m->d2, m->flags) : 0;
+
+    esp_err_t eu = ESP_OK, ed = ESP_OK;
+    switch (m->status & 0xF0) {
+    case 0xB0:
+        if (to_usb) eu = usb_midi_send_cc(to_usb, m->cables, ch, m->d1, m->d2);
+        if (to_din) {
+            if (m->mf & MSG_F_CONT) ed = uart_midi_send_cc_cont(to_din, ch, m->d1, m->d2);
+            else                    ed = uart_midi_send_cc(to_din, ch, m->d1, m->d2);
+        }
+        break;
+    case 0xC0:
+        if (to_usb) eu = usb_midi_send_pc(to_usb, m->cables, ch, m->d1);
+        if (to_din) ed = uart_midi_send_pc(to_din, ch, m->d1);
+        break;
+    default:
+        break;
+    }
+    if (eu != ESP_OK) usb_forget(to_usb, m->status, m->d1);
+    if (ed != ESP_OK) din_forget(to_din, m->status, m->d1);
+}
+
+// -------------------- sysex stream --------------------
+static void sx_start(const midi_out_msg_t *m, uint8_t usb_ok, uint8_t din_ok)
+{
+    if (!s_sx.buf) { s_sx_stats.dropped++; return; }
+
+    int len = midi_sysex_copy(m->d1, s_sx.buf, MIDI_SYSEX_MAX_LEN);
+    if (len <= 0) { s_sx_stats.dropped++; return; }
+
+    uint8_t devs = ACTION_F_USB_DEVS(m->flags);
+    if (devs == 0) devs = USB_MIDI_DEV_ALL;
+    uint8_t ports = ACTION_F_DIN_PORTS(m->flags);
+    if (ports == 0) ports = UART_MIDI_PORT_ALL;
+
+    s_sx.len = (uint16_t)len;
+    s_sx.cables = m->cables ? m->cables : ACTION_CABLES_DEFAULT;
+    s_sx.usb_mask = ACTION_F_TO_USB(m->flags) ? (uint8_t)(devs & usb_ok) : 0;
+    s_sx.usb_wait = 0;
+    memset(s_sx.usb_off, 0, sizeof(s_sx.usb_off));
+    s_sx.din_mask = ACTION_F_TO_DIN(m->flags) ? (uint8_t)(ports & din_ok) : 0;
+    s_sx.din_wait = 0;
+    memset(s_sx.din_off, 0, sizeof(s_sx.din_off));
+    s_sx.t0 = esp_timer_get_time();
+    s_sx.active = (s_sx.usb_mask || s_sx.din_mask);
+
+    if (!s_sx.active) return;
+
+    s_sx_stats.streams++;
+    s_sx_stats.bytes += (uint32_t)len;
+    s_sx_stats.last_len = (uint32_t)len;
+    s_sx_stats.last_usb_us = 0;
+    s_sx_stats.last_din_us = 0;
+}
+
+// USB-MIDI sysex framing, 3 payload bytes per packet:
+// CIN 4 = start/continue, CIN 5/6/7 = ends with 1/2/3 bytes
+static int sx_usb_pkts(uint16_t *off, uint8_t *out, int max_pkts)
+{
+    int n = 0;
+    int ncab = __builtin_popcount(s_sx.cables);
+
+    while (*off < s_sx.len && n + ncab <= max_pkts) {
+        int left = s_sx.len - *off;
+        int k = (left > 3) ? 3 : left;
+        uint8_t cin = (left > 3) ? 0x4 : (uint8_t)(0x4 + k);
+
+
+        for (int cab = 0; cab < 16; cab++) {
+            if (!(s_sx.cables & (1u << cab))) continue;
+            uint8_t *p = &out[n * 4];
+            p[0] = (uint8_t)((cab << 4) | cin);
+            p[1] = s_sx.buf[*off];
+            p[2] = (k > 1) ? s_sx.buf[*off + 1] : 0;
+            p[3] = (k > 2) ? s_sx.buf[*off + 2] : 0;
+            n++;
+        }
+        *off = (uint16_t)(*off + k);
+    }
+    return n;
+}
+
+// device d stops getting the stream: a lone F7 per cable ends the message for its
+// parser (a stray F7 after a complete one is ignored by receivers)
+static void sx_usb_abort(int d)
+{
+    uint8_t f7[16 * 4];
+    int n = 0;
+    for (int cab = 0; cab < 16; cab++) {
+        if (!(s_sx.cables & (1u << cab))) continue;
+        f7[n * 4 + 0] = (uint8_t)((cab << 4) | 0x5);   // CIN 5 = ends with 1 byte
+        f7[n * 4 + 1] = 0xF7;
+        f7[n * 4 + 2] = 0;
+        f7[n * 4 + 3] = 0;
+        n++;
+    }
+    (void)usb_midi_send_packets((uint8_t)(1u << d), f7, n);
+    s_sx.usb_mask &= (uint8_t)~(1u << d);
+    s_sx_stats.aborted++;
+}
+
+// feed every target as far as it has room right now. true = something was queued on USB
+static bool sx_step(uint8_t usb_ok, uint8_t din_ok)
+{
+    static uint8_t pkts[MIDI_OUT_SX_USB_PKTS * 4];
+    bool usb_sent = false;
+    const int64_t now = esp_timer_get_time();
+
+    for (int d = 0; d < USB_MIDI_MAX_DEVS; d++) {
+        const uint8_t bit = (uint8_t)(1u << d);
+        if (!(s_sx.usb_mask & bit)) continue;
+        if (!(usb_ok & bit)) { s_sx.usb_mask &= (uint8_t)~bit; continue; }   // unplugged mid-stream
+
+        int room;
+        while ((room = usb_midi_tx_room(d)) > 0 && s_sx.usb_off[d] < s_sx.len) {
+            int max = (room < MIDI_OUT_SX_USB_PKTS) ? room : MIDI_OUT_SX_USB_PKTS;
+            int n = sx_usb_pkts(&s_sx.usb_off[d], pkts, max);
+            if (n == 0) break;
+            usb_sent = true;
+            if (usb_midi_send_packets(bit, pkts, n) != ESP_OK) {
+                // part of the block may be queued already: a resend would duplicate
+                // bytes -> close the message here instead of leaving it open
+                sx_usb_abort(d);
+                break;
+            }
+        }
+        if (!(s_sx.usb_mask & bit)) continue;
+        if (s_sx.usb_off[d] >= s_sx.len) {
+            s_sx.usb_mask &= (uint8_t)~bit;
+            s_sx.usb_wait |= bit;
+        }
+    }
+
+    if (s_sx.usb_wait && !s_sx.usb_mask && !usb_sent && usb_midi_tx_idle(s_sx.usb_wait)) {
+        s_sx_stats.last_usb_us = (uint32_t)(now - s_sx.t0);
+        s_sx.usb_wait = 0;
+    }
+
+    // each DIN port at its own pace (own ring)
+    for (int p = 0; p < UART_MIDI_PORTS; p++) {
+        const uint8_t bit = (uint8_t)(1u << p);
+        if (!(s_sx.din_mask & bit)) continue;
+        if (!(din_ok & bit)) { s_sx.din_mask &= (uint8_t)~bit; continue; }
+
+        int left = s_sx.len - s_sx.din_off[p];
+        int k = (left > MIDI_OUT_SX_DIN_STEP) ? MIDI_OUT_SX_DIN_STEP : left;
+        s_sx.din_off[p] = (uint16_t)(s_sx.din_off[p] + uart_midi_send_sysex_chunk(p, &s_sx.buf[s_sx.din_off[p]], k));
+        if (s_sx.din_off[p] >= s_sx.len) {
+            s_sx.din_mask &= (uint8_t)~bit;
+            s_sx.din_wait |= bit;
+        }
+    }
+
+    if (s_sx.din_wait && !s_sx.din_mask && uart_midi_out_tx_idle(s_sx.din_wait)) {
+        s_sx_stats.last_din_us = (uint32_t)(now - s_sx.t0);
+        s_sx.din_wait = 0;
+    }
+
+    // everything queued: later messages may follow (timing stats finish on their own)
+    if (!s_sx.usb_mask && !s_sx.din_mask && !s_sx.usb_wait && !s_sx.din_wait) s_sx.active = false;
+
+    return usb_sent;
+}
+
+// USB devices / DIN ports a program really has bytes for (route + masks per message)
+static void prog_targets(const midi_prog_t *p, uint8_t *devs, uint8_t *ports)
+{
+    *devs = 0;
+    *ports = 0;
+    for (int i = 0; i < p->n; i++) {
+        if (p->usb_off[i + 1] > p->usb_off[i]) {
+            const uint8_t dm = ACTION_F_USB_DEVS(p->flags[i]);
+            *devs |= dm ? dm : USB_MIDI_DEV_ALL;
+        }
+        if (p->din_off[i + 1] > p->din_off[i]) {
+            const uint8_t pm = ACTION_F_DIN_PORTS(p->flags[i]);
+            *ports |= pm ? pm : UART_MIDI_PORT_ALL;
+        }
+    }
+}
+
+// would m have to go out in the middle of the running sysex?
+// decided per device / port from m's real targets: anything else keeps flowing.
+// a DIN port whose chunks are all in its (FIFO) ring is free again: later bytes queue behind the F7
+static bool sx_blocks(const midi_out_msg_t *m)
+{
+    if (!s_sx.active) return false;
+
+    // one stream at a time (the next one also waits for this one's stats)
+    if (m->status == 0xF0) return true;
+    if (!s_sx.usb_mask && !s_sx.din_mask) return false;
+
+    uint8_t devs, ports;
+    if (m->status == 0) {
+        prog_targets(m->prog, &devs, &ports);
+    } else {
+        devs = ACTION_F_USB_DEVS(m->flags);
+        if (devs == 0) devs = USB_MIDI_DEV_ALL;
+        ports = ACTION_F_DIN_PORTS(m->flags);
+        if (ports == 0) ports = UART_MIDI_PORT_ALL;
+        if (!ACTION_F_TO_USB(m->flags)) devs = 0;
+        if (!ACTION_F_TO_DIN(m->flags)) ports = 0;
+    }
+    return (devs & s_sx.usb_mask) || (ports & s_sx.din_mask);
+}
+
+static void midi_out_task(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        // a running sysex is fed every tick; otherwise sleep until committed
+        ulTaskNotifyTake(pdTRUE, s_sx.active ? 1 : pdMS_TO_TICKS(MIDI_OUT_IDLE_MS));
+
+        const uint8_t usb_ok = usb_midi_ready_mask();
+        const uint8_t din_ok = uart_midi_out_ready_mask();
+
+        // new USB device/session in a slot -> it knows nothing of what the last one got.
+        // packets dropped after they were queued -> we no longer know what it got
+        for (int d = 0; d < USB_MIDI_MAX_DEVS; d++) {
+            uint32_t gen = usb_midi_conn_gen(d);
+            uint32_t loss = usb_midi_loss_gen(d);
+            if (gen != s_usb_gen[d] || loss != s_usb_loss[d]) {
+                s_usb_gen[d] = gen;
+                s_usb_loss[d] = loss;
+                midi_state_reset(MIDI_PORT_USB_DEV(d));
+            }
+        }
+        // DIN port back from the self-test -> its receivers got the test pattern
+        for (int p = 0; p < UART_MIDI_PORTS; p++) {
+            uint32_t gen = uart_midi_out_port_gen(p);
+            if (gen != s_din_gen[p]) {
+                s_din_gen[p] = gen;
+                midi_state_reset(MIDI_PORT_DIN_N(p));
+            }
+        }
+
+        // realtime first, and again before every channel message below
+        rt_drain(usb_ok, din_ok);
+
+        bool any = false;
+        bool more;
+        do {
+            more = false;
+            // round-robin between producers; each queue keeps its own order
+            for (int q = 0; q < MIDI_SRC_COUNT; q++) {
+                int k = 0;
+                midi_out_msg_t m;
+                while (k < MIDI_OUT_BURST && q_peek(&s_q[q], &m)) {
+                    // must not land inside the running sysex on one of its targets: stays
+                    // queued (and so does the rest of q, to keep its order)
+                    if (sx_blocks(&m)) break;
+                    (void)q_pop(&s_q[q], &m);
+                    rt_drain(usb_ok, din_ok);
+                    if (m.status == 0xF0) sx_start(&m, usb_ok, din_ok);
+                    else dispatch_one(&m, usb_ok, din_ok);
+                    // its copy is free again (pool entries go in queue order)
+                    if (m.status == 0) __atomic_store_n(&s_pool[q].tail, s_pool[q].tail + 1, __ATOMIC_RELEASE);
+                    k++;
+                }
+                if (k == MIDI_OUT_BURST) more = true;
+                if (k) any = true;
+            }
+        } while (more);
+
+        if (s_sx.active && sx_step(usb_ok, din_ok)) any = true;
+
+        // everything drained this round -> as few bulk transfers as possible
+        if (any && usb_ok) (void)usb_midi_flush();
+    }
+}
+
+// -------------------- public --------------------
+void midi_out_init(void)
+{
+    if (s_task) {
+        ESP_LOGW(TAG, "already inited");
+        return;
+    }
+
+    memset(s_q, 0, sizeof(s_q));
+
+    // sysex stream buffer: PSRAM first, internal RAM if that's all there is
+    memset(&s_sx, 0, sizeof(s_sx));
+    s_sx.buf = heap_caps_malloc(MIDI_SYSEX_MAX_LEN, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_sx.buf) {
+        s_sx.buf = heap_caps_malloc(MIDI_SYSEX_MAX_LEN, MALLOC_CAP_8BIT);
+        if (s_sx.buf) ESP_LOGW(TAG, "sysex buffer: no PSRAM, using internal RAM");
+        else ESP_LOGE(TAG, "sysex buffer alloc failed (sysex disabled)");
+    }
+
+    // program copies: without them every list goes through the interpreter
+    memset(s_pool, 0, sizeof(s_pool));
+    for (int q = 0; q < MIDI_SRC_COUNT; q++) {
+        const size_t bytes = sizeof(midi_prog_t) * MIDI_OUT_PROG_LEN;
+        s_pool[q].slot = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_pool[q].slot) s_pool[q].slot = heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+        if (!s_pool[q].slot) ESP_LOGW(TAG, "queue %d: no heap for program copies (interpreted path only)", q);
+    }
+
+    // above footswitch/expfs (6) so a committed burst goes out right away
+    if (xTaskCreatePinnedToCore(midi_out_task, "midi_out", 4096, NULL, 8, &s_task, 1) != pdPASS) {
+        ESP_LOGE(TAG, "dispatcher task create failed");
+        s_task = NULL;
+        return;
+    }
+    ESP_LOGI(TAG, "MIDI out dispatcher ready (queues=%d len=%d)", MIDI_SRC_COUNT, MIDI_OUT_Q_LEN);
+}
+
+int midi_out_ready_fast(void)
+{
+    return usb_midi_ready_fast() || uart_midi_out_ready_fast();
+}
+
+esp_err_t midi_out_cc(midi_src_t src, uint8_t ch_1_16, uint8_t cc, uint8_t val, uint8_t flags, uint16_t cables)
+{
+    if ((unsigned)src >= MIDI_SRC_COUNT) return ESP_ERR_INVALID_ARG;
+    midi_out_msg_t m = {
+        .status = (uint8_t)(0xB0 | ((clampCh(ch_1_16) - 1) & 0x0F)),
+        .d1 = clamp7(cc),
+        .d2 = clamp7(val),
+        .flags = flags,
+        .cables = cables,
+    };
+    return q_push(&s_q[src], &m) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t midi_out_cc_cont(midi_src_t src, uint8_t ch_1_16, uint8_t cc, uint8_t val, uint8_t flags, uint16_t cables)
+{
+    if ((unsigned)src >= MIDI_SRC_COUNT) return ESP_ERR_INVALID_ARG;
+    midi_out_msg_t m = {
+        .status = (uint8_t)(0xB0 | ((clampCh(ch_1_16) - 1) & 0x0F)),
+        .d1 = clamp7(cc),
+        .d2 = clamp7(val),
+        .flags = flags,
+        .cables = cables,
+        .mf = MSG_F_CONT,
+    };
+    return q_push(&s_q[src], &m) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t midi_out_cc_hr(midi_src_t src, uint8_t ch_1_16, uint8_t cc, uint8_t val7, uint32_t val32,
+                         bool only_hr, uint8_t flags, uint16_t cables)
+{
+    if ((unsigned)src >= MIDI_SRC_COUNT) return ESP_ERR_INVALID_ARG;
+    midi_out_msg_t m = {
+        .status = (uint8_t)(0xB0 | ((clampCh(ch_1_16) - 1) & 0x0F)),
+        .d1 = clamp7(cc),
+        .d2 = clamp7(val7),
+        .flags = flags,
+        .cables = cables,
+        .hr = only_hr ? MSG_HR_ONLY : MSG_HR_WITH7,
+        .mf = MSG_F_CONT,
+        .v32 = val32,
+    };
+    return q_push(&s_q[src], &m) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t midi_out_pc(midi_src_t src, uint8_t ch_1_16, uint8_t pc, uint8_t flags, uint16_t cables)
+{
+    if ((unsigned)src >= MIDI_SRC_COUNT) return ESP_ERR_INVALID_ARG;
+    midi_out_msg_t m = {
+        .status = (uint8_t)(0xC0 | ((clampCh(ch_1_16) - 1) & 0x0F)),
+        .d1 = clamp7(pc),
+        .d2 = 0,
+        .flags = flags,
+        .cables = cables,
+    };
+    return q_push(&s_q[src], &m) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t midi_out_prog(midi_src_t src, const midi_prog_t *prog)
+{
+    if ((unsigned)src >= MIDI_SRC_COUNT || !prog) return ESP_ERR_INVALID_ARG;
+
+    midi_out_pool_t *pl = &s_pool[src];
+    if (!pl->slot) return ESP_ERR_NO_MEM;
+    const uint32_t h = pl->head;
+    if ((h - __atomic_load_n(&pl->tail, __ATOMIC_ACQUIRE)) >= MIDI_OUT_PROG_LEN) return ESP_ERR_NO_MEM;
+
+    // copied here, in the producer's task: the dispatcher never touches the slot table
+    midi_prog_t *c = &pl->slot[h & (MIDI_OUT_PROG_LEN - 1)];
+    if (!midi_prog_read(prog, c)) return ESP_ERR_INVALID_STATE;
+    if (c->n == 0) return ESP_OK;
+
+    midi_out_msg_t m = {
+        .status = 0,
+        .prog = c,
+    };
+    if (!q_push(&s_q[src], &m)) return ESP_ERR_NO_MEM;
+    pl->head = h + 1;
+    return ESP_OK;
+}
+
+esp_err_t midi_out_sysex(midi_src_t src, uint8_t slot, uint8_t flags, uint16_t cables)
+{
+    if ((unsigned)src >= MIDI_SRC_COUNT || slot >= MIDI_SYSEX_SLOTS) return ESP_ERR_INVALID_ARG;
+    midi_out_msg_t m = {
+        .status = 0xF0,
+        .d1 = slot,
+        .d2 = 0,
+        .flags = flags,
+        .cables = cables,
+    };
+    return q_push(&s_q[src], &m) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t midi_out_thru(midi_src_t src, const uint8_t *msg, int n, uint32_t t_us)
+{
+    if ((unsigned)src >= MIDI_SRC_COUNT || !msg || n < 1 || n > 3) return ESP_ERR_INVALID_ARG;
+    if (msg[0] < 0x80 || msg[0] == 0xF0 || msg[0] == 0xF7 || msg[0] >= 0xF8) return ESP_ERR_INVALID_ARG;
+    midi_out_msg_t m = {
+        .status = msg[0],
+        .d1 = (n > 1) ? (uint8_t)(msg[1] & 0x7F) : 0,
+        .d2 = (n > 2) ? (uint8_t)(msg[2] & 0x7F) : 0,
+        .flags = 0,
+        .cables = ACTION_CABLES_DEFAULT,
+        .mf = MSG_F_THRU,
+        .v32 = t_us,
+    };
+    return q_push(&s_q[src], &m) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void midi_out_commit(midi_src_t src)
+{
+    (void)src;
+    if (s_task) xTaskNotifyGive(s_task);
+}
+
+esp_err_t midi_out_rt(uint8_t rt_byte)
+{
+    if (rt_byte < 0xF8) return ESP_ERR_INVALID_ARG;
+    if (!rt_push(rt_byte)) return ESP_ERR_NO_MEM;
+    if (s_task) xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+esp_err_t IRAM_ATTR midi_out_rt_from_isr(uint8_t rt_byte, BaseType_t *woken)
+{
+    if (rt_byte < 0xF8) return ESP_ERR_INVALID_ARG;
+    if (!rt_push(rt_byte)) return ESP_ERR_NO_MEM;
+    if (s_task) vTaskNotifyGiveFromISR(s_task, woken);
+    return ESP_OK;
+}
+
+void midi_out_get_rtstats(uint32_t *sent, uint32_t *dropped)
+{
+    if (sent)    *sent = s_rt_sent;
+    if (dropped) *dropped = s_rt_dropped;
+}
+
+void midi_out_get_sysex_stats(midi_out_sysex_stats_t *out)
+{
+    if (!out) return;
+    *out = s_sx_stats;
+    out->active = s_sx.active ? 1 : 0;
+}
+
+void midi_out_get_thru_stats(midi_out_thru_stats_t *out)
+{
+    if (!out) return;
+    *out = s_thru_stats;
+}
+
+uint32_t midi_out_free(midi_src_t src)
+{
+    if ((unsigned)src >= MIDI_SRC_COUNT) return 0;
+    const midi_out_q_t *q = &s_q[src];
+    uint32_t used = q->head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    return MIDI_OUT_Q_LEN - used;
+}
+
+void midi_out_get_qstats(midi_src_t src, midi_out_qstats_t *out)
+{
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if ((unsigned)src >= MIDI_SRC_COUNT) return;
+
+    const midi_out_q_t *q = &s_q[src];
+    out->enqueued   = q->enqueued;
+    out->dropped    = q->dropped;
+    out->high_water = q->high_water;
+    out->depth      = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,103 @@
+// ===== FILE: main/midi_out.h =====
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// producers: one lock-free SPSC queue each (exactly one task may push per source)
+typedef enum {
+    MIDI_SRC_FOOT = 0,   // footswitch task
+    MIDI_SRC_EXPFS,      // exp/fs task
+    MIDI_SRC_SCHED,      // timer wheel (delayed actions, midi_sched.c)
+    MIDI_SRC_SCENE,      // scene recall task (midi_scene.c)
+    MIDI_SRC_DIN_IN,     // DIN MIDI IN rx task (uart_midi_in.c), thru/merge
+    MIDI_SRC_COUNT
+} midi_src_t;
+
+// start dispatcher task (call after usb_midi_host_init / uart_midi_out_init)
+void midi_out_init(void);
+
+// any transport up?
+int midi_out_ready_fast(void);
+
+// queue only (never blocks, never touches USB/UART)
+// flags = ACTION_F_* (config_store.h), e.g. ACTION_F_ALWAYS bypasses suppression
+// cables = USB-MIDI cable mask (bit n = cable n, 0 = cable 0); DIN ignores it
+esp_err_t midi_out_cc(midi_src_t src, uint8_t ch_1_16, uint8_t cc, uint8_t val, uint8_t flags, uint16_t cables);
+esp_err_t midi_out_pc(midi_src_t src, uint8_t ch_1_16, uint8_t pc, uint8_t flags, uint16_t cables);
+
+// continuous controller (expression pedal): like midi_out_cc, but a DIN port
+// whose queue still holds this CC gets the value replaced instead of another
+// message (last value wins). discrete CC/PC actions use midi_out_cc / _pc
+esp_err_t midi_out_cc_cont(midi_src_t src, uint8_t ch_1_16, uint8_t cc, uint8_t val, uint8_t flags, uint16_t cables);
+
+// high-resolution CC (continuous, last value wins on DIN like midi_out_cc_cont): MIDI 2.0 (UMP) devices get val32 (full 32-bit range),
+// MIDI 1.0 devices + DIN get val7 unless only_hr (= 7-bit value unchanged)
+esp_err_t midi_out_cc_hr(midi_src_t src, uint8_t ch_1_16, uint8_t cc, uint8_t val7, uint32_t val32,
+                         bool only_hr, uint8_t flags, uint16_t cables);
+
+// SysEx payload from the pool (midi_sysex.h slot). streamed in chunks by the
+// dispatcher; realtime and other devices / ports keep going meanwhile, later messages
+// for a device or port still being fed wait until its F7 (MIDI forbids anything else inside)
+esp_err_t midi_out_sysex(midi_src_t src, uint8_t slot, uint8_t flags, uint16_t cables);
+
+// compiled program (see midi_prog.h): one queue entry, one copy per transport.
+// prog = slot from midi_prog_lookup(), copied before this returns.
+// ESP_ERR_INVALID_STATE = slot rebuilt / busy, ESP_ERR_NO_MEM = no room:
+// send the action list through the interpreter instead
+typedef struct midi_prog_s midi_prog_t;
+esp_err_t midi_out_prog(midi_src_t src, const midi_prog_t *prog);
+
+// thru: one complete incoming message (channel voice / system common, status first).
+// goes to DIN + every ready USB device (cable 0), never suppressed; t_us = when it
+// arrived (esp_timer, low 32 bits) for the thru latency stats
+esp_err_t midi_out_thru(midi_src_t src, const uint8_t *msg, int n, uint32_t t_us);
+
+// realtime (0xF8..0xFF): strict priority, sent ahead of every queued channel message.
+// any task may call midi_out_rt(); timer/GPIO ISRs use the _from_isr variant.
+esp_err_t midi_out_rt(uint8_t rt_byte);
+esp_err_t midi_out_rt_from_isr(uint8_t rt_byte, BaseType_t *woken);
+
+// end of a burst from src -> wake dispatcher (it sends + flushes everything queued)
+void midi_out_commit(midi_src_t src);
+
+// per-queue stats
+typedef struct {
+    uint32_t enqueued;
+    uint32_t dropped;      // queue full
+    uint32_t depth;        // waiting now
+    uint32_t high_water;   // max depth seen
+} midi_out_qstats_t;
+
+void midi_out_get_qstats(midi_src_t src, midi_out_qstats_t *out);
+
+// free slots in src's queue (its producer may wait on this instead of dropping)
+uint32_t midi_out_free(midi_src_t src);
+
+// realtime lane counters
+void midi_out_get_rtstats(uint32_t *sent, uint32_t *dropped);
+
+// sysex streams (times = first byte queued .. transport idle again)
+typedef struct {
+    uint32_t streams;      // started
+    uint32_t dropped;      // empty slot / no heap
+    uint32_t aborted;      // USB device cut off mid-stream (send failed, F7 sent to close it)
+    uint32_t bytes;        // payload bytes streamed (all streams)
+    uint32_t last_len;     // last stream
+    uint32_t last_usb_us;  // 0 = did not go to USB
+    uint32_t last_din_us;  // 0 = did not go to DIN
+    uint8_t  active;       // a stream is running now
+} midi_out_sysex_stats_t;
+
+void midi_out_get_sysex_stats(midi_out_sysex_stats_t *out);
+
+// thru latency: arrival .. handed to the transports (USB transfer / UART ring)
+typedef struct {
+    uint32_t msgs;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint32_t avg_us;       // running average (1/16)
+} midi_out_thru_stats_t;
+
+void midi_out_get_thru_stats(midi_out_thru_stats_t *out);
@@ -0,0 +1,237 @@
+// ===== FILE: main/midi_prog.c =====
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "midi_prog.h"
+
+static const char *TAG = "MIDI_PROG";
+
+// slots: footswitch [bank][btn][short/long], then exp/fs [port][tip/ring][short/long]
+#define PROG_FOOT_SLOTS   (MAX_BANKS * NUM_BTNS * 2)
+#define PROG_EXPFS_SLOTS  (EXPFS_PORT_COUNT * 2 * 2)
+#define PROG_SLOTS        (PROG_FOOT_SLOTS + PROG_EXPFS_SLOTS)
+
+// a slot read = ~330 B copy from PSRAM -> seqlock instead of a spinlock around it:
+// writer makes seq odd, copies, makes it even again; a reader retries if seq was odd
+// or changed during its copy (for at most PROG_READ_SPIN_US)
+#define PROG_READ_SPIN_US 50
+
+typedef struct {
+    volatile uint32_t seq;  // odd = write in progress
+    uint8_t compiled;       // 0 = list needs the interpreter (or slot never built)
+    midi_prog_t p;
+} prog_slot_t;
+
+// ✅ big table (1608 slots x 332 B ~ 521 KB) -> PSRAM only; without it every press uses the interpreter
+static prog_slot_t *s_slots = NULL;
+static portMUX_TYPE s_prog_mux = portMUX_INITIALIZER_UNLOCKED;   // writers only: even -> odd seq
+
+static inline uint8_t clamp7(int v)  { if (v < 0) return 0; if (v > 127) return 127; return (uint8_t)v; }
+static inline uint8_t clampCh(int v) { if (v < 1) return 1; if (v > 16) return 16; return (uint8_t)v; }
+
+static bool alloc_once(void)
+{
+    if (s_slots) return true;
+
+    const size_t bytes = sizeof(prog_slot_t) * PROG_SLOTS;
+
+    // no internal RAM fallback: the table is larger than the whole internal heap
+    s_slots = (prog_slot_t *)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+
+    if (!s_slots) {
+        ESP_LOGE(TAG, "no heap for action programs (%u bytes) -> interpreted path only", (unsigned)bytes);
+        return false;
+    }
+
+    memset(s_slots, 0, bytes);
+    ESP_LOGI(TAG, "action programs allocated (%u slots, %u bytes)", (unsigned)PROG_SLOTS, (unsigned)bytes);
+    return true;
+}
+
+static inline int foot_slot(int bank, int btn, int which)
+{
+    return ((bank * NUM_BTNS) + btn) * 2 + which;
+}
+
+static inline int expfs_slot(int port, int ring, int which)
+{
+    return PROG_FOOT_SLOTS + ((port * 2) + ring) * 2 + which;
+}
+
+// CC/PC only: anything else (or a later trigger-specific type) -> not compiled
+static bool compile(const action_t *list, int n, midi_prog_t *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    for (int i = 0; i < n; i++) {
+        const action_t *a = &list[i];
+        if (a->type == ACT_NONE) continue;
+
+        uint8_t ch = (uint8_t)((clampCh(a->ch) - 1) & 0x0F);
+        uint8_t msg[4];
+        int len;
+
+        if (a->type == ACT_CC) {
+            msg[0] = 0x0B;                       // CIN 0xB (cable added below)
+            msg[1] = (uint8_t)(0xB0 | ch);
+            msg[2] = clamp7(a->a);
+            msg[3] = clamp7(a->b);
+            len = 3;
+        } else if (a->type == ACT_PC) {
+            msg[0] = 0x0C;                       // CIN 0xC
+            msg[1] = (uint8_t)(0xC0 | ch);
+            msg[2] = clamp7(a->a);
+            msg[3] = 0;
+            len = 2;
+        } else {
+            return false;
+        }
+
+        out->din_off[out->n] = out->din_len;
+        out->usb_off[out->n] = out->usb_n;
+
+        if (ACTION_F_TO_DIN(a->c)) {
+            memcpy(&out->din[out->din_len], &msg[1], (size_t)len);
+            out->din_len += (uint8_t)len;
+        }
+
+        // one USB packet per targeted cable, back to back
+        const uint16_t cables = ACTION_F_TO_USB(a->c) ? ACTION_CABLES(a) : 0;
+        for (int cab = 0; cab < 16; cab++) {
+            if (!(cables & (1u << cab))) continue;
+            if (out->usb_n >= MIDI_PROG_USB_MAX) return false;   // too wide -> interpreted path
+            uint8_t *pkt = &out->usb[out->usb_n * 4];
+            memcpy(pkt, msg, 4);
+            pkt[0] = (uint8_t)((cab << 4) | msg[0]);
+            out->usb_n++;
+        }
+
+        out->flags[out->n] = a->c;
+        out->cables[out->n] = a->cables;
+        out->n++;
+        out->usb_off[out->n] = out->usb_n;
+        out->din_off[out->n] = out->din_len;
+    }
+    return true;
+}
+
+static void build_slot(int slot, const action_t *list)
+{
+    midi_prog_t tmp;
+    uint8_t ok = compile(list, MAX_ACTIONS, &tmp) ? 1u : 0u;
+
+    prog_slot_t *s = &s_slots[slot];
+
+    // claim the slot (another writer may be mid-copy: wait for it)
+    for (;;) {
+        bool got = false;
+        portENTER_CRITICAL(&s_prog_mux);
+        if (!(s->seq & 1u)) { s->seq++; got = true; }
+        portEXIT_CRITICAL(&s_prog_mux);
+        if (got) break;
+        vTaskDelay(1);
+    }
+
+    s->compiled = ok;
+    memcpy(&s->p, &tmp, sizeof(tmp));
+    __atomic_store_n(&s->seq, s->seq + 1u, __ATOMIC_RELEASE);
+}
+
+// -------------------- public --------------------
+void midi_prog_rebuild_btn(int bank, int btn)
+{
+    const foot_config_t *cfg = config_store_get();
+    if (!cfg || !alloc_once()) return;
+    if (bank < 0 || bank >= MAX_BANKS || btn < 0 || btn >= NUM_BTNS) return;
+
+    const btn_map_t *m = &cfg->map[bank][btn];
+    build_slot(foot_slot(bank, btn, 0), m->short_actions);
+    build_slot(foot_slot(bank, btn, 1), m->long_actions);
+}
+
+void midi_prog_rebuild_expfs(int port)
+{
+    if (port < 0 || port >= EXPFS_PORT_COUNT || !alloc_once()) return;
+
+    const expfs_port_cfg_t *e = config_store_get_expfs_cfg(port);
+    if (!e) return;
+
+    build_slot(expfs_slot(port, 0, 0), e->tip.short_actions);
+    build_slot(expfs_slot(port, 0, 1), e->tip.long_actions);
+    build_slot(expfs_slot(port, 1, 0), e->ring.short_actions);
+    build_slot(expfs_slot(port, 1, 1), e->ring.long_actions);
+}
+
+void midi_prog_rebuild_all(void)
+{
+    if (!config_store_get() || !alloc_once()) return;
+
+    for (int b = 0; b < MAX_BANKS; b++) {
+        for (int k = 0; k < NUM_BTNS; k++) midi_prog_rebuild_btn(b, k);
+    }
+    for (int p = 0; p < EXPFS_PORT_COUNT; p++) midi_prog_rebuild_expfs(p);
+}
+
+const midi_prog_t *midi_prog_lookup(const action_t *list)
+{
+    if (!s_slots || !list) return NULL;
+
+    int slot = -1;
+
+    // footswitch map: position inside cfg->map gives bank/btn/short-long
+    const foot_config_t *cfg = config_store_get();
+    if (cfg) {
+        const uint8_t *base = (const uint8_t *)&cfg->map[0][0];
+        const uint8_t *p = (const uint8_t *)list;
+        if (p >= base && p < base + sizeof(cfg->map)) {
+            size_t off = (size_t)(p - base);
+            size_t idx = off / sizeof(btn_map_t);
+            size_t rem = off % sizeof(btn_map_t);
+            if (rem == offsetof(btn_map_t, short_actions))     slot = (int)idx * 2;
+            else if (rem == offsetof(btn_map_t, long_actions)) slot = (int)idx * 2 + 1;
+        }
+    }
+
+    // exp/fs tip/ring
+    for (int port = 0; slot < 0 && port < EXPFS_PORT_COUNT; port++) {
+        const expfs_port_cfg_t *e = config_store_get_expfs_cfg(port);
+        if (!e) continue;
+        if (list == e->tip.short_actions)       slot = expfs_slot(port, 0, 0);
+        else if (list == e->tip.long_actions)   slot = expfs_slot(port, 0, 1);
+        else if (list == e->ring.short_actions) slot = expfs_slot(port, 1, 0);
+        else if (list == e->ring.long_actions)  slot = expfs_slot(port, 1, 1);
+    }
+
+    if (slot < 0 || !s_slots[slot].compiled) return NULL;
+    return &s_slots[slot].p;
+}
+
+bool midi_prog_read(const midi_prog_t *slot, midi_prog_t *out)
+{
+    if (!s_slots || !slot || !out) return false;
+
+    const prog_slot_t *s = (const prog_slot_t *)((const uint8_t *)slot - offsetof(prog_slot_t, p));
+
+    // never sleeps: a writer on the other core is done within a few us; one we
+    // preempted on this core can't finish before we give up -> caller interprets
+    const int64_t t_end = esp_timer_get_time() + PROG_READ_SPIN_US;
+    do {
+        const uint32_t s0 = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (s0 & 1u) continue;
+
+        const bool ok = (s->compiled != 0);
+        if (ok) memcpy(out, &s->p, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == s0) return ok;
+    } while (esp_timer_get_time() < t_end);
+
+    return false;
+}
@@ -0,0 +1,40 @@
+// ===== FILE: main/midi_prog.h =====
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "config_store.h"
+
+// compiled action list: wire-ready bytes per transport, rebuilt whenever the
+// config changes so a press is one copy per transport (no walking/clamping).
+// the route of each action (ACTION_F_ROUTE) is resolved here: a USB-only message
+// has no DIN bytes, a DIN-only one no USB packets
+// USB packets a program may hold: one per targeted cable. wider lists are not
+// compiled (interpreted path still sends them)
+#define MIDI_PROG_USB_MAX   (MAX_ACTIONS * 2)
+
+typedef struct midi_prog_s {
+    uint8_t n;                          // messages (0 = nothing to send)
+    uint8_t din_len;                    // bytes used in din[]
+    uint8_t usb_n;                      // packets used in usb[]
+    uint8_t usb_off[MAX_ACTIONS + 1];   // message i = packets usb_off[i] .. usb_off[i+1]-1 (none = not for USB)
+    uint8_t din_off[MAX_ACTIONS + 1];   // message i = din[din_off[i]] .. din[din_off[i+1]-1] (none = not for DIN)
+    uint8_t usb[MIDI_PROG_USB_MAX * 4]; // USB-MIDI event packets, one per cable of each message
+    uint8_t din[MAX_ACTIONS * 3];       // DIN bytes, status on every message
+    uint8_t flags[MAX_ACTIONS];         // ACTION_F_* per message
+    uint16_t cables[MAX_ACTIONS];       // cable mask per message (0 = cable 0)
+} midi_prog_t;
+
+// (re)compile programs from config_store (safe to call any time after config_store_init)
+void midi_prog_rebuild_all(void);
+void midi_prog_rebuild_btn(int bank, int btn);
+void midi_prog_rebuild_expfs(int port);
+
+// program slot for an action list owned by config_store (footswitch map or exp/fs
+// tip/ring). NULL = not compiled (no heap, or list not part of the config).
+const midi_prog_t *midi_prog_lookup(const action_t *list);
+
+// copy a slot consistently (a rebuild may run on another task). never blocks.
+// false = no copy (no longer compiled after a config edit, or a rebuild holds the
+// slot right now) -> send the action list through the interpreter instead.
+// true with out->n == 0 = compiled, nothing to send
+bool midi_prog_read(const midi_prog_t *slot, midi_prog_t *out);
@@ -0,0 +1,327 @@
+// ===== FILE: main/midi_scene.c =====
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "midi_scene.h"
+#include "midi_state.h"
+#include "midi_out.h"
+#include "footswitch.h"
+#include "config_store.h"
+
+static const char *TAG = "MIDI_SCENE";
+
+#define SCENE_MAGIC  0x4E435346u   // 'FSCN'
+#define SCENE_VER    3      // 2: one mirror per USB device slot, 3: one per DIN port
+#define SCENE_PORTS_V2  4   // mirrors in a v2 file (3 USB + 1 DIN)
+#define SCENE_PATH   "/spiffs/scene_%02d.bin"
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t ver;
+    uint16_t reserved;
+    uint32_t size;
+} scene_hdr_t;
+
+typedef struct {
+    uint8_t cc[MIDI_PORT_COUNT][16][128];
+    uint8_t pc[MIDI_PORT_COUNT][16];
+    uint8_t ab[MAX_BANKS * NUM_BTNS];
+    uint8_t grp[MAX_BANKS];
+} scene_body_t;
+
+typedef enum { SCENE_CMD_SAVE = 0, SCENE_CMD_RECALL, SCENE_CMD_DELETE } scene_cmd_kind_t;
+
+typedef struct {
+    uint8_t kind;
+    uint8_t idx;
+} scene_cmd_t;
+
+static QueueHandle_t s_cmdq = NULL;
+static uint32_t s_exists = 0;          // bit per scene file on SPIFFS
+static midi_scene_stats_t s_stats = { .last_idx = -1 };
+
+// work buffers (scene task only), PSRAM first
+static scene_body_t *s_snap = NULL;    // file contents
+static scene_body_t *s_cur = NULL;     // live state for the diff
+
+static void scene_path(int idx, char *out, size_t n)
+{
+    snprintf(out, n, SCENE_PATH, idx);
+}
+
+static scene_body_t *alloc_body(void)
+{
+    scene_body_t *b = (scene_body_t *)heap_caps_malloc(sizeof(scene_body_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!b) b = (scene_body_t *)heap_caps_malloc(sizeof(scene_body_t), MALLOC_CAP_8BIT);
+    return b;
+}
+
+static void capture(scene_body_t *b)
+{
+    for (int p = 0; p < MIDI_PORT_COUNT; p++) {
+        if (!midi_state_export((midi_port_t)p, b->cc[p], b->pc[p])) {
+            memset(b->cc[p], MIDI_STATE_UNKNOWN, sizeof(b->cc[p]));
+            memset(b->pc[p], MIDI_STATE_UNKNOWN, sizeof(b->pc[p]));
+        }
+    }
+    footswitch_dyn_export(b->ab, b->grp);
+}
+
+// -------------------- file I/O --------------------
+static esp_err_t file_save(int idx, const scene_body_t *b)
+{
+    char path[32];
+    scene_path(idx, path, sizeof(path));
+
+    FILE *f = fopen(path, "wb");
+    if (!f) return ESP_FAIL;
+
+    scene_hdr_t hdr = {0};
+    hdr.magic = SCENE_MAGIC;
+    hdr.ver   = SCENE_VER;
+    hdr.size  = (uint32_t)sizeof(scene_body_t);
+
+    size_t w1 = fwrite(&hdr, 1, sizeof(hdr), f);
+    size_t w2 = fwrite(b, 1, sizeof(*b), f);
+    fflush(f);
+    fclose(f);
+
+    if (w1 != sizeof(hdr) || w2 != sizeof(*b)) return ESP_FAIL;
+    return ESP_OK;
+}
+
+// body size a header must announce for its version (0 = version not readable)
+static size_t hdr_body_size(const scene_hdr_t *hdr)
+{
+    if (hdr->magic != SCENE_MAGIC) return 0;
+    if (hdr->ver == SCENE_VER) return sizeof(scene_body_t);
+    if (hdr->ver == 2) {
+        const scene_body_t *b = NULL;
+        return (sizeof(b->cc[0]) + sizeof(b->pc[0])) * SCENE_PORTS_V2 + sizeof(b->ab) + sizeof(b->grp);
+    }
+    return 0;
+}
+
+static esp_err_t file_load(int idx, scene_body_t *b)
+{
+    char path[32];
+    scene_path(idx, path, sizeof(path));
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return ESP_ERR_NOT_FOUND;
+
+    scene_hdr_t hdr;
+    size_t r1 = fread(&hdr, 1, sizeof(hdr), f);
+    if (r1 != sizeof(hdr) || hdr_body_size(&hdr) == 0 || hdr.size != hdr_body_size(&hdr)) {
+        fclose(f);
+        return ESP_FAIL;
+    }
+
+    if (hdr.ver == 2) {
+        // v2: same layout with fewer mirrors -> the DIN ports added since start unknown
+        const size_t ncc = sizeof(b->cc[0]) * SCENE_PORTS_V2;
+        const size_t npc = sizeof(b->pc[0]) * SCENE_PORTS_V2;
+
+        memset(b->cc, MIDI_STATE_UNKNOWN, sizeof(b->cc));
+        memset(b->pc, MIDI_STATE_UNKNOWN, sizeof(b->pc));
+        size_t r2 = fread(b->cc, 1, ncc, f);
+        r2 += fread(b->pc, 1, npc, f);
+        r2 += fread(b->ab, 1, sizeof(b->ab), f);
+        r2 += fread(b->grp, 1, sizeof(b->grp), f);
+        fclose(f);
+        return (r2 == hdr.size) ? ESP_OK : ESP_FAIL;
+    }
+
+    size_t r2 = fread(b, 1, sizeof(*b), f);
+    fclose(f);
+    return (r2 == sizeof(*b)) ? ESP_OK : ESP_FAIL;
+}
+
+// -------------------- recall --------------------
+// queue is short (64): wait for room instead of dropping (own task, may block)
+static void wait_room(void)
+{
+    while (midi_out_free(MIDI_SRC_SCENE) == 0) {
+        midi_out_commit(MIDI_SRC_SCENE);
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+// one receiver: PCs first (preset), then the CCs that differ
+static uint32_t send_diff(midi_port_t port, const scene_body_t *want, const scene_body_t *have, uint32_t *skipped)
+{
+    const uint8_t route = MIDI_PORT_IS_USB(port)
+        ? (uint8_t)(ACTION_F_ROUTE(ACTION_ROUTE_USB) | ACTION_F_USB_DEV(port - MIDI_PORT_USB))
+        : (uint8_t)(ACTION_F_ROUTE(ACTION_ROUTE_DIN) | ACTION_F_DIN_PORT(port - MIDI_PORT_DIN));
+    uint32_t n = 0;
+
+    for (int ch = 0; ch < 16; ch++) {
+        uint8_t v = want->pc[port][ch];
+        if (v == MIDI_STATE_UNKNOWN) continue;
+        if (v == have->pc[port][ch]) { (*skipped)++; continue; }
+        wait_room();
+        (void)midi_out_pc(MIDI_SRC_SCENE, (uint8_t)(ch + 1), v, route, 0);
+        n++;
+    }
+
+    for (int ch = 0; ch < 16; ch++) {
+        for (int cc = 0; cc < 128; cc++) {
+            uint8_t v = want->cc[port][ch][cc];
+            if (v == MIDI_STATE_UNKNOWN) continue;
+            if (v == have->cc[port][ch][cc]) { (*skipped)++; continue; }
+            wait_room();
+            (void)midi_out_cc(MIDI_SRC_SCENE, (uint8_t)(ch + 1), (uint8_t)cc, v, route, 0);
+            n++;
+        }
+    }
+    return n;
+}
+
+static void do_recall(int idx)
+{
+    esp_err_t e = file_load(idx, s_snap);
+    if (e != ESP_OK) {
+        ESP_LOGW(TAG, "scene %d: load failed (%s)", idx, esp_err_to_name(e));
+        return;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    capture(s_cur);
+
+    uint32_t skipped = 0;
+    uint32_t nu = 0;
+    for (int d = 0; d < MIDI_PORT_USB_COUNT; d++) nu += send_diff(MIDI_PORT_USB_DEV(d), s_snap, s_cur, &skipped);
+    uint32_t nd = 0;
+    for (int p = 0; p < MIDI_PORT_DIN_COUNT; p++) nd += send_diff(MIDI_PORT_DIN_N(p), s_snap, s_cur, &skipped);
+    midi_out_commit(MIDI_SRC_SCENE);
+
+    footswitch_dyn_import(s_snap->ab, s_snap->grp);
+
+    s_stats.last_idx = idx;
+    s_stats.last_usb_msgs = nu;
+    s_stats.last_din_msgs = nd;
+    s_stats.last_skipped = skipped;
+    s_stats.last_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    s_stats.recalls++;
+
+    ESP_LOGI(TAG, "scene %d recalled: usb=%u din=%u msgs, %u unchanged, %u ms",
+             idx, (unsigned)nu, (unsigned)nd, (unsigned)skipped, (unsigned)s_stats.last_ms);
+}
+
+static void do_save(int idx)
+{
+    capture(s_cur);
+    if (file_save(idx, s_cur) != ESP_OK) {
+        ESP_LOGE(TAG, "scene %d: save failed", idx);
+        return;
+    }
+    s_exists |= (1u << idx);
+    s_stats.saves++;
+    ESP_LOGI(TAG, "scene %d saved", idx);
+}
+
+static void do_delete(int idx)
+{
+    char path[32];
+    scene_path(idx, path, sizeof(path));
+    (void)remove(path);
+    s_exists &= ~(1u << idx);
+}
+
+static void scene_task(void *arg)
+{
+    (void)arg;
+    scene_cmd_t c;
+
+    while (1) {
+        if (xQueueReceive(s_cmdq, &c, portMAX_DELAY) != pdTRUE) continue;
+
+        switch (c.kind) {
+        case SCENE_CMD_SAVE:   do_save(c.idx);   break;
+        case SCENE_CMD_RECALL: do_recall(c.idx); break;
+        case SCENE_CMD_DELETE: do_delete(c.idx); break;
+        default: break;
+        }
+    }
+}
+
+static esp_err_t post(scene_cmd_kind_t kind, int idx)
+{
+    if (!s_cmdq) return ESP_ERR_INVALID_STATE;
+    if (idx < 0 || idx >= MIDI_SCENE_COUNT) return ESP_ERR_INVALID_ARG;
+
+    scene_cmd_t c = { .kind = (uint8_t)kind, .idx = (uint8_t)idx };
+    return (xQueueSend(s_cmdq, &c, 0) == pdTRUE) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+// -------------------- public --------------------
+void midi_scene_init(void)
+{
+    if (s_cmdq) {
+        ESP_LOGW(TAG, "already inited");
+        return;
+    }
+
+    s_snap = alloc_body();
+    s_cur = alloc_body();
+    if (!s_snap || !s_cur) {
+        ESP_LOGE(TAG, "no heap for scene buffers (2 x %u bytes) -> scenes disabled", (unsigned)sizeof(scene_body_t));
+        return;
+    }
+
+    // which scenes exist (header check only, same rule as file_load: v2 files count)
+    for (int i = 0; i < MIDI_SCENE_COUNT; i++) {
+        char path[32];
+        scene_path(i, path, sizeof(path));
+        FILE *f = fopen(path, "rb");
+        if (!f) continue;
+        scene_hdr_t hdr;
+        if (fread(&hdr, 1, sizeof(hdr), f) == sizeof(hdr) &&
+            hdr_body_size(&hdr) != 0 && hdr.size == hdr_body_size(&hdr)) {
+            s_exists |= (1u << i);
+        }
+        fclose(f);
+    }
+
+    s_cmdq = xQueueCreate(4, sizeof(scene_cmd_t));
+    if (!s_cmdq) {
+        ESP_LOGE(TAG, "cmd queue create failed");
+        return;
+    }
+
+    // below footswitch/expfs: recall is bulk work, presses stay first
+    if (xTaskCreatePinnedToCore(scene_task, "midi_scene", 4096, NULL, 4, NULL, 1) != pdPASS) {
+        ESP_LOGE(TAG, "scene task create failed");
+        vQueueDelete(s_cmdq);
+        s_cmdq = NULL;
+        return;
+    }
+
+    ESP_LOGI(TAG, "scenes ready (%d slots, saved mask=0x%04x)", MIDI_SCENE_COUNT, (unsigned)s_exists);
+}
+
+esp_err_t midi_scene_save(int idx)   { return post(SCENE_CMD_SAVE, idx); }
+esp_err_t midi_scene_recall(int idx) { return post(SCENE_CMD_RECALL, idx); }
+esp_err_t midi_scene_delete(int idx) { return post(SCENE_CMD_DELETE, idx); }
+
+bool midi_scene_exists(int idx)
+{
+    if (idx < 0 || idx >= MIDI_SCENE_COUNT) return false;
+    return (s_exists >> idx) & 1u;
+}
+
+void midi_scene_get_stats(midi_scene_stats_t *out)
+{
+    if (!out) return;
+    *out = s_stats;
+}
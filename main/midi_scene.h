@@ -0,0 +1,30 @@
+// ===== FILE: main/midi_scene.h =====
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// scenes: snapshot of every receiver's CC/PC state (midi_state mirror) plus the
+// footswitch A/B + group state. recall sends only what differs from now.
+#define MIDI_SCENE_COUNT 16
+
+void midi_scene_init(void);
+
+// async (scene task does the SPIFFS I/O and the sending); ESP_ERR_NO_MEM = busy
+esp_err_t midi_scene_save(int idx);
+esp_err_t midi_scene_recall(int idx);
+esp_err_t midi_scene_delete(int idx);
+
+bool midi_scene_exists(int idx);
+
+typedef struct {
+    int      last_idx;        // last recalled scene (-1 = none)
+    uint32_t last_usb_msgs;   // messages the diff sent per transport (usb = all devices)
+    uint32_t last_din_msgs;
+    uint32_t last_skipped;    // entries already matching (not sent)
+    uint32_t last_ms;         // recall duration until everything was queued
+    uint32_t recalls;
+    uint32_t saves;
+} midi_scene_stats_t;
+
+void midi_scene_get_stats(midi_scene_stats_t *out);
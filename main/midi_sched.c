@@ -0,0 +1,298 @@
+// ===== FILE: main/midi_sched.c =====
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "midi_sched.h"
+
+static const char *TAG = "MIDI_SCHED";
+
+// ---- config ----
+#define SCHED_POOL      256            // pending timed messages (all producers)
+#define SCHED_L0_BITS   8              // level 0: 256 x 1 ms
+#define SCHED_L1_BITS   6              // level 1:  64 x 256 ms  (horizon 16384 ms)
+#define SCHED_L0_SLOTS  (1u << SCHED_L0_BITS)
+#define SCHED_L1_SLOTS  (1u << SCHED_L1_BITS)
+#define SCHED_NIL       0xFFFFu
+
+typedef struct {
+    uint16_t next;
+    uint16_t cables;   // USB cable mask
+    uint8_t  tag;
+    uint8_t  status;   // Bx / Cx (channel included) / F0 = sysex slot d1
+    uint8_t  d1;
+    uint8_t  d2;
+    uint8_t  flags;    // ACTION_F_*
+    uint32_t due;      // tick (ms)
+} sched_ent_t;
+
+// FIFO per slot -> same-tick entries keep their sequence order
+typedef struct {
+    uint16_t head;
+    uint16_t tail;
+} sched_list_t;
+
+static sched_ent_t  s_pool[SCHED_POOL];
+static uint16_t     s_free = SCHED_NIL;
+static sched_list_t s_l0[SCHED_L0_SLOTS];
+static sched_list_t s_l1[SCHED_L1_SLOTS];
+
+static uint32_t s_now = 0;             // last processed tick
+static uint32_t s_pending = 0;
+static bool     s_running = false;     // one-shot armed (only its owner re-arms it)
+
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_tmr = NULL;
+static midi_sched_stats_t s_stats;
+
+static inline uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// -------------------- lists (s_mux held) --------------------
+static inline void list_push(sched_list_t *l, uint16_t i)
+{
+    s_pool[i].next = SCHED_NIL;
+    if (l->tail == SCHED_NIL) l->head = i;
+    else s_pool[l->tail].next = i;
+    l->tail = i;
+}
+
+static inline void list_clear(sched_list_t *l)
+{
+    l->head = SCHED_NIL;
+    l->tail = SCHED_NIL;
+}
+
+static inline void free_push(uint16_t i)
+{
+    s_pool[i].next = s_free;
+    s_free = i;
+}
+
+static void wheel_insert(uint16_t i)
+{
+    uint32_t due = s_pool[i].due;
+    uint32_t delta = due - s_now;
+
+    if (delta < SCHED_L0_SLOTS) {
+        list_push(&s_l0[due & (SCHED_L0_SLOTS - 1)], i);
+    } else {
+        list_push(&s_l1[(due >> SCHED_L0_BITS) & (SCHED_L1_SLOTS - 1)], i);
+    }
+}
+
+// remove every entry with tag from one list; returns removed count
+static uint32_t list_cancel(sched_list_t *l, uint8_t tag)
+{
+    uint32_t n = 0;
+    uint16_t i = l->head;
+    list_clear(l);
+
+    while (i != SCHED_NIL) {
+        uint16_t nx = s_pool[i].next;
+        if (s_pool[i].tag == tag) {
+            free_push(i);
+            n++;
+        } else {
+            list_push(l, i);
+        }
+        i = nx;
+    }
+    return n;
+}
+
+// -------------------- tick --------------------
+static void fire_list(uint16_t i)
+{
+    while (i != SCHED_NIL) {
+        const sched_ent_t *e = &s_pool[i];
+        uint8_t ch = (uint8_t)((e->status & 0x0F) + 1);
+
+        if (e->status == 0xF0)               (void)midi_out_sysex(MIDI_SRC_SCHED, e->d1, e->flags, e->cables);
+        else if ((e->status & 0xF0) == 0xB0) (void)midi_out_cc(MIDI_SRC_SCHED, ch, e->d1, e->d2, e->flags, e->cables);
+        else                                 (void)midi_out_pc(MIDI_SRC_SCHED, ch, e->d1, e->flags, e->cables);
+
+        uint16_t nx = e->next;
+        portENTER_CRITICAL(&s_mux);
+        free_push(i);
+        s_pending--;
+        s_stats.fired++;
+        portEXIT_CRITICAL(&s_mux);
+        i = nx;
+    }
+}
+
+// esp_timer task: advance the wheel up to "now" (catches up after a late callback),
+// then re-arm for the next tick while anything is pending
+static void sched_tmr_cb(void *arg)
+{
+    (void)arg;
+    const uint32_t target = now_ms();
+    bool fired = false;
+    bool rearm;
+
+    while (1) {
+        uint16_t due_head = SCHED_NIL;
+
+        portENTER_CRITICAL(&s_mux);
+        if (s_pending == 0 || (int32_t)(target - s_now) <= 0) {
+            rearm = (s_pending != 0);
+            if (!rearm) s_running = false;
+            portEXIT_CRITICAL(&s_mux);
+            break;
+        }
+
+        s_now++;
+
+        // new 256 ms block -> cascade its level-1 slot down to level 0
+        if ((s_now & (SCHED_L0_SLOTS - 1)) == 0) {
+            sched_list_t *l1 = &s_l1[(s_now >> SCHED_L0_BITS) & (SCHED_L1_SLOTS - 1)];
+            uint16_t i = l1->head;
+            list_clear(l1);
+            while (i != SCHED_NIL) {
+                uint16_t nx = s_pool[i].next;
+                wheel_insert(i);
+                i = nx;
+            }
+        }
+
+        sched_list_t *l0 = &s_l0[s_now & (SCHED_L0_SLOTS - 1)];
+        due_head = l0->head;
+        list_clear(l0);
+        portEXIT_CRITICAL(&s_mux);
+
+        // detached list: send outside the lock
+        if (due_head != SCHED_NIL) {
+            fire_list(due_head);
+            fired = true;
+        }
+    }
+
+    if (fired) midi_out_commit(MIDI_SRC_SCHED);
+    if (rearm) (void)esp_timer_start_once(s_tmr, 1000);
+}
+
+// -------------------- add --------------------
+static esp_err_t sched_add(uint32_t delay_ms, midi_src_t tag, uint8_t status, uint8_t d1, uint8_t d2, uint8_t flags, uint16_t cables)
+{
+    if (!s_tmr) return ESP_ERR_INVALID_STATE;
+    if (delay_ms < 1) delay_ms = 1;
+    if (delay_ms > MIDI_SCHED_MAX_MS) delay_ms = MIDI_SCHED_MAX_MS;
+
+    bool start = false;
+
+    portENTER_CRITICAL(&s_mux);
+    if (s_free == SCHED_NIL) {
+        s_stats.dropped++;
+        portEXIT_CRITICAL(&s_mux);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // idle wheel: jump straight to now (nothing pending to replay)
+    if (!s_running) {
+        s_now = now_ms();
+        s_running = true;
+        start = true;
+    }
+
+    uint16_t i = s_free;
+    s_free = s_pool[i].next;
+
+    sched_ent_t *e = &s_pool[i];
+    e->tag = (uint8_t)tag;
+    e->status = status;
+    e->d1 = d1;
+    e->d2 = d2;
+    e->flags = flags;
+    e->cables = cables;
+    e->due = s_now + delay_ms;
+    wheel_insert(i);
+
+    s_pending++;
+    s_stats.scheduled++;
+    if (s_pending > s_stats.max_pending) s_stats.max_pending = s_pending;
+    portEXIT_CRITICAL(&s_mux);
+
+    if (start) (void)esp_timer_start_once(s_tmr, 1000);
+    return ESP_OK;
+}
+
+// -------------------- public --------------------
+void midi_sched_init(void)
+{
+    if (s_tmr) {
+        ESP_LOGW(TAG, "already inited");
+        return;
+    }
+
+    for (uint32_t k = 0; k < SCHED_L0_SLOTS; k++) list_clear(&s_l0[k]);
+    for (uint32_t k = 0; k < SCHED_L1_SLOTS; k++) list_clear(&s_l1[k]);
+    s_free = SCHED_NIL;
+    for (int k = SCHED_POOL - 1; k >= 0; k--) free_push((uint16_t)k);
+    memset(&s_stats, 0, sizeof(s_stats));
+
+    const esp_timer_create_args_t ta = {
+        .callback = sched_tmr_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "midi_sched",
+    };
+    if (esp_timer_create(&ta, &s_tmr) != ESP_OK) {
+        ESP_LOGE(TAG, "timer create failed -> delayed actions disabled");
+        s_tmr = NULL;
+        return;
+    }
+
+    ESP_LOGI(TAG, "scheduler ready (pool=%d, horizon=%d ms)", SCHED_POOL, MIDI_SCHED_MAX_MS);
+}
+
+esp_err_t midi_sched_cc(uint32_t delay_ms, midi_src_t tag, uint8_t ch_1_16, uint8_t cc, uint8_t val, uint8_t flags, uint16_t cables)
+{
+    if (ch_1_16 < 1) ch_1_16 = 1;
+    if (ch_1_16 > 16) ch_1_16 = 16;
+    return sched_add(delay_ms, tag, (uint8_t)(0xB0 | (ch_1_16 - 1)), (uint8_t)(cc & 0x7F), (uint8_t)(val & 0x7F), flags, cables);
+}
+
+esp_err_t midi_sched_pc(uint32_t delay_ms, midi_src_t tag, uint8_t ch_1_16, uint8_t pc, uint8_t flags, uint16_t cables)
+{
+    if (ch_1_16 < 1) ch_1_16 = 1;
+    if (ch_1_16 > 16) ch_1_16 = 16;
+    return sched_add(delay_ms, tag, (uint8_t)(0xC0 | (ch_1_16 - 1)), (uint8_t)(pc & 0x7F), 0, flags, cables);
+}
+
+esp_err_t midi_sched_sysex(uint32_t delay_ms, midi_src_t tag, uint8_t slot, uint8_t flags, uint16_t cables)
+{
+    return sched_add(delay_ms, tag, 0xF0, slot, 0, flags, cables);
+}
+
+void midi_sched_cancel(midi_src_t tag)
+{
+    uint32_t n = 0;
+
+    portENTER_CRITICAL(&s_mux);
+    if (s_pending) {
+        for (uint32_t k = 0; k < SCHED_L0_SLOTS; k++) n += list_cancel(&s_l0[k], (uint8_t)tag);
+        for (uint32_t k = 0; k < SCHED_L1_SLOTS; k++) n += list_cancel(&s_l1[k], (uint8_t)tag);
+        s_pending -= n;
+        s_stats.cancelled += n;
+    }
+    portEXIT_CRITICAL(&s_mux);
+
+    if (n) ESP_LOGD(TAG, "cancelled %u pending (tag=%d)", (unsigned)n, (int)tag);
+}
+
+void midi_sched_get_stats(midi_sched_stats_t *out)
+{
+    if (!out) return;
+    portENTER_CRITICAL(&s_mux);
+    *out = s_stats;
+    out->pending = s_pending;
+    portEXIT_CRITICAL(&s_mux);
+}
@@ -0,0 +1,31 @@
+// ===== FILE: main/midi_sched.h =====
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+#include "midi_out.h"
+
+// delayed CC/PC (ACT_DELAY sequences). 1 ms resolution, up to MIDI_SCHED_MAX_MS ahead.
+// never blocks: entries sit in a 2-level timer wheel and are handed to the
+// dispatcher (MIDI_SRC_SCHED queue) when due.
+#define MIDI_SCHED_MAX_MS   16383
+
+void midi_sched_init(void);
+
+// tag = producer that owns the entry (cancel unit); flags/cables as midi_out_cc()
+esp_err_t midi_sched_cc(uint32_t delay_ms, midi_src_t tag, uint8_t ch_1_16, uint8_t cc, uint8_t val, uint8_t flags, uint16_t cables);
+esp_err_t midi_sched_pc(uint32_t delay_ms, midi_src_t tag, uint8_t ch_1_16, uint8_t pc, uint8_t flags, uint16_t cables);
+esp_err_t midi_sched_sysex(uint32_t delay_ms, midi_src_t tag, uint8_t slot, uint8_t flags, uint16_t cables);
+
+// drop everything still pending for tag (e.g. bank change cancels footswitch sequences)
+void midi_sched_cancel(midi_src_t tag);
+
+typedef struct {
+    uint32_t scheduled;
+    uint32_t fired;
+    uint32_t cancelled;
+    uint32_t dropped;      // pool full
+    uint32_t pending;
+    uint32_t max_pending;
+} midi_sched_stats_t;
+
+void midi_sched_get_stats(midi_sched_stats_t *out);
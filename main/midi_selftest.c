@@ -0,0 +1,403 @@
+// ===== FILE: main/midi_selftest.c =====
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "midi_selftest.h"
+#include "uart_midi_out.h"
+#include "uart_midi_in.h"
+
+static const char *TAG = "MIDI_SELFTEST";
+
+// ---- config ----
+#define ST_PORT         0                 // DIN 1 (the port with an RX pin)
+#define ST_PORT_MASK    ((uint8_t)(1u << ST_PORT))
+#define ST_BURST        192               // messages per CC/PC burst (< TX ring: nothing dropped)
+#define ST_CC_FIRST     102               // 102..105 = undefined controllers
+#define ST_CC_COUNT     4
+#define ST_SYSEX_LEN    512               // F0 7D <510 data> F7 (7D = non-commercial id)
+#define ST_PINGS        16
+#define ST_CAP          1024              // captured bytes per test
+#define ST_FLUSH_MS     2000
+#define ST_BYTE_US      320               // one byte on the wire @31250
+#define ST_RS_SETTLE_MS 250               // > UART_MIDI_RS_REFRESH_MS: first message carries its status
+
+typedef struct {
+    uint8_t b[3];
+    uint8_t n;
+} st_msg_t;
+
+// one block (PSRAM if there is one), freed after the run
+typedef struct {
+    uint8_t  cap[ST_CAP];
+    uint8_t  sx[ST_SYSEX_LEN];
+    st_msg_t sent[ST_BURST];
+    st_msg_t recv[ST_CAP / 2];
+} st_work_t;
+
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static midi_selftest_status_t s_st;
+static volatile bool s_busy = false;
+
+// -------------------- decode / compare --------------------
+// channel messages only (running status, realtime skipped). data byte without a
+// status = stray -> counted as an error by the caller
+static int decode(const uint8_t *in, int n, st_msg_t *out, int cap, uint32_t *bytes, uint32_t *stray)
+{
+    uint8_t rs = 0;
+    st_msg_t cur = {0};
+    int need = 0, k = 0;
+
+    for (int i = 0; i < n; i++) {
+        uint8_t b = in[i];
+        if (b >= 0xF8) continue;
+        (*bytes)++;
+
+        if (b & 0x80) {
+            rs = (b < 0xF0) ? b : 0;
+            cur.b[0] = b;
+            cur.n = 1;
+            uint8_t hi = (uint8_t)(b & 0xF0);
+            need = (hi == 0xC0 || hi == 0xD0) ? 1 : 2;
+            continue;
+        }
+        if (!rs) { (*stray)++; continue; }
+        if (cur.n == 1 + need) {   // running status: previous one complete, status implied
+            cur.b[0] = rs;
+            cur.n = 1;
+        }
+        cur.b[cur.n++] = b;
+        if (cur.n == 1 + need && k < cap) out[k++] = cur;
+    }
+    return k;
+}
+
+static bool msg_eq(const st_msg_t *a, const st_msg_t *b)
+{
+    return a->n == b->n && memcmp(a->b, b->b, a->n) == 0;
+}
+
+// plain path: every message must come back, in order
+static uint32_t cmp_exact(const st_msg_t *a, int na, const st_msg_t *b, int nb)
+{
+    uint32_t e = 0;
+    int n = (na > nb) ? na : nb;
+    for (int i = 0; i < n; i++) {
+        if (i >= na) { e += b[i].n; continue; }
+        if (i >= nb) { e += a[i].n; continue; }
+        if (a[i].n != b[i].n) { e += (a[i].n > b[i].n) ? a[i].n : b[i].n; continue; }
+        for (int j = 0; j < a[i].n; j++) e += (a[i].b[j] != b[i].b[j]);
+    }
+    return e;
+}
+
+// coalesced path: per controller, what comes back is a subsequence of what was
+// sent (order across controllers may change: a merged value keeps its old slot),
+// and the last value of every controller made it
+static uint32_t cmp_coal(const st_msg_t *a, int na, const st_msg_t *b, int nb)
+{
+    uint32_t e = 0;
+    int pos[ST_CC_COUNT] = {0};
+    for (int j = 0; j < nb; j++) {
+        int c = b[j].b[1] - ST_CC_FIRST;
+        if (c < 0 || c >= ST_CC_COUNT) { e += b[j].n; continue; }
+        int k = pos[c];
+        while (k < na && !msg_eq(&a[k], &b[j])) k++;
+        if (k == na) { e += b[j].n; continue; }
+        pos[c] = k + 1;
+    }
+
+    for (int c = 0; c < ST_CC_COUNT; c++) {
+        const st_msg_t *ls = NULL, *lr = NULL;
+        for (int k = 0; k < na; k++) if (a[k].b[1] == ST_CC_FIRST + c) ls = &a[k];
+        for (int k = 0; k < nb; k++) if (b[k].b[1] == ST_CC_FIRST + c) lr = &b[k];
+        if (!ls) continue;
+        if (!lr) e += ls->n;
+        else if (!msg_eq(ls, lr)) e++;
+    }
+    return e;
+}
+
+// -------------------- one burst --------------------
+typedef enum { ST_CC, ST_CC_CONT, ST_PC, ST_SYSEX } st_kind_t;
+
+static esp_err_t run_burst(st_work_t *w, st_kind_t kind, bool rs, uint8_t ch, midi_selftest_result_t *r)
+{
+    static const char *const NAMES[] = { "cc", "cc_cont", "pc", "sysex" };
+
+    memset(r, 0, sizeof(*r));
+    r->name = NAMES[kind];
+    r->rs = rs ? 1 : 0;
+    r->coal = (kind == ST_CC_CONT) ? 1 : 0;
+
+    uart_midi_out_force_running_status(ST_PORT, rs ? 1 : 0);
+    esp_err_t e = uart_midi_out_flush(ST_PORT_MASK, ST_FLUSH_MS);
+    if (e != ESP_OK) return e;
+    // the status of the previous test may still count as "on the wire" -> the first
+    // byte captured would be a bare data byte
+    if (rs) vTaskDelay(pdMS_TO_TICKS(ST_RS_SETTLE_MS));
+
+    uart_midi_stats_t s0, s1;
+    uart_midi_out_get_stats(ST_PORT, &s0);
+
+    e = uart_midi_in_capture_start(w->cap, ST_CAP);
+    if (e != ESP_OK) return e;
+
+    int ns = 0;
+    const int64_t t0 = esp_timer_get_time();
+
+    if (kind == ST_SYSEX) {
+        int off = 0;
+        while (off < ST_SYSEX_LEN) {
+            int k = uart_midi_send_sysex_chunk(ST_PORT, &w->sx[off], ST_SYSEX_LEN - off);
+            if (k <= 0) {
+                if (esp_timer_get_time() - t0 > (int64_t)ST_FLUSH_MS * 1000) break;
+                vTaskDelay(1);
+                continue;
+            }
+            off += k;
+        }
+        ns = 1;
+    } else {
+        for (int i = 0; i < ST_BURST; i++) {
+            st_msg_t *m = &w->sent[ns];
+            if (kind == ST_PC) {
+                m->b[0] = (uint8_t)(0xC0 | ((ch - 1) & 0x0F));
+                m->b[1] = (uint8_t)(i & 0x7F);
+                m->n = 2;
+                e = uart_midi_send_pc(ST_PORT_MASK, ch, m->b[1]);
+            } else {
+                m->b[0] = (uint8_t)(0xB0 | ((ch - 1) & 0x0F));
+                m->b[1] = (uint8_t)(ST_CC_FIRST + (i % ST_CC_COUNT));
+                m->b[2] = (uint8_t)(i & 0x7F);
+                m->n = 3;
+                e = (kind == ST_CC_CONT)
+                    ? uart_midi_send_cc_cont(ST_PORT_MASK, ch, m->b[1], m->b[2])
+                    : uart_midi_send_cc(ST_PORT_MASK, ch, m->b[1], m->b[2]);
+            }
+            if (e == ESP_OK) ns++;
+        }
+    }
+
+    (void)uart_midi_out_flush(ST_PORT_MASK, ST_FLUSH_MS);
+    vTaskDelay(2);   // last byte: stop bit -> rx task (well under a tick)
+
+    int64_t t_first = 0, t_last = 0;
+    int nc = uart_midi_in_capture_stop(&t_first, &t_last);
+    uart_midi_out_get_stats(ST_PORT, &s1);
+
+    r->sent = (uint16_t)ns;
+    r->coalesced = s1.coalesced - s0.coalesced;
+    r->bytes_tx = s1.bytes_sent - s0.bytes_sent;
+
+    if (kind == ST_SYSEX) {
+        int k = 0;
+        for (int i = 0; i < nc; i++) {
+            uint8_t b = w->cap[i];
+            if (b >= 0xF8) continue;
+            if (k < ST_SYSEX_LEN) r->errors += (b != w->sx[k]);
+            else r->errors++;
+            k++;
+        }
+        if (k < ST_SYSEX_LEN) r->errors += (uint32_t)(ST_SYSEX_LEN - k);
+        r->bytes_rx = (uint32_t)k;
+        r->recv = (k == ST_SYSEX_LEN && r->errors == 0) ? 1 : 0;
+    } else {
+        uint32_t stray = 0;
+        int nr = decode(w->cap, nc, w->recv, ST_CAP / 2, &r->bytes_rx, &stray);
+        r->recv = (uint16_t)nr;
+        r->errors = stray + ((kind == ST_CC_CONT) ? cmp_coal(w->sent, ns, w->recv, nr)
+                                                  : cmp_exact(w->sent, ns, w->recv, nr));
+    }
+
+    if (nc > 0 && t_last > t0) {
+        r->total_us = (uint32_t)(t_last - t0);
+        r->msgs_per_s = (uint32_t)(((uint64_t)r->recv * 1000000u) / r->total_us);
+    }
+    r->wire_us = r->bytes_rx * ST_BYTE_US;
+    return ESP_OK;
+}
+
+// one CC at a time: enqueue .. last byte read back (idle line, no queueing)
+static esp_err_t run_ping(st_work_t *w, uint8_t ch, midi_selftest_result_t *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->name = "ping";
+
+    uart_midi_out_force_running_status(ST_PORT, 0);
+    esp_err_t e = uart_midi_out_flush(ST_PORT_MASK, ST_FLUSH_MS);
+    if (e != ESP_OK) return e;
+
+    uint64_t sum = 0;
+    const uint8_t st = (uint8_t)(0xB0 | ((ch - 1) & 0x0F));
+
+    for (int i = 0; i < ST_PINGS; i++) {
+        e = uart_midi_in_capture_start(w->cap, ST_CAP);
+        if (e != ESP_OK) return e;
+
+        const int64_t t0 = esp_timer_get_time();
+        if (uart_midi_send_cc(ST_PORT_MASK, ch, ST_CC_FIRST, (uint8_t)i) != ESP_OK) {
+            (void)uart_midi_in_capture_stop(NULL, NULL);
+            continue;
+        }
+        r->sent++;
+
+        // 3 bytes ≈ 1 ms on the wire; timestamps come from the rx task, polling only waits
+        for (int t = 0; t < 5 && uart_midi_in_capture_count() < 3; t++) vTaskDelay(1);
+
+        int64_t t_last = 0;
+        int nc = uart_midi_in_capture_stop(NULL, &t_last);
+        const uint8_t want[3] = { st, ST_CC_FIRST, (uint8_t)i };
+        int k = 0;
+        for (int j = 0; j < nc; j++) {
+            if (w->cap[j] >= 0xF8) continue;
+            if (k < 3) r->errors += (w->cap[j] != want[k]);
+            else r->errors++;
+            k++;
+        }
+        if (k < 3) r->errors += (uint32_t)(3 - k);
+        r->bytes_rx += (uint32_t)k;
+        if (k >= 3) r->recv++;
+
+        if (nc > 0 && t_last > t0) {
+            uint32_t us = (uint32_t)(t_last - t0);
+            sum += us;
+            if (us > r->lat_max_us) r->lat_max_us = us;
+        }
+    }
+
+    if (r->recv) r->lat_avg_us = (uint32_t)(sum / r->recv);
+    r->bytes_tx = r->sent * 3u;
+    r->wire_us = 3u * ST_BYTE_US;
+    return ESP_OK;
+}
+
+// -------------------- task --------------------
+static void publish(const midi_selftest_result_t *r, esp_err_t err, bool finished)
+{
+    portENTER_CRITICAL(&s_mux);
+    if (r && s_st.n < MIDI_SELFTEST_MAX_RESULTS) s_st.r[s_st.n++] = *r;
+    s_st.err = err;
+    if (finished) {
+        s_st.running = false;
+        s_st.done = true;
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+static void selftest_task(void *arg)
+{
+    (void)arg;
+    const uint8_t ch = s_st.ch;
+    const bool external = s_st.external;
+    esp_err_t e = ESP_OK;
+
+    st_work_t *w = (st_work_t *)heap_caps_malloc(sizeof(st_work_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!w) w = (st_work_t *)heap_caps_malloc(sizeof(st_work_t), MALLOC_CAP_8BIT);
+    if (!w) {
+        ESP_LOGE(TAG, "no mem for work buffers");
+        publish(NULL, ESP_ERR_NO_MEM, true);
+        s_busy = false;
+        vTaskDelete(NULL);
+        return;
+    }
+
+    w->sx[0] = 0xF0;
+    w->sx[1] = 0x7D;
+    for (int i = 2; i < ST_SYSEX_LEN - 1; i++) w->sx[i] = (uint8_t)(i & 0x7F);
+    w->sx[ST_SYSEX_LEN - 1] = 0xF7;
+
+    // DIN 1 is ours for the run: the dispatcher (footswitch, scenes, thru, scheduler,
+    // clock) stops sending there, so only the pattern lands in the capture. it runs on
+    // this core at a higher priority -> its next round already sees the port gone
+    e = uart_midi_out_reserve(ST_PORT, true);
+    const bool reserved = (e == ESP_OK);
+    if (e == ESP_OK && !external) e = uart_midi_out_set_loopback(ST_PORT, true);
+
+    if (e == ESP_OK) {
+        static const struct { st_kind_t kind; bool rs; } PLAN[] = {
+            { ST_CC,      false }, { ST_CC,      true },
+            { ST_CC_CONT, false }, { ST_CC_CONT, true },
+            { ST_PC,      false }, { ST_PC,      true },
+            { ST_SYSEX,   false },
+        };
+        midi_selftest_result_t r;
+
+        for (size_t i = 0; i < sizeof(PLAN) / sizeof(PLAN[0]) && e == ESP_OK; i++) {
+            e = run_burst(w, PLAN[i].kind, PLAN[i].rs, ch, &r);
+            if (e == ESP_OK) {
+                ESP_LOGI(TAG, "%-7s rs=%d sent=%u recv=%u err=%u %u msg/s total=%uus wire=%uus",
+                         r.name, r.rs, r.sent, r.recv, (unsigned)r.errors,
+                         (unsigned)r.msgs_per_s, (unsigned)r.total_us, (unsigned)r.wire_us);
+                publish(&r, ESP_OK, false);
+            }
+        }
+        if (e == ESP_OK) {
+            e = run_ping(w, ch, &r);
+            if (e == ESP_OK) {
+                ESP_LOGI(TAG, "ping    recv=%u/%u err=%u avg=%uus max=%uus",
+                         r.recv, r.sent, (unsigned)r.errors,
+                         (unsigned)r.lat_avg_us, (unsigned)r.lat_max_us);
+                publish(&r, ESP_OK, false);
+            }
+        }
+    }
+
+    // restore: nothing of ours left in the ring, loopback off, port (and its global
+    // running status setting) back to the dispatcher
+    (void)uart_midi_out_flush(ST_PORT_MASK, ST_FLUSH_MS);
+    if (!external) (void)uart_midi_out_set_loopback(ST_PORT, false);
+    if (reserved) (void)uart_midi_out_reserve(ST_PORT, false);
+    free(w);
+
+    if (e != ESP_OK) ESP_LOGW(TAG, "stopped: %s", esp_err_to_name(e));
+    publish(NULL, e, true);
+    s_busy = false;
+    vTaskDelete(NULL);
+}
+
+// -------------------- public --------------------
+esp_err_t midi_selftest_start(bool external, uint8_t ch_1_16)
+{
+    if (ch_1_16 < 1 || ch_1_16 > 16) return ESP_ERR_INVALID_ARG;
+    if (!(uart_midi_out_ready_mask() & ST_PORT_MASK) || !uart_midi_in_ready_fast()) return ESP_ERR_INVALID_STATE;
+
+    bool taken = false;
+    portENTER_CRITICAL(&s_mux);
+    if (!s_busy) {
+        s_busy = true;
+        taken = true;
+        memset(&s_st, 0, sizeof(s_st));
+        s_st.running = true;
+        s_st.external = external;
+        s_st.ch = ch_1_16;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    if (!taken) return ESP_ERR_INVALID_STATE;
+
+    // below the dispatcher (8) and rx task (9): the test only enqueues and waits
+    if (xTaskCreatePinnedToCore(selftest_task, "midi_selftest", 4096, NULL, 4, NULL, 1) != pdPASS) {
+        publish(NULL, ESP_ERR_NO_MEM, true);
+        s_busy = false;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "start: %s loopback, ch=%u", external ? "external" : "internal", ch_1_16);
+    return ESP_OK;
+}
+
+void midi_selftest_get(midi_selftest_status_t *out)
+{
+    if (!out) return;
+    portENTER_CRITICAL(&s_mux);
+    *out = s_st;
+    portEXIT_CRITICAL(&s_mux);
+}
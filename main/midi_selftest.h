@@ -0,0 +1,48 @@
+// ===== FILE: main/midi_selftest.h =====
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// DIN OUT loopback self-test (DIN 1 TX -> DIN 1 RX).
+// patterns go through the real uart_midi_out.c path (ring, tx task, running status,
+// coalescing); uart_midi_in.c hands the bytes back raw instead of parsing/thru.
+//   internal = UART loopback inside the chip (TX -> RX, no wiring)
+//   external = MIDI cable DIN OUT 1 -> DIN IN (opto + cable included)
+// runs in its own task, a few hundred ms. DIN 1 carries only the test pattern meanwhile
+// (channel ch): the dispatcher's output skips it, DIN 2 and USB keep going as usual,
+// and running status is switched for DIN 1 alone (the portal setting is left alone).
+#define MIDI_SELFTEST_MAX_RESULTS  8
+
+typedef struct {
+    const char *name;       // "cc", "cc_cont", "pc", "sysex", "ping"
+    uint8_t  rs;            // running status on
+    uint8_t  coal;          // continuous CC (last-value-wins) path
+    uint16_t sent;          // messages enqueued
+    uint16_t recv;          // messages decoded from the loopback
+    uint32_t coalesced;     // merged in the TX ring (port stats delta)
+    uint32_t bytes_tx;      // bytes handed to the UART
+    uint32_t bytes_rx;      // bytes read back (realtime excluded)
+    uint32_t errors;        // wrong / missing / extra bytes vs. what was sent
+    uint32_t msgs_per_s;    // recv / total_us
+    uint32_t total_us;      // first enqueue .. last byte read back (last stop bit + rx wakeup)
+    uint32_t wire_us;       // bytes_rx x 320 us (line busy all the time)
+    uint32_t lat_avg_us;    // ping: enqueue .. last byte read back, one message at a time
+    uint32_t lat_max_us;
+} midi_selftest_result_t;
+
+typedef struct {
+    bool running;
+    bool done;
+    bool external;
+    uint8_t ch;
+    esp_err_t err;          // ESP_OK or why the run stopped
+    int n;
+    midi_selftest_result_t r[MIDI_SELFTEST_MAX_RESULTS];
+} midi_selftest_status_t;
+
+// start a run (ESP_ERR_INVALID_STATE = already running / DIN not ready)
+esp_err_t midi_selftest_start(bool external, uint8_t ch_1_16);
+
+// last (or current) run
+void midi_selftest_get(midi_selftest_status_t *out);
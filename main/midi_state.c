@@ -0,0 +1,132 @@
+// ===== FILE: main/midi_state.c =====
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "midi_state.h"
+#include "config_store.h"
+
+static const char *TAG = "MIDI_STATE";
+
+// one mirror per transport: 16 x 128 CC + 16 PC
+typedef struct {
+    uint8_t cc[16][128];
+    uint8_t pc[16];
+} midi_mirror_t;
+
+// ✅ heap (PSRAM first); without it nothing is tracked and nothing is suppressed
+static midi_mirror_t *s_mirror = NULL;   // [MIDI_PORT_COUNT]
+static volatile int s_suppress = 0;
+static midi_state_stats_t s_stats[MIDI_PORT_COUNT];
+
+void midi_state_init(void)
+{
+    if (s_mirror) {
+        ESP_LOGW(TAG, "already inited");
+        return;
+    }
+
+    const size_t bytes = sizeof(midi_mirror_t) * MIDI_PORT_COUNT;
+
+    s_mirror = (midi_mirror_t *)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_mirror) s_mirror = (midi_mirror_t *)heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+
+    if (!s_mirror) {
+        ESP_LOGE(TAG, "no heap for state mirror (%u bytes) -> no tracking/suppression", (unsigned)bytes);
+        return;
+    }
+
+    memset(s_mirror, MIDI_STATE_UNKNOWN, bytes);
+    memset(s_stats, 0, sizeof(s_stats));
+    s_suppress = config_store_get_midi_suppress() ? 1 : 0;
+
+    ESP_LOGI(TAG, "state mirror ready (%u bytes, suppress=%d)", (unsigned)bytes, s_suppress);
+}
+
+void midi_state_set_suppress(int enable)
+{
+    s_suppress = enable ? 1 : 0;
+    (void)config_store_set_midi_suppress((uint8_t)s_suppress);
+}
+
+int midi_state_get_suppress(void)
+{
+    return s_suppress;
+}
+
+bool midi_state_pass(midi_port_t port, uint8_t status, uint8_t d1, uint8_t d2, uint8_t flags)
+{
+    if (!s_mirror || (unsigned)port >= MIDI_PORT_COUNT) return true;
+
+    midi_mirror_t *m = &s_mirror[port];
+    const uint8_t ch = (uint8_t)(status & 0x0F);
+    uint8_t *slot;
+    uint8_t v;
+
+    switch (status & 0xF0) {
+    case 0xB0: slot = &m->cc[ch][d1 & 0x7F]; v = d2; break;
+    case 0xC0: slot = &m->pc[ch];            v = d1; break;
+    default:   return true;
+    }
+
+    if (s_suppress && !(flags & ACTION_F_ALWAYS) && *slot == v) {
+        s_stats[port].suppressed++;
+        return false;
+    }
+
+    *slot = v;
+    s_stats[port].passed++;
+    return true;
+}
+
+void midi_state_forget(midi_port_t port, uint8_t status, uint8_t d1)
+{
+    if (!s_mirror || (unsigned)port >= MIDI_PORT_COUNT) return;
+
+    midi_mirror_t *m = &s_mirror[port];
+    const uint8_t ch = (uint8_t)(status & 0x0F);
+    switch (status & 0xF0) {
+    case 0xB0: m->cc[ch][d1 & 0x7F] = MIDI_STATE_UNKNOWN; break;
+    case 0xC0: m->pc[ch] = MIDI_STATE_UNKNOWN;            break;
+    default:   break;
+    }
+}
+
+void midi_state_reset(midi_port_t port)
+{
+    if (!s_mirror || (unsigned)port >= MIDI_PORT_COUNT) return;
+    memset(&s_mirror[port], MIDI_STATE_UNKNOWN, sizeof(midi_mirror_t));
+}
+
+bool midi_state_export(midi_port_t port, uint8_t cc[16][128], uint8_t pc[16])
+{
+    if (!s_mirror || (unsigned)port >= MIDI_PORT_COUNT) return false;
+    if (cc) memcpy(cc, s_mirror[port].cc, sizeof(s_mirror[port].cc));
+    if (pc) memcpy(pc, s_mirror[port].pc, sizeof(s_mirror[port].pc));
+    return true;
+}
+
+uint8_t midi_state_get_cc(midi_port_t port, uint8_t ch_1_16, uint8_t cc)
+{
+    if (!s_mirror || (unsigned)port >= MIDI_PORT_COUNT) return MIDI_STATE_UNKNOWN;
+    if (ch_1_16 < 1 || ch_1_16 > 16) return MIDI_STATE_UNKNOWN;
+    return s_mirror[port].cc[ch_1_16 - 1][cc & 0x7F];
+}
+
+uint8_t midi_state_get_pc(midi_port_t port, uint8_t ch_1_16)
+{
+    if (!s_mirror || (unsigned)port >= MIDI_PORT_COUNT) return MIDI_STATE_UNKNOWN;
+    if (ch_1_16 < 1 || ch_1_16 > 16) return MIDI_STATE_UNKNOWN;
+    return s_mirror[port].pc[ch_1_16 - 1];
+}
+
+void midi_state_get_stats(midi_port_t port, midi_state_stats_t *out)
+{
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if ((unsigned)port >= MIDI_PORT_COUNT) return;
+    *out = s_stats[port];
+}
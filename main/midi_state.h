@@ -0,0 +1,57 @@
+// ===== FILE: main/midi_state.h =====
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// what each receiver was last sent (dispatcher task updates, anyone may read)
+// one mirror per USB device slot (usb_midi_host.h USB_MIDI_MAX_DEVS) + one per
+// DIN port (uart_midi_out.h UART_MIDI_PORTS)
+typedef enum {
+    MIDI_PORT_USB = 0,   // USB device slot 0
+    MIDI_PORT_USB1,
+    MIDI_PORT_USB2,
+    MIDI_PORT_DIN,       // DIN port 0
+    MIDI_PORT_DIN2,
+    MIDI_PORT_COUNT
+} midi_port_t;
+
+#define MIDI_PORT_USB_COUNT   (MIDI_PORT_DIN - MIDI_PORT_USB)
+#define MIDI_PORT_USB_DEV(d)  ((midi_port_t)(MIDI_PORT_USB + (d)))
+#define MIDI_PORT_IS_USB(p)   ((p) < MIDI_PORT_DIN)
+#define MIDI_PORT_DIN_COUNT   (MIDI_PORT_COUNT - MIDI_PORT_DIN)
+#define MIDI_PORT_DIN_N(n)    ((midi_port_t)(MIDI_PORT_DIN + (n)))
+
+#define MIDI_STATE_UNKNOWN 0xFF
+
+void midi_state_init(void);
+
+// suppression: drop CC/PC that would not change the receiver (unless the
+// message carries ACTION_F_ALWAYS). persisted by config_store.
+void midi_state_set_suppress(int enable);
+int  midi_state_get_suppress(void);
+
+// dispatcher: message about to go to port -> true = send it (mirror updated),
+// false = redundant and suppressed
+bool midi_state_pass(midi_port_t port, uint8_t status, uint8_t d1, uint8_t d2, uint8_t flags);
+
+// send after midi_state_pass() failed -> the receiver may not have it: that
+// CC/PC slot goes back to MIDI_STATE_UNKNOWN (the next one is never suppressed)
+void midi_state_forget(midi_port_t port, uint8_t status, uint8_t d1);
+
+// forget everything known about port (receiver reconnected / reset)
+void midi_state_reset(midi_port_t port);
+
+// whole mirror of port (false = no mirror allocated)
+bool midi_state_export(midi_port_t port, uint8_t cc[16][128], uint8_t pc[16]);
+
+// query (MIDI_STATE_UNKNOWN = never sent)
+uint8_t midi_state_get_cc(midi_port_t port, uint8_t ch_1_16, uint8_t cc);
+uint8_t midi_state_get_pc(midi_port_t port, uint8_t ch_1_16);
+
+typedef struct {
+    uint32_t passed;
+    uint32_t suppressed;
+} midi_state_stats_t;
+
+void midi_state_get_stats(midi_port_t port, midi_state_stats_t *out);
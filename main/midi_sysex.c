@@ -0,0 +1,194 @@
+// ===== FILE: main/midi_sysex.c =====
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "midi_sysex.h"
+
+static const char *TAG = "MIDI_SYSEX";
+
+#define SYSEX_PATH "/spiffs/sysex_%02d.syx"
+
+typedef struct {
+    uint8_t *data;     // heap (PSRAM first), NULL = empty
+    uint16_t len;
+} sysex_slot_t;
+
+static sysex_slot_t s_slot[MIDI_SYSEX_SLOTS];
+static uint32_t s_used = 0;
+static SemaphoreHandle_t s_lock = NULL;   // payloads are big: mutex, not a spinlock
+
+static void slot_path(int slot, char *out, size_t n)
+{
+    snprintf(out, n, SYSEX_PATH, slot);
+}
+
+static bool valid_msg(const uint8_t *d, int len)
+{
+    if (!d || len < 2 || len > MIDI_SYSEX_MAX_LEN) return false;
+    if (d[0] != 0xF0 || d[len - 1] != 0xF7) return false;
+    for (int i = 1; i < len - 1; i++) {
+        if (d[i] & 0x80) return false;
+    }
+    return true;
+}
+
+static uint8_t *alloc_payload(int len)
+{
+    uint8_t *p = (uint8_t *)heap_caps_malloc((size_t)len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p) p = (uint8_t *)heap_caps_malloc((size_t)len, MALLOC_CAP_8BIT);
+    return p;
+}
+
+// s_lock held
+static esp_err_t slot_store_locked(int slot, const uint8_t *data, int len)
+{
+    sysex_slot_t *s = &s_slot[slot];
+
+    if (s_used - s->len + (uint32_t)len > MIDI_SYSEX_POOL_MAX) return ESP_ERR_NO_MEM;
+
+    uint8_t *p = alloc_payload(len);
+    if (!p) return ESP_ERR_NO_MEM;
+    memcpy(p, data, (size_t)len);
+
+    s_used -= s->len;
+    free(s->data);
+    s->data = p;
+    s->len = (uint16_t)len;
+    s_used += (uint32_t)len;
+    return ESP_OK;
+}
+
+static esp_err_t file_write(int slot, const uint8_t *data, int len)
+{
+    char path[32];
+    slot_path(slot, path, sizeof(path));
+
+    FILE *f = fopen(path, "wb");
+    if (!f) return ESP_FAIL;
+    size_t w = fwrite(data, 1, (size_t)len, f);
+    fclose(f);
+    return (w == (size_t)len) ? ESP_OK : ESP_FAIL;
+}
+
+static void load_slot(int slot, uint8_t *tmp)
+{
+    char path[32];
+    slot_path(slot, path, sizeof(path));
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return;
+    int len = (int)fread(tmp, 1, MIDI_SYSEX_MAX_LEN + 1, f);
+    fclose(f);
+
+    if (!valid_msg(tmp, len)) {
+        ESP_LOGW(TAG, "slot %d: %s is not one complete sysex message -> ignored", slot, path);
+        return;
+    }
+    if (slot_store_locked(slot, tmp, len) != ESP_OK) {
+        ESP_LOGW(TAG, "slot %d: pool full (%u bytes used) -> not loaded", slot, (unsigned)s_used);
+    }
+}
+
+// -------------------- public --------------------
+void midi_sysex_init(void)
+{
+    if (s_lock) {
+        ESP_LOGW(TAG, "already inited");
+        return;
+    }
+
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        ESP_LOGE(TAG, "lock alloc failed -> sysex disabled");
+        return;
+    }
+
+    uint8_t *tmp = alloc_payload(MIDI_SYSEX_MAX_LEN + 1);
+    if (!tmp) {
+        ESP_LOGE(TAG, "no heap for load buffer -> saved payloads not loaded");
+        return;
+    }
+
+    int n = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MIDI_SYSEX_SLOTS; i++) {
+        load_slot(i, tmp);
+        if (s_slot[i].data) n++;
+    }
+    xSemaphoreGive(s_lock);
+    free(tmp);
+
+    ESP_LOGI(TAG, "sysex pool ready (%d/%d slots, %u/%u bytes)",
+             n, MIDI_SYSEX_SLOTS, (unsigned)s_used, (unsigned)MIDI_SYSEX_POOL_MAX);
+}
+
+esp_err_t midi_sysex_set(int slot, const uint8_t *data, int len)
+{
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    if (slot < 0 || slot >= MIDI_SYSEX_SLOTS) return ESP_ERR_INVALID_ARG;
+    if (!valid_msg(data, len)) return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t e = slot_store_locked(slot, data, len);
+    xSemaphoreGive(s_lock);
+    if (e != ESP_OK) return e;
+
+    e = file_write(slot, data, len);
+    if (e != ESP_OK) ESP_LOGW(TAG, "slot %d: save to SPIFFS failed (kept in RAM)", slot);
+
+    ESP_LOGI(TAG, "slot %d = %d bytes", slot, len);
+    return ESP_OK;
+}
+
+esp_err_t midi_sysex_delete(int slot)
+{
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    if (slot < 0 || slot >= MIDI_SYSEX_SLOTS) return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_used -= s_slot[slot].len;
+    free(s_slot[slot].data);
+    s_slot[slot].data = NULL;
+    s_slot[slot].len = 0;
+    xSemaphoreGive(s_lock);
+
+    char path[32];
+    slot_path(slot, path, sizeof(path));
+    (void)remove(path);
+    return ESP_OK;
+}
+
+int midi_sysex_len(int slot)
+{
+    if (slot < 0 || slot >= MIDI_SYSEX_SLOTS) return 0;
+    return s_slot[slot].len;
+}
+
+int midi_sysex_copy(int slot, uint8_t *out, int cap)
+{
+    if (!s_lock || !out || slot < 0 || slot >= MIDI_SYSEX_SLOTS) return 0;
+
+    int len = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const sysex_slot_t *s = &s_slot[slot];
+    if (s->data && s->len <= cap) {
+        memcpy(out, s->data, s->len);
+        len = s->len;
+    }
+    xSemaphoreGive(s_lock);
+    return len;
+}
+
+uint32_t midi_sysex_pool_used(void)
+{
+    return s_used;
+}
@@ -0,0 +1,26 @@
+// ===== FILE: main/midi_sysex.h =====
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+// SysEx payload pool: ACT_SYSEX actions point at a slot (action a = slot).
+// each slot is one complete message F0 .. F7, stored as /spiffs/sysex_NN.syx
+#define MIDI_SYSEX_SLOTS      32
+#define MIDI_SYSEX_MAX_LEN    4096           // one preset dump
+#define MIDI_SYSEX_POOL_MAX   (64 * 1024)    // all slots together
+
+// load saved payloads (needs SPIFFS mounted)
+void midi_sysex_init(void);
+
+// data must start with F0, end with F7 and carry only 7-bit bytes in between
+esp_err_t midi_sysex_set(int slot, const uint8_t *data, int len);
+esp_err_t midi_sysex_delete(int slot);
+
+// 0 = slot empty
+int midi_sysex_len(int slot);
+
+// copy slot into out (cap bytes). returns length, 0 = empty or does not fit
+int midi_sysex_copy(int slot, uint8_t *out, int cap);
+
+// bytes used by every slot together
+uint32_t midi_sysex_pool_used(void);
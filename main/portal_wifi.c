@@ -22,6 +22,17 @@
 #include "config_store.h"
 #include "footswitch.h"
 #include "expfs.h"
+#include "usb_midi_host.h"
+#include "uart_midi_out.h"
+#include "uart_midi_in.h"
+#include "midi_actions.h"
+#include "midi_out.h"
+#include "midi_sched.h"
+#include "midi_clock.h"
+#include "midi_state.h"
+#include "midi_scene.h"
+#include "midi_sysex.h"
+#include "midi_selftest.h"
 
 static const char *TAG = "PORTAL";
 static httpd_handle_t s_http = NULL;
@@ -602,7 +613,738 @@ static esp_err_t h_post_button(httpd_req_t *req)
     return ESP_OK;
 }
 
+// -------- API: MIDI output stats --------
+static void add_qstats(cJSON *parent, const char *name, midi_src_t src)
+{
+    midi_out_qstats_t q;
+    midi_out_get_qstats(src, &q);
+
+    cJSON *o = cJSON_CreateObject();
+    cJSON_AddNumberToObject(o, "enqueued",  q.enqueued);
+    cJSON_AddNumberToObject(o, "dropped",   q.dropped);
+    cJSON_AddNumberToObject(o, "depth",     q.depth);
+    cJSON_AddNumberToObject(o, "highWater", q.high_water);
+    cJSON_AddItemToObject(parent, name, o);
+}
+
+static esp_err_t h_get_midi_stats(httpd_req_t *req)
+{
+    usb_midi_stats_t us;
+    usb_midi_get_stats(&us);
+
+    // DIN: totals over every port (+ per port below)
+    uart_midi_stats_t dp[UART_MIDI_PORTS];
+    uart_midi_stats_t ds = {0};
+    for (int p = 0; p < UART_MIDI_PORTS; p++) {
+        uart_midi_out_get_stats(p, &dp[p]);
+        ds.enqueued    += dp[p].enqueued;
+        ds.bytes_sent  += dp[p].bytes_sent;
+        ds.overflow    += dp[p].overflow;
+        ds.depth       += dp[p].depth;
+        ds.bytes_saved += dp[p].bytes_saved;
+        ds.rt_bytes    += dp[p].rt_bytes;
+        ds.coalesced   += dp[p].coalesced;
+        if (dp[p].backlog_us > ds.backlog_us) ds.backlog_us = dp[p].backlog_us;
+        if (dp[p].max_depth > ds.max_depth) ds.max_depth = dp[p].max_depth;
+    }
+
+    cJSON *root = cJSON_CreateObject();
+
+    cJSON *usb = cJSON_CreateObject();
+    cJSON_AddNumberToObject(usb, "transfers",      us.transfers);
+    cJSON_AddNumberToObject(usb, "packets",        us.packets);
+    cJSON_AddNumberToObject(usb, "pktsPerXfer",    us.transfers ? (double)us.packets / (double)us.transfers : 0.0);
+    cJSON_AddNumberToObject(usb, "maxPktsPerXfer", us.max_pkts_per_xfer);
+    cJSON_AddNumberToObject(usb, "dropped",        us.dropped);
+    cJSON_AddNumberToObject(usb, "droppedFull",    us.dropped_full);
+    cJSON_AddNumberToObject(usb, "inFlight",       us.in_flight);
+    cJSON_AddNumberToObject(usb, "maxInFlight",    us.max_in_flight);
+    cJSON_AddNumberToObject(usb, "rtPackets",      us.rt_packets);
+    cJSON_AddNumberToObject(usb, "inTransfers",    us.in_transfers);
+    cJSON_AddNumberToObject(usb, "inPackets",      us.in_packets);
+    cJSON_AddNumberToObject(usb, "inDropped",      us.in_dropped);
+    cJSON_AddNumberToObject(usb, "inErrors",       us.in_errors);
+    cJSON_AddNumberToObject(usb, "inDepth",        us.in_depth);
+    cJSON_AddNumberToObject(usb, "devices",        us.devices);
+    cJSON_AddNumberToObject(usb, "descCacheHits",  us.desc_cache_hits);
+    cJSON_AddNumberToObject(usb, "descCacheMiss",  us.desc_cache_misses);
+    cJSON_AddNumberToObject(usb, "lastOpenUs",     us.last_open_us);
+    cJSON_AddNumberToObject(usb, "lastFirstTxUs",  us.last_first_tx_us);
+    cJSON_AddNumberToObject(usb, "txErrors",       us.tx_errors);
+    cJSON_AddNumberToObject(usb, "txStalls",       us.tx_stalls);
+    cJSON_AddNumberToObject(usb, "txRetries",      us.tx_retries);
+    cJSON_AddNumberToObject(usb, "txRecovered",    us.tx_recovered);
+    cJSON_AddNumberToObject(usb, "txGaveUp",       us.tx_gave_up);
+    cJSON_AddNumberToObject(usb, "inUmpSkipped",   us.in_ump_skipped);
+
+    cJSON *devs = cJSON_CreateArray();
+    for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+        usb_midi_dev_info_t di;
+        usb_midi_get_dev_info(i, &di);
+        cJSON *d = cJSON_CreateObject();
+        cJSON_AddBoolToObject(d, "ready",    di.ready);
+        cJSON_AddNumberToObject(d, "addr",   di.addr);
+        cJSON_AddNumberToObject(d, "epOut",  di.ep_out);
+        cJSON_AddNumberToObject(d, "epIn",   di.ep_in);
+        cJSON_AddNumberToObject(d, "inFlight", di.in_flight);
+        cJSON_AddNumberToObject(d, "vid",      di.vid);
+        cJSON_AddNumberToObject(d, "pid",      di.pid);
+        cJSON_AddNumberToObject(d, "bcd",      di.bcd);
+        cJSON_AddBoolToObject(d,   "cached",   di.cache_hit);
+        cJSON_AddNumberToObject(d, "openUs",   di.open_us);
+        cJSON_AddNumberToObject(d, "firstTxUs", di.first_tx_us);
+        cJSON_AddBoolToObject(d, "ump", di.ump);
+        cJSON_AddItemToArray(devs, d);
+    }
+    cJSON_AddItemToObject(usb, "dev", devs);
+    cJSON_AddItemToObject(root, "usb", usb);
+
+    cJSON *din = cJSON_CreateObject();
+    cJSON_AddNumberToObject(din, "enqueued",      ds.enqueued);
+    cJSON_AddNumberToObject(din, "bytesSent",     ds.bytes_sent);
+    cJSON_AddNumberToObject(din, "overflow",      ds.overflow);
+    cJSON_AddNumberToObject(din, "depth",         ds.depth);
+    cJSON_AddNumberToObject(din, "maxDepth",      ds.max_depth);
+    cJSON_AddNumberToObject(din, "runningStatus", uart_midi_out_get_running_status());
+    cJSON_AddNumberToObject(din, "bytesSaved",    ds.bytes_saved);
+    cJSON_AddNumberToObject(din, "rtBytes",       ds.rt_bytes);
+    cJSON_AddNumberToObject(din, "coalesced",     ds.coalesced);
+    cJSON_AddNumberToObject(din, "maxBacklogUs",  ds.backlog_us);
+    const uint8_t din_ok = uart_midi_out_ready_mask();
+    cJSON *ports = cJSON_CreateArray();
+    for (int p = 0; p < UART_MIDI_PORTS; p++) {
+        cJSON *o = cJSON_CreateObject();
+        cJSON_AddBoolToObject(o,   "ready",      (din_ok >> p) & 1);
+        cJSON_AddNumberToObject(o, "enqueued",   dp[p].enqueued);
+        cJSON_AddNumberToObject(o, "bytesSent",  dp[p].bytes_sent);
+        cJSON_AddNumberToObject(o, "overflow",   dp[p].overflow);
+        cJSON_AddNumberToObject(o, "depth",      dp[p].depth);
+        cJSON_AddNumberToObject(o, "maxDepth",   dp[p].max_depth);
+        cJSON_AddNumberToObject(o, "bytesSaved", dp[p].bytes_saved);
+        cJSON_AddNumberToObject(o, "coalesced",  dp[p].coalesced);
+        cJSON_AddNumberToObject(o, "backlogUs",  dp[p].backlog_us);
+        cJSON_AddItemToArray(ports, o);
+    }
+    cJSON_AddItemToObject(din, "ports", ports);
+    cJSON_AddItemToObject(root, "din", din);
+
+    uart_midi_in_stats_t is;
+    uart_midi_in_get_stats(&is);
+    midi_out_thru_stats_t ts;
+    midi_out_get_thru_stats(&ts);
+    cJSON *dinIn = cJSON_CreateObject();
+    cJSON_AddBoolToObject(dinIn,   "ready",        uart_midi_in_ready_fast());
+    cJSON_AddBoolToObject(dinIn,   "thru",         uart_midi_in_get_thru());
+    cJSON_AddNumberToObject(dinIn, "rxBytes",      is.rx_bytes);
+    cJSON_AddNumberToObject(dinIn, "msgs",         is.msgs);
+    cJSON_AddNumberToObject(dinIn, "rt",           is.rt);
+    cJSON_AddNumberToObject(dinIn, "sysexSkipped", is.sysex_skipped);
+    cJSON_AddNumberToObject(dinIn, "stray",        is.stray);
+    cJSON_AddNumberToObject(dinIn, "dropped",      is.dropped);
+    cJSON_AddNumberToObject(dinIn, "parseLastUs",  is.parse_last_us);
+    cJSON_AddNumberToObject(dinIn, "parseMaxUs",   is.parse_max_us);
+    // arrival .. handed to USB/UART (wire time of the outgoing bytes not included)
+    cJSON_AddNumberToObject(dinIn, "thruMsgs",     ts.msgs);
+    cJSON_AddNumberToObject(dinIn, "thruLastUs",   ts.last_us);
+    cJSON_AddNumberToObject(dinIn, "thruMaxUs",    ts.max_us);
+    cJSON_AddNumberToObject(dinIn, "thruAvgUs",    ts.avg_us);
+    cJSON_AddItemToObject(root, "dinIn", dinIn);
+
+    footswitch_input_stats_t fi;
+    footswitch_get_input_stats(&fi);
+    cJSON *footIn = cJSON_CreateObject();
+    cJSON_AddNumberToObject(footIn, "edges",     fi.edges);
+    cJSON_AddNumberToObject(footIn, "accepted",  fi.accepted);
+    cJSON_AddNumberToObject(footIn, "glitches",  fi.glitches);
+    cJSON_AddNumberToObject(footIn, "dropped",   fi.dropped);
+    // switch edge .. actions queued (dispatcher + wire time not included)
+    cJSON_AddNumberToObject(footIn, "latLastUs", fi.lat_last_us);
+    cJSON_AddNumberToObject(footIn, "latMaxUs",  fi.lat_max_us);
+    cJSON_AddItemToObject(root, "footIn", footIn);
+
+    cJSON *qs = cJSON_CreateObject();
+    add_qstats(qs, "foot",  MIDI_SRC_FOOT);
+    add_qstats(qs, "expfs", MIDI_SRC_EXPFS);
+    add_qstats(qs, "sched", MIDI_SRC_SCHED);
+    add_qstats(qs, "scene", MIDI_SRC_SCENE);
+    add_qstats(qs, "dinIn", MIDI_SRC_DIN_IN);
+    uint32_t rt_sent = 0, rt_dropped = 0;
+    midi_out_get_rtstats(&rt_sent, &rt_dropped);
+    cJSON *rt = cJSON_CreateObject();
+    cJSON_AddNumberToObject(rt, "sent",    rt_sent);
+    cJSON_AddNumberToObject(rt, "dropped", rt_dropped);
+    cJSON_AddItemToObject(qs, "rt", rt);
+    cJSON_AddItemToObject(root, "queues", qs);
+
+    midi_sched_stats_t ss;
+    midi_sched_get_stats(&ss);
+    cJSON *sc = cJSON_CreateObject();
+    cJSON_AddNumberToObject(sc, "scheduled",  ss.scheduled);
+    cJSON_AddNumberToObject(sc, "fired",      ss.fired);
+    cJSON_AddNumberToObject(sc, "cancelled",  ss.cancelled);
+    cJSON_AddNumberToObject(sc, "dropped",    ss.dropped);
+    cJSON_AddNumberToObject(sc, "pending",    ss.pending);
+    cJSON_AddNumberToObject(sc, "maxPending", ss.max_pending);
+    cJSON_AddItemToObject(root, "sched", sc);
+
+    midi_out_sysex_stats_t xs;
+    midi_out_get_sysex_stats(&xs);
+    cJSON *sx = cJSON_CreateObject();
+    cJSON_AddNumberToObject(sx, "streams",   xs.streams);
+    cJSON_AddNumberToObject(sx, "dropped",   xs.dropped);
+    cJSON_AddNumberToObject(sx, "aborted",   xs.aborted);
+    cJSON_AddNumberToObject(sx, "bytes",     xs.bytes);
+    cJSON_AddBoolToObject(sx,   "active",    xs.active);
+    cJSON_AddNumberToObject(sx, "lastLen",   xs.last_len);
+    cJSON_AddNumberToObject(sx, "lastUsbUs", xs.last_usb_us);
+    cJSON_AddNumberToObject(sx, "lastDinUs", xs.last_din_us);
+    // bytes/s of the last stream per transport (0 = not sent there)
+    cJSON_AddNumberToObject(sx, "usbBps", xs.last_usb_us ? (double)xs.last_len * 1e6 / xs.last_usb_us : 0);
+    cJSON_AddNumberToObject(sx, "dinBps", xs.last_din_us ? (double)xs.last_len * 1e6 / xs.last_din_us : 0);
+    cJSON_AddNumberToObject(sx, "poolUsed", midi_sysex_pool_used());
+    cJSON_AddItemToObject(root, "sysex", sx);
+
+    char *out = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!out) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, out);
+    free(out);
+    return ESP_OK;
+}
+
 // ---- helper: register with log ----
+// -------- API: MIDI clock --------
+static esp_err_t send_clock_json(httpd_req_t *req)
+{
+    midi_clock_stats_t cs;
+    midi_clock_get_stats(&cs);
+
+    char out[320];
+    snprintf(out, sizeof(out),
+             "{\"bpm\":%.1f,\"running\":%s,\"periodUs\":%u,\"ticks\":%u,"
+             "\"jitter\":{\"samples\":%u,\"lastUs\":%u,\"minUs\":%u,\"maxUs\":%u,"
+             "\"avgUs\":%u,\"maxDevUs\":%u,\"isrDropped\":%u}}",
+             (double)cs.bpm, cs.running ? "true" : "false", (unsigned)cs.period_us, (unsigned)cs.ticks,
+             (unsigned)cs.samples, (unsigned)cs.last_us, (unsigned)cs.min_us, (unsigned)cs.max_us,
+             (unsigned)cs.avg_jitter_us, (unsigned)cs.max_jitter_us, (unsigned)cs.isr_dropped);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, out);
+    return ESP_OK;
+}
+
+static esp_err_t h_get_clock(httpd_req_t *req)
+{
+    return send_clock_json(req);
+}
+
+// body: {"bpm":120.0} and/or {"cmd":"start"|"stop"|"continue"|"reset_stats"}
+static esp_err_t h_post_clock(httpd_req_t *req)
+{
+    int total = req->content_len;
+    if (total <= 0 || total > 256) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad body");
+        return ESP_FAIL;
+    }
+
+    char buf[257];
+    int got = 0;
+    while (got < total) {
+        int r = httpd_req_recv(req, buf + got, total - got);
+        if (r <= 0) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "recv fail");
+            return ESP_FAIL;
+        }
+        got += r;
+    }
+    buf[total] = 0;
+
+    cJSON *root = cJSON_Parse(buf);
+    if (!root) { httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad json"); return ESP_FAIL; }
+
+    cJSON *jb = cJSON_GetObjectItem(root, "bpm");
+    cJSON *jc = cJSON_GetObjectItem(root, "cmd");
+
+    if (cJSON_IsNumber(jb)) (void)midi_clock_set_bpm((float)jb->valuedouble);
+
+    if (cJSON_IsString(jc)) {
+        if (strcmp(jc->valuestring, "start") == 0)            (void)midi_clock_start();
+        else if (strcmp(jc->valuestring, "stop") == 0)        (void)midi_clock_stop();
+        else if (strcmp(jc->valuestring, "continue") == 0)    (void)midi_clock_continue();
+        else if (strcmp(jc->valuestring, "reset_stats") == 0) midi_clock_reset_stats();
+    }
+
+    cJSON_Delete(root);
+    return send_clock_json(req);
+}
+
+// -------- API: MIDI state mirror --------
+// GET ?port=usb|usb1|usb2|din|din2&ch=1..16 -> last CC values (-1 = never sent) + last PC of that channel
+static esp_err_t h_get_midi_state(httpd_req_t *req)
+{
+    char q[64];
+    char tmp[8] = "usb";
+    if (httpd_req_get_url_query_str(req, q, sizeof(q)) == ESP_OK) {
+        (void)httpd_query_key_value(q, "port", tmp, sizeof(tmp));
+    }
+    midi_port_t port = MIDI_PORT_USB;
+    if (strcmp(tmp, "din") == 0) port = MIDI_PORT_DIN;
+    else if (strcmp(tmp, "din2") == 0) port = MIDI_PORT_DIN2;
+    else if (strcmp(tmp, "usb1") == 0) port = MIDI_PORT_USB1;
+    else if (strcmp(tmp, "usb2") == 0) port = MIDI_PORT_USB2;
+    int ch = clampi_local(parse_q_int(req, "ch", 1), 1, 16);
+
+    cJSON *root = cJSON_CreateObject();
+    if (!root) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+        return ESP_FAIL;
+    }
+
+    cJSON_AddBoolToObject(root, "suppress", midi_state_get_suppress());
+    cJSON_AddBoolToObject(root, "resync", config_store_get_usb_resync());
+    cJSON_AddBoolToObject(root, "ump", config_store_get_usb_ump());
+    cJSON_AddBoolToObject(root, "dinThru", config_store_get_din_thru());
+    static const char *const port_names[MIDI_PORT_COUNT] = { "usb", "usb1", "usb2", "din", "din2" };
+    cJSON_AddStringToObject(root, "port", port_names[port]);
+    cJSON_AddNumberToObject(root, "ch", ch);
+
+    cJSON *cc = cJSON_CreateArray();
+    for (int i = 0; i < 128; i++) {
+        uint8_t v = midi_state_get_cc(port, (uint8_t)ch, (uint8_t)i);
+        cJSON_AddItemToArray(cc, cJSON_CreateNumber((v == MIDI_STATE_UNKNOWN) ? -1 : v));
+    }
+    cJSON_AddItemToObject(root, "cc", cc);
+
+    uint8_t pc = midi_state_get_pc(port, (uint8_t)ch);
+    cJSON_AddNumberToObject(root, "pc", (pc == MIDI_STATE_UNKNOWN) ? -1 : pc);
+
+    midi_state_stats_t st;
+    midi_state_get_stats(port, &st);
+    cJSON_AddNumberToObject(root, "passed",     st.passed);
+    cJSON_AddNumberToObject(root, "suppressed", st.suppressed);
+
+    midi_resync_stats_t rs;
+    midi_actions_get_resync_stats(&rs);
+    cJSON *jrs = cJSON_CreateObject();
+    cJSON_AddNumberToObject(jrs, "bursts",   rs.bursts);
+    cJSON_AddNumberToObject(jrs, "msgs",     rs.msgs);
+    cJSON_AddNumberToObject(jrs, "lastMsgs", rs.last_msgs);
+    cJSON_AddNumberToObject(jrs, "lastDev",  rs.last_dev);
+    cJSON_AddNumberToObject(jrs, "capped",   rs.capped);
+    cJSON_AddItemToObject(root, "resyncStats", jrs);
+
+    char *out = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!out) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, out);
+    free(out);
+    return ESP_OK;
+}
+
+// POST {"suppress":true|false}, {"resync":true|false}, {"ump":true|false},
+//      {"dinThru":true|false} and/or {"reset":"usb"|"din"|"all"}
+static esp_err_t h_post_midi_state(httpd_req_t *req)
+{
+    int total = req->content_len;
+    if (total <= 0 || total > 256) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad body");
+        return ESP_FAIL;
+    }
+
+    char buf[257];
+    int got = 0;
+    while (got < total) {
+        int r = httpd_req_recv(req, buf + got, total - got);
+        if (r <= 0) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "recv fail");
+            return ESP_FAIL;
+        }
+        got += r;
+    }
+    buf[total] = 0;
+
+    cJSON *root = cJSON_Parse(buf);
+    if (!root) { httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad json"); return ESP_FAIL; }
+
+    cJSON *js = cJSON_GetObjectItem(root, "suppress");
+    cJSON *jr = cJSON_GetObjectItem(root, "reset");
+    cJSON *jy = cJSON_GetObjectItem(root, "resync");
+    cJSON *ju = cJSON_GetObjectItem(root, "ump");
+    cJSON *jt = cJSON_GetObjectItem(root, "dinThru");
+
+    if (cJSON_IsBool(js)) midi_state_set_suppress(cJSON_IsTrue(js));
+    if (cJSON_IsBool(jy)) (void)config_store_set_usb_resync(cJSON_IsTrue(jy) ? 1 : 0);
+    if (cJSON_IsBool(ju)) {
+        // takes effect on the next attach (alt setting is chosen at open)
+        (void)config_store_set_usb_ump(cJSON_IsTrue(ju) ? 1 : 0);
+        usb_midi_set_ump(cJSON_IsTrue(ju));
+    }
+    if (cJSON_IsBool(jt)) {
+        (void)config_store_set_din_thru(cJSON_IsTrue(jt) ? 1 : 0);
+        uart_midi_in_set_thru(cJSON_IsTrue(jt));
+    }
+
+    if (cJSON_IsString(jr)) {
+        if (strcmp(jr->valuestring, "usb") == 0 || strcmp(jr->valuestring, "all") == 0) {
+            for (int d = 0; d < MIDI_PORT_USB_COUNT; d++) midi_state_reset(MIDI_PORT_USB_DEV(d));
+        }
+        if (strcmp(jr->valuestring, "din") == 0 || strcmp(jr->valuestring, "all") == 0) {
+            for (int p = 0; p < MIDI_PORT_DIN_COUNT; p++) midi_state_reset(MIDI_PORT_DIN_N(p));
+        }
+    }
+
+    cJSON_Delete(root);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"ok\":true}");
+    return ESP_OK;
+}
+
+// GET /api/scene -> saved slots + last recall
+static esp_err_t h_get_scene(httpd_req_t *req)
+{
+    midi_scene_stats_t st;
+    midi_scene_get_stats(&st);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON *arr = cJSON_CreateArray();
+    for (int i = 0; i < MIDI_SCENE_COUNT; i++) {
+        cJSON_AddItemToArray(arr, cJSON_CreateBool(midi_scene_exists(i)));
+    }
+    cJSON_AddItemToObject(root, "saved", arr);
+
+    cJSON *last = cJSON_CreateObject();
+    cJSON_AddNumberToObject(last, "idx",     st.last_idx);
+    cJSON_AddNumberToObject(last, "usb",     st.last_usb_msgs);
+    cJSON_AddNumberToObject(last, "din",     st.last_din_msgs);
+    cJSON_AddNumberToObject(last, "skipped", st.last_skipped);
+    cJSON_AddNumberToObject(last, "ms",      st.last_ms);
+    cJSON_AddItemToObject(root, "last", last);
+
+    cJSON_AddNumberToObject(root, "recalls", st.recalls);
+    cJSON_AddNumberToObject(root, "saves",   st.saves);
+
+    char *out = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!out) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, out);
+    free(out);
+    return ESP_OK;
+}
+
+// POST {"save":i} | {"recall":i} | {"delete":i}  (queued, scene task does the work)
+static esp_err_t h_post_scene(httpd_req_t *req)
+{
+    int total = req->content_len;
+    if (total <= 0 || total > 128) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad body");
+        return ESP_FAIL;
+    }
+
+    char buf[129];
+    int got = 0;
+    while (got < total) {
+        int r = httpd_req_recv(req, buf + got, total - got);
+        if (r <= 0) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "recv fail");
+            return ESP_FAIL;
+        }
+        got += r;
+    }
+    buf[total] = 0;
+
+    cJSON *root = cJSON_Parse(buf);
+    if (!root) { httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad json"); return ESP_FAIL; }
+
+    cJSON *jsv = cJSON_GetObjectItem(root, "save");
+    cJSON *jrc = cJSON_GetObjectItem(root, "recall");
+    cJSON *jdl = cJSON_GetObjectItem(root, "delete");
+
+    esp_err_t e = ESP_ERR_INVALID_ARG;
+    if (cJSON_IsNumber(jsv))      e = midi_scene_save(jsv->valueint);
+    else if (cJSON_IsNumber(jrc)) e = midi_scene_recall(jrc->valueint);
+    else if (cJSON_IsNumber(jdl)) e = midi_scene_delete(jdl->valueint);
+
+    cJSON_Delete(root);
+
+    if (e != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(e));
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"ok\":true}");
+    return ESP_OK;
+}
+
+// GET /api/sysex -> slot lengths | ?slot=n -> {"slot":n,"hex":"F0..F7"}
+static esp_err_t h_get_sysex(httpd_req_t *req)
+{
+    if (!s_buf) return resp_503(req, "buffer not ready");
+
+    int slot = -1;
+    char q[32], tmp[8];
+    if (httpd_req_get_url_query_str(req, q, sizeof(q)) == ESP_OK) {
+        if (httpd_query_key_value(q, "slot", tmp, sizeof(tmp)) == ESP_OK) slot = atoi(tmp);
+    }
+
+    if (slot < 0) {
+        cJSON *root = cJSON_CreateObject();
+        cJSON *arr = cJSON_CreateArray();
+        for (int i = 0; i < MIDI_SYSEX_SLOTS; i++) {
+            cJSON_AddItemToArray(arr, cJSON_CreateNumber(midi_sysex_len(i)));
+        }
+        cJSON_AddItemToObject(root, "len", arr);
+        cJSON_AddNumberToObject(root, "maxLen",  MIDI_SYSEX_MAX_LEN);
+        cJSON_AddNumberToObject(root, "poolMax", MIDI_SYSEX_POOL_MAX);
+        cJSON_AddNumberToObject(root, "poolUsed", midi_sysex_pool_used());
+
+        char *out = cJSON_PrintUnformatted(root);
+        cJSON_Delete(root);
+        if (!out) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+            return ESP_FAIL;
+        }
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, out);
+        free(out);
+        return ESP_OK;
+    }
+
+    if (slot >= MIDI_SYSEX_SLOTS) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad slot");
+        return ESP_FAIL;
+    }
+
+    int len = midi_sysex_len(slot);
+    // {"slot":NN,"hex":"..."} -> 2 chars per byte + ~24
+    if (len * 2 + 32 > BUF_MAX) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "too big for buffer");
+        return ESP_FAIL;
+    }
+
+    uint8_t *data = heap_caps_malloc(len ? len : 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!data) data = malloc(len ? len : 1);
+    if (!data) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+        return ESP_FAIL;
+    }
+    len = midi_sysex_copy(slot, data, len);
+
+    if (s_buf_lock) xSemaphoreTake(s_buf_lock, portMAX_DELAY);
+    int n = snprintf(s_buf, BUF_MAX, "{\"slot\":%d,\"hex\":\"", slot);
+    static const char hx[] = "0123456789ABCDEF";
+    for (int i = 0; i < len; i++) {
+        s_buf[n++] = hx[data[i] >> 4];
+        s_buf[n++] = hx[data[i] & 0x0F];
+    }
+    s_buf[n++] = '"';
+    s_buf[n++] = '}';
+    s_buf[n] = 0;
+    free(data);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, s_buf, n);
+    if (s_buf_lock) xSemaphoreGive(s_buf_lock);
+    return ESP_OK;
+}
+
+static int hex_nib(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// POST {"slot":n,"hex":"F0 41 .. F7"} (spaces ok) | {"delete":n}
+static esp_err_t h_post_sysex(httpd_req_t *req)
+{
+    if (!s_buf) return resp_503(req, "buffer not ready");
+
+    int total = req->content_len;
+    if (total <= 0 || total > BUF_MAX) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad body");
+        return ESP_FAIL;
+    }
+
+    if (s_buf_lock) xSemaphoreTake(s_buf_lock, portMAX_DELAY);
+
+    int got = 0;
+    while (got < total) {
+        int r = httpd_req_recv(req, s_buf + got, total - got);
+        if (r <= 0) {
+            if (s_buf_lock) xSemaphoreGive(s_buf_lock);
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "recv fail");
+            return ESP_FAIL;
+        }
+        got += r;
+    }
+    s_buf[total] = 0;
+
+    cJSON *root = cJSON_Parse(s_buf);
+    if (s_buf_lock) xSemaphoreGive(s_buf_lock);
+    if (!root) { httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad json"); return ESP_FAIL; }
+
+    cJSON *jdl = cJSON_GetObjectItem(root, "delete");
+    cJSON *jsl = cJSON_GetObjectItem(root, "slot");
+    cJSON *jhx = cJSON_GetObjectItem(root, "hex");
+
+    esp_err_t e = ESP_ERR_INVALID_ARG;
+    if (cJSON_IsNumber(jdl)) {
+        e = midi_sysex_delete(jdl->valueint);
+    } else if (cJSON_IsNumber(jsl) && cJSON_IsString(jhx)) {
+        const char *h = jhx->valuestring;
+        uint8_t *data = heap_caps_malloc(MIDI_SYSEX_MAX_LEN, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!data) data = malloc(MIDI_SYSEX_MAX_LEN);
+        if (!data) {
+            e = ESP_ERR_NO_MEM;
+        } else {
+            int len = 0;
+            int hi = -1;
+            bool bad = false;
+            for (; *h; h++) {
+                if (*h == ' ' || *h == ',' || *h == '\n' || *h == '\r' || *h == '\t') continue;
+                int v = hex_nib(*h);
+                if (v < 0 || len >= MIDI_SYSEX_MAX_LEN) { bad = true; break; }
+                if (hi < 0) { hi = v; continue; }
+                data[len++] = (uint8_t)((hi << 4) | v);
+                hi = -1;
+            }
+            if (!bad && hi < 0) e = midi_sysex_set(jsl->valueint, data, len);
+            free(data);
+        }
+    }
+
+    cJSON_Delete(root);
+
+    if (e != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(e));
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"ok\":true}");
+    return ESP_OK;
+}
+
+// GET /api/selftest -> last / current DIN loopback run
+static esp_err_t h_get_selftest(httpd_req_t *req)
+{
+    midi_selftest_status_t st;
+    midi_selftest_get(&st);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "running", st.running);
+    cJSON_AddBoolToObject(root, "done", st.done);
+    cJSON_AddStringToObject(root, "loop", st.external ? "external" : "internal");
+    cJSON_AddNumberToObject(root, "ch", st.ch);
+    if (st.err != ESP_OK) cJSON_AddStringToObject(root, "err", esp_err_to_name(st.err));
+
+    cJSON *arr = cJSON_CreateArray();
+    for (int i = 0; i < st.n; i++) {
+        const midi_selftest_result_t *r = &st.r[i];
+        cJSON *o = cJSON_CreateObject();
+        cJSON_AddStringToObject(o, "test",      r->name ? r->name : "?");
+        cJSON_AddBoolToObject(o,   "rs",        r->rs);
+        cJSON_AddBoolToObject(o,   "coal",      r->coal);
+        cJSON_AddNumberToObject(o, "sent",      r->sent);
+        cJSON_AddNumberToObject(o, "recv",      r->recv);
+        cJSON_AddNumberToObject(o, "coalesced", r->coalesced);
+        cJSON_AddNumberToObject(o, "bytesTx",   r->bytes_tx);
+        cJSON_AddNumberToObject(o, "bytesRx",   r->bytes_rx);
+        cJSON_AddNumberToObject(o, "errors",    r->errors);
+        cJSON_AddNumberToObject(o, "msgsPerS",  r->msgs_per_s);
+        cJSON_AddNumberToObject(o, "totalUs",   r->total_us);
+        cJSON_AddNumberToObject(o, "wireUs",    r->wire_us);
+        if (r->lat_max_us) {
+            cJSON_AddNumberToObject(o, "latAvgUs", r->lat_avg_us);
+            cJSON_AddNumberToObject(o, "latMaxUs", r->lat_max_us);
+        }
+        cJSON_AddItemToArray(arr, o);
+    }
+    cJSON_AddItemToObject(root, "results", arr);
+
+    char *out = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!out) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, out);
+    free(out);
+    return ESP_OK;
+}
+
+// POST {"loop":"internal"|"external","ch":1..16}  (both optional: internal, ch 16)
+// starts a run in the background; poll GET for the results
+static esp_err_t h_post_selftest(httpd_req_t *req)
+{
+    int total = req->content_len;
+    if (total < 0 || total > 128) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad body");
+        return ESP_FAIL;
+    }
+
+    bool external = false;
+    int ch = 16;
+
+    if (total > 0) {
+        char buf[129];
+        int got = 0;
+        while (got < total) {
+            int r = httpd_req_recv(req, buf + got, total - got);
+            if (r <= 0) {
+                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "recv fail");
+                return ESP_FAIL;
+            }
+            got += r;
+        }
+        buf[total] = 0;
+
+        cJSON *root = cJSON_Parse(buf);
+        if (!root) { httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad json"); return ESP_FAIL; }
+
+        cJSON *jl = cJSON_GetObjectItem(root, "loop");
+        cJSON *jc = cJSON_GetObjectItem(root, "ch");
+        if (cJSON_IsString(jl) && jl->valuestring) external = (strcmp(jl->valuestring, "external") == 0);
+        if (cJSON_IsNumber(jc)) ch = jc->valueint;
+        cJSON_Delete(root);
+    }
+
+    if (ch < 1 || ch > 16) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad ch");
+        return ESP_FAIL;
+    }
+
+    esp_err_t e = midi_selftest_start(external, (uint8_t)ch);
+    if (e != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(e));
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"ok\":true}");
+    return ESP_OK;
+}
+
 static void reg_uri(httpd_handle_t h, const httpd_uri_t *u, const char *name)
 {
     esp_err_t e = httpd_register_uri_handler(h, u);
@@ -623,7 +1365,7 @@ static void start_http_server(void)
     }
 
     httpd_config_t cfg = HTTPD_DEFAULT_CONFIG();
-    cfg.max_uri_handlers = 32;
+    cfg.max_uri_handlers = 40;
     cfg.max_open_sockets = 4;
     cfg.stack_size = 8192;
     cfg.lru_purge_enable = true;
@@ -664,6 +1406,23 @@ static void start_http_server(void)
     httpd_uri_t u_expfs_p = { .uri="/api/expfs", .method=HTTP_POST, .handler=h_post_expfs };
     httpd_uri_t u_expfs_cal = { .uri="/api/expfs_cal", .method=HTTP_POST, .handler=h_post_expfs_cal };
 
+    httpd_uri_t u_mstats = { .uri="/api/midi_stats", .method=HTTP_GET, .handler=h_get_midi_stats };
+
+    httpd_uri_t u_clock_g = { .uri="/api/clock", .method=HTTP_GET,  .handler=h_get_clock };
+    httpd_uri_t u_clock_p = { .uri="/api/clock", .method=HTTP_POST, .handler=h_post_clock };
+
+    httpd_uri_t u_mstate_g = { .uri="/api/midi_state", .method=HTTP_GET,  .handler=h_get_midi_state };
+    httpd_uri_t u_mstate_p = { .uri="/api/midi_state", .method=HTTP_POST, .handler=h_post_midi_state };
+
+    httpd_uri_t u_scene_g = { .uri="/api/scene", .method=HTTP_GET,  .handler=h_get_scene };
+    httpd_uri_t u_scene_p = { .uri="/api/scene", .method=HTTP_POST, .handler=h_post_scene };
+
+    httpd_uri_t u_sysex_g = { .uri="/api/sysex", .method=HTTP_GET,  .handler=h_get_sysex };
+    httpd_uri_t u_sysex_p = { .uri="/api/sysex", .method=HTTP_POST, .handler=h_post_sysex };
+
+    httpd_uri_t u_stest_g = { .uri="/api/selftest", .method=HTTP_GET,  .handler=h_get_selftest };
+    httpd_uri_t u_stest_p = { .uri="/api/selftest", .method=HTTP_POST, .handler=h_post_selftest };
+
     reg_uri(s_http, &u_root,  "root");
     reg_uri(s_http, &u_js,    "js");
     reg_uri(s_http, &u_css,   "css");
@@ -693,6 +1452,23 @@ static void start_http_server(void)
     reg_uri(s_http, &u_expfs_p, "expfs_post");
     reg_uri(s_http, &u_expfs_cal, "expfs_cal");
 
+    reg_uri(s_http, &u_mstats, "midi_stats");
+
+    reg_uri(s_http, &u_clock_g, "clock_get");
+    reg_uri(s_http, &u_clock_p, "clock_post");
+
+    reg_uri(s_http, &u_mstate_g, "midi_state_get");
+    reg_uri(s_http, &u_mstate_p, "midi_state_post");
+
+    reg_uri(s_http, &u_scene_g, "scene_get");
+    reg_uri(s_http, &u_scene_p, "scene_post");
+
+    reg_uri(s_http, &u_sysex_g, "sysex_get");
+    reg_uri(s_http, &u_sysex_p, "sysex_post");
+
+    reg_uri(s_http, &u_stest_g, "selftest_get");
+    reg_uri(s_http, &u_stest_p, "selftest_post");
+
     ESP_LOGI(TAG, "HTTP server started");
 }
 
@@ -0,0 +1,264 @@
+// ===== FILE: main/uart_midi_in.c =====
+#include <string.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+
+#include "uart_midi_in.h"
+#include "uart_midi_out.h"
+#include "midi_out.h"
+#include "midi_clock.h"
+
+static const char *TAG = "UART_MIDI_IN";
+
+// ---- config ----
+// UART เดียวกับ uart_midi_out.c (driver + RX pin ตั้งที่นั่น), ที่นี่อ่านฝั่ง RX อย่างเดียว
+#define UART_MIDI_IN_PORT      UART_NUM_1
+#define UART_MIDI_IN_READ_MAX  32     // bytes per read (whatever is buffered after the first one)
+
+// ISR hands bytes to the driver buffer after every byte (default = 120 bytes or
+// ~10 symbol times idle ≈ 3 ms @31250) -> the task sees each byte ~320 us after its start bit
+#define UART_MIDI_IN_RXFULL    1
+#define UART_MIDI_IN_RXTOUT    1
+
+static int s_inited = 0;
+static volatile int s_thru = 1;
+static uart_midi_in_stats_t s_stats;
+
+// self-test capture (raw bytes instead of the parser)
+static portMUX_TYPE s_cap_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t *s_cap_buf = NULL;
+static int      s_cap_cap = 0;
+static int      s_cap_n = 0;
+static int64_t  s_cap_first_us = 0;
+static int64_t  s_cap_last_us = 0;
+
+// -------------------- parser --------------------
+// running status, realtime anywhere (even inside a message), sysex skipped until
+// the next status byte. one instance, rx task only.
+typedef struct {
+    uint8_t status;    // current status (0 = none / waiting for one)
+    uint8_t running;   // 1 = channel status, reused for following data bytes
+    uint8_t need;      // data bytes for status
+    uint8_t n;         // data bytes collected
+    uint8_t d[2];
+    uint8_t sysex;     // inside F0 .. F7
+} midi_parser_t;
+
+static midi_parser_t s_p;
+
+static int data_len(uint8_t st)
+{
+    if (st < 0xF0) {
+        uint8_t hi = (uint8_t)(st & 0xF0);
+        return (hi == 0xC0 || hi == 0xD0) ? 1 : 2;
+    }
+    switch (st) {
+    case 0xF1: case 0xF3: return 1;   // MTC quarter frame, song select
+    case 0xF2:            return 2;   // song position
+    case 0xF6:            return 0;   // tune request
+    default:              return -1;  // F4/F5 undefined, F0/F7 handled by the caller
+    }
+}
+
+static void emit(const uint8_t *b, int n, uint32_t t_us)
+{
+    s_stats.msgs++;
+    if (!s_thru) return;
+    if (midi_out_thru(MIDI_SRC_DIN_IN, b, n, t_us) != ESP_OK) s_stats.dropped++;
+}
+
+// one byte in; returns true when something was queued for the dispatcher
+static bool parse_byte(midi_parser_t *p, uint8_t b, uint32_t t_us)
+{
+    if (b >= 0xF8) {
+        // realtime: priority lane, does not touch the message being collected.
+        // our own clock running -> its clock/transport wins (two masters = double tempo)
+        s_stats.rt++;
+        if (!s_thru) return false;
+        if (b <= 0xFC && b != 0xF9 && midi_clock_running()) return false;
+        if (midi_out_rt(b) != ESP_OK) s_stats.dropped++;
+        return false;
+    }
+
+    if (b & 0x80) {
+        if (p->sysex) {
+            p->sysex = 0;
+            s_stats.sysex_skipped++;
+        }
+        p->status = 0;
+        p->running = 0;
+        p->n = 0;
+
+        if (b == 0xF0) { p->sysex = 1; return false; }
+        if (b == 0xF7) return false;   // stray end (start was missed)
+
+        int need = data_len(b);
+        if (need < 0) return false;
+        if (need == 0) {
+            emit(&b, 1, t_us);
+            return true;
+        }
+        p->status = b;
+        p->running = (b < 0xF0);
+        p->need = (uint8_t)need;
+        return false;
+    }
+
+    // data byte
+    if (p->sysex) return false;
+    if (!p->status) { s_stats.stray++; return false; }
+
+    p->d[p->n++] = b;
+    if (p->n < p->need) return false;
+
+    uint8_t msg[3] = { p->status, p->d[0], p->d[1] };
+    emit(msg, 1 + p->need, t_us);
+
+    p->n = 0;
+    if (!p->running) p->status = 0;   // system common: no running status
+    return true;
+}
+
+// capture active -> bytes stored, parser skipped
+static bool capture_take(const uint8_t *b, int n, int64_t t_us)
+{
+    bool on;
+    portENTER_CRITICAL(&s_cap_mux);
+    on = (s_cap_buf != NULL);
+    if (on) {
+        int k = s_cap_cap - s_cap_n;
+        if (k > n) k = n;
+        if (k > 0) memcpy(&s_cap_buf[s_cap_n], b, (size_t)k);
+        if (s_cap_n == 0) s_cap_first_us = t_us;
+        s_cap_n += k;
+        s_cap_last_us = t_us;
+    }
+    portEXIT_CRITICAL(&s_cap_mux);
+    return on;
+}
+
+static void uart_midi_in_task(void *arg)
+{
+    (void)arg;
+    uint8_t buf[UART_MIDI_IN_READ_MAX];
+
+    while (1) {
+        // first byte wakes us, then take whatever else is already buffered
+        int n = uart_read_bytes(UART_MIDI_IN_PORT, buf, 1, portMAX_DELAY);
+        if (n <= 0) continue;
+
+        const int64_t t0 = esp_timer_get_time();
+        size_t more = 0;
+        if (uart_get_buffered_data_len(UART_MIDI_IN_PORT, &more) == ESP_OK && more > 0) {
+            if (more > sizeof(buf) - 1) more = sizeof(buf) - 1;
+            int m = uart_read_bytes(UART_MIDI_IN_PORT, &buf[1], (uint32_t)more, 0);
+            if (m > 0) n += m;
+        }
+        s_stats.rx_bytes += (uint32_t)n;
+        if (capture_take(buf, n, t0)) {
+            memset(&s_p, 0, sizeof(s_p));   // resync on the first status after the capture
+            continue;
+        }
+
+        bool queued = false;
+        for (int i = 0; i < n; i++) {
+            if (parse_byte(&s_p, buf[i], (uint32_t)t0)) queued = true;
+        }
+
+        if (queued) {
+            midi_out_commit(MIDI_SRC_DIN_IN);
+            uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+            s_stats.parse_last_us = us;
+            if (us > s_stats.parse_max_us) s_stats.parse_max_us = us;
+        }
+    }
+}
+
+// -------------------- public --------------------
+void uart_midi_in_init(void)
+{
+    if (s_inited) {
+        ESP_LOGW(TAG, "already inited");
+        return;
+    }
+    if (!uart_midi_out_ready_fast()) {
+        ESP_LOGE(TAG, "uart not ready (uart_midi_out_init first)");
+        return;
+    }
+
+    (void)uart_set_rx_full_threshold(UART_MIDI_IN_PORT, UART_MIDI_IN_RXFULL);
+    (void)uart_set_rx_timeout(UART_MIDI_IN_PORT, UART_MIDI_IN_RXTOUT);
+    (void)uart_flush_input(UART_MIDI_IN_PORT);
+
+    memset(&s_p, 0, sizeof(s_p));
+    memset(&s_stats, 0, sizeof(s_stats));
+
+    // above the dispatcher (8): parse + queue is short, the dispatcher sends right after
+    if (xTaskCreatePinnedToCore(uart_midi_in_task, "uart_midi_in", 3072, NULL, 9, NULL, 1) != pdPASS) {
+        ESP_LOGE(TAG, "rx task create failed");
+        return;
+    }
+
+    s_inited = 1;
+    ESP_LOGI(TAG, "UART MIDI IN ready: port=%d thru=%d", (int)UART_MIDI_IN_PORT, s_thru);
+}
+
+int uart_midi_in_ready_fast(void)
+{
+    return s_inited;
+}
+
+void uart_midi_in_set_thru(int enable)
+{
+    s_thru = enable ? 1 : 0;
+}
+
+int uart_midi_in_get_thru(void)
+{
+    return s_thru;
+}
+
+void uart_midi_in_get_stats(uart_midi_in_stats_t *out)
+{
+    if (!out) return;
+    *out = s_stats;
+}
+
+esp_err_t uart_midi_in_capture_start(uint8_t *buf, int cap)
+{
+    if (!s_inited) return ESP_ERR_INVALID_STATE;
+    if (!buf || cap <= 0) return ESP_ERR_INVALID_ARG;
+
+    (void)uart_flush_input(UART_MIDI_IN_PORT);
+    portENTER_CRITICAL(&s_cap_mux);
+    s_cap_buf = buf;
+    s_cap_cap = cap;
+    s_cap_n = 0;
+    s_cap_first_us = 0;
+    s_cap_last_us = 0;
+    portEXIT_CRITICAL(&s_cap_mux);
+    return ESP_OK;
+}
+
+int uart_midi_in_capture_count(void)
+{
+    return s_cap_n;
+}
+
+int uart_midi_in_capture_stop(int64_t *first_us, int64_t *last_us)
+{
+    int n;
+    portENTER_CRITICAL(&s_cap_mux);
+    s_cap_buf = NULL;
+    n = s_cap_n;
+    if (first_us) *first_us = s_cap_first_us;
+    if (last_us)  *last_us = s_cap_last_us;
+    portEXIT_CRITICAL(&s_cap_mux);
+    return n;
+}
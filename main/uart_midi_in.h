@@ -0,0 +1,36 @@
+// ===== FILE: main/uart_midi_in.h =====
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+// DIN MIDI IN (RX side of the UART used by uart_midi_out.c, 31250 8N1).
+// byte parser (running status, realtime anywhere, sysex skipped) ->
+// incoming messages are merged into midi_out (MIDI_SRC_DIN_IN) = thru to DIN OUT + USB.
+// call after uart_midi_out_init() and midi_out_init()
+void uart_midi_in_init(void);
+
+int uart_midi_in_ready_fast(void);
+
+// thru on/off (runtime; parser keeps running so stats stay live)
+void uart_midi_in_set_thru(int enable);
+int  uart_midi_in_get_thru(void);
+
+typedef struct {
+    uint32_t rx_bytes;       // bytes read from the UART
+    uint32_t msgs;           // complete channel / system common messages
+    uint32_t rt;             // realtime bytes (passed straight to the realtime lane)
+    uint32_t sysex_skipped;  // sysex messages not passed thru
+    uint32_t stray;          // data bytes without a status (line noise / cable plugged mid-message)
+    uint32_t dropped;        // thru queue full
+    uint32_t parse_last_us;  // read returned .. message queued
+    uint32_t parse_max_us;
+} uart_midi_in_stats_t;
+
+void uart_midi_in_get_stats(uart_midi_in_stats_t *out);
+
+// self-test capture (midi_selftest.c): while active, raw bytes go into buf (up to
+// cap) instead of the parser and thru. stop returns the byte count and when the
+// first / last read returned (esp_timer us)
+esp_err_t uart_midi_in_capture_start(uint8_t *buf, int cap);
+int  uart_midi_in_capture_count(void);
+int  uart_midi_in_capture_stop(int64_t *first_us, int64_t *last_us);
@@ -1,10 +1,12 @@
 // ===== FILE: main/uart_midi_out.c =====
 #include <string.h>
+#include <stdio.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/uart.h"
 #include "driver/gpio.h"
 
@@ -13,27 +15,368 @@
 static const char *TAG = "UART_MIDI";
 
 // ---- config ----
-// ใช้ UART1 เพื่อเลี่ยงชนกับ USB-serial (U0TXD/U0RXD)
-#define UART_MIDI_PORT      UART_NUM_1
+// UART0 = USB-serial / display (display_uart.c) -> DIN ports ใช้ UART1, UART2
 #define UART_MIDI_BAUD      31250
 
-// แนะนำ: GPIO17 = U1TXD
-#define UART_MIDI_TX_GPIO   17
-#define UART_MIDI_RX_GPIO   (-1)   // not used
-#define UART_MIDI_RTS_GPIO  (-1)
-#define UART_MIDI_CTS_GPIO  (-1)
+typedef struct {
+    uart_port_t uart;
+    int tx_gpio;
+    int rx_gpio;    // -1 = TX only
+} uart_midi_hw_t;
 
-static int s_inited = 0;
+// เพิ่มพอร์ตได้ตรงนี้ (+ UART_MIDI_PORTS ใน header)
+static const uart_midi_hw_t HW[UART_MIDI_PORTS] = {
+    { UART_NUM_1, 17, 18 },   // DIN 1: GPIO17 = U1TXD, GPIO18 = DIN MIDI IN (opto output, uart_midi_in.c)
+    { UART_NUM_2, 21, -1 },   // DIN 2: GPIO21 = U2TXD
+};
+
+// ---- non-blocking TX ----
+// 1 = send_* แค่ใส่ข้อความลง ring แล้ว return ทันที, tx task (หนึ่งตัวต่อพอร์ต) เป็นคนเขียนออกสาย
+// 0 = แบบเดิม (uart_write_bytes + uart_wait_tx_done ใน task ผู้เรียก)
+#define UART_MIDI_NONBLOCKING   1
+#define UART_MIDI_TX_RING       256    // messages per port (power of 2)
+#define UART_MIDI_TX_CHUNK      3      // bytes handed to the driver per write (= one message)
+#define UART_MIDI_RT_RING       32     // realtime priority lane per port (bytes, power of 2)
+
+// ---- last-value-wins (continuous CC) ----
+// ค่าใหม่ของ CC เดิม (port, ch, cc) ที่ยังรอคิวอยู่ -> ทับค่าเก่าในที่เดิม แทนการต่อคิว
+// ลิงก์ 31250 baud ส่งได้ ~1000 msg/s: คิวยาวเมื่อไหร่ ค่าที่รอก็ถูกอัปเดตแทนที่จะล้าหลัง
+#define UART_MIDI_COAL_SLOTS    8      // continuous controllers tracked per port
+#define UART_MIDI_BYTE_US       320    // one byte on the wire (10 bits @31250)
+
+// ---- running status ----
+// CC/PC ซ้ำ channel เดิม -> ตัด status byte ทิ้ง (ประหยัด 320us/byte @31250)
+// ส่ง status ใหม่ทุก UART_MIDI_RS_REFRESH_MS เผื่อ receiver เพิ่งเสียบสาย
+#define UART_MIDI_RUNNING_STATUS   1
+#define UART_MIDI_RS_REFRESH_MS    200
+
+typedef struct {
+    uint8_t n;      // 1..3
+    uint8_t raw;    // 1 = sysex bytes (written as-is, no running status)
+    uint8_t coal;   // 1 = continuous CC: a newer value may overwrite b[2] while queued
+    uint8_t b[3];
+} uart_midi_msg_t;
+
+// where the last continuous CC for (status, cc) sits in the ring
+typedef struct {
+    uint8_t status;   // 0 = free
+    uint8_t cc;
+    uint32_t pos;     // ring index (free-running)
+} coal_slot_t;
+
+// one per DIN port: own ring, realtime lane, tx task and running status,
+// so a busy port never delays another
+typedef struct {
+    int inited;
+    uart_port_t uart;
+
+    uart_midi_msg_t ring[UART_MIDI_TX_RING];
+    uint32_t head;      // producer index (free-running)
+    uint32_t tail;      // consumer index (free-running)
+    portMUX_TYPE mux;
+    TaskHandle_t tx_task;
+
+    // realtime lane: always written before the next queued message
+    uint8_t  rt[UART_MIDI_RT_RING];
+    uint32_t rt_head;
+    uint32_t rt_tail;
+
+    coal_slot_t coal[UART_MIDI_COAL_SLOTS];
+    uint8_t coal_next;   // round-robin victim
+
+    uart_midi_stats_t stats;
+
+    uint8_t rs_status;   // last status on the wire (0 = none)
+    int64_t rs_sent_us;  // when that status byte was last sent
+    volatile uint8_t rs_mode;   // RS_MODE_* (self-test override)
+
+    uint32_t gen;        // +1 when the port comes back from the self-test (receivers got its pattern)
+} din_port_t;
+
+#define RS_MODE_GLOBAL  0   // follow uart_midi_out_set_running_status()
+#define RS_MODE_OFF     1
+#define RS_MODE_ON      2
+
+static din_port_t s_port[UART_MIDI_PORTS];
+static uint8_t s_ready_mask = 0;
+static volatile uint8_t s_reserved = 0;   // ports held by the self-test: hidden from ready_mask
+
+static volatile int s_rs_enabled = UART_MIDI_RUNNING_STATUS;
+
+// encode one message for the wire (running status applied). returns bytes written to out.
+static int rs_encode(din_port_t *p, const uint8_t *b, int n, uint8_t *out)
+{
+    uint8_t st = b[0];
+
+    // realtime does not touch running status (it only ever lands between messages)
+    if (st >= 0xF8) {
+        memcpy(out, b, (size_t)n);
+        return n;
+    }
+
+    // system common / sysex -> force a fresh status next time
+    if (st >= 0xF0) {
+        p->rs_status = 0;
+        memcpy(out, b, (size_t)n);
+        return n;
+    }
+
+    uint8_t hi = (uint8_t)(st & 0xF0);
+    int64_t now = esp_timer_get_time();
+
+    const bool rs_on = (p->rs_mode == RS_MODE_GLOBAL) ? (s_rs_enabled != 0) : (p->rs_mode == RS_MODE_ON);
+    if (rs_on &&
+        (hi == 0xB0 || hi == 0xC0) &&
+        st == p->rs_status &&
+        (now - p->rs_sent_us) < (int64_t)UART_MIDI_RS_REFRESH_MS * 1000)
+    {
+        memcpy(out, &b[1], (size_t)(n - 1));
+        p->stats.bytes_saved++;
+        return n - 1;
+    }
+
+    p->rs_status = st;
+    p->rs_sent_us = now;
+    memcpy(out, b, (size_t)n);
+    return n;
+}
 
 static inline uint8_t clamp7(int v)  { if (v < 0) return 0; if (v > 127) return 127; return (uint8_t)v; }
 static inline uint8_t clampCh(int v) { if (v < 1) return 1; if (v > 16) return 16; return (uint8_t)v; }
 
-void uart_midi_out_init(void)
+// length of a complete message from its status byte (channel voice / system common / realtime)
+static inline int msg_len(uint8_t st)
 {
-    if (s_inited) {
-        ESP_LOGW(TAG, "already inited");
-        return;
+    if (st >= 0xF8 || st == 0xF6) return 1;
+    if (st == 0xF2) return 3;
+    if (st >= 0xF0) return 2;   // F1, F3
+    uint8_t hi = (uint8_t)(st & 0xF0);
+    return (hi == 0xC0 || hi == 0xD0) ? 2 : 3;
+}
+
+// -------------------- tx ring --------------------
+#if UART_MIDI_NONBLOCKING
+static bool ring_pop_bytes(din_port_t *p, uint8_t *out, int cap, int *out_n)
+{
+    int n = 0;
+
+    portENTER_CRITICAL(&p->mux);
+    while (p->tail != p->head) {
+        const uart_midi_msg_t *m = &p->ring[p->tail & (UART_MIDI_TX_RING - 1)];
+        if (n + m->n > cap) break;
+        if (m->raw) {
+            // sysex on the wire -> the receiver forgets running status
+            p->rs_status = 0;
+            memcpy(&out[n], m->b, m->n);
+            n += m->n;
+        } else {
+            n += rs_encode(p, m->b, m->n, &out[n]);
+        }
+        p->tail++;
+    }
+    portEXIT_CRITICAL(&p->mux);
+
+    *out_n = n;
+    return n > 0;
+}
+
+static int rt_pop_bytes(din_port_t *p, uint8_t *out, int cap)
+{
+    int n = 0;
+
+    portENTER_CRITICAL(&p->mux);
+    while (p->rt_tail != p->rt_head && n < cap) {
+        out[n++] = p->rt[p->rt_tail & (UART_MIDI_RT_RING - 1)];
+        p->rt_tail++;
+    }
+    portEXIT_CRITICAL(&p->mux);
+
+    return n;
+}
+
+static void uart_midi_tx_task(void *arg)
+{
+    din_port_t *p = (din_port_t *)arg;
+    uint8_t buf[UART_MIDI_RT_RING + UART_MIDI_TX_CHUNK];
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (1) {
+            // pending realtime bytes first, then at most one queued message
+            int n = rt_pop_bytes(p, buf, UART_MIDI_RT_RING);
+            int m = 0;
+            (void)ring_pop_bytes(p, &buf[n], UART_MIDI_TX_CHUNK, &m);
+            n += m;
+            if (n == 0) break;
+
+            // TX buffer = 0 -> copies into the HW FIFO, blocks only this task
+            int w = uart_write_bytes(p->uart, (const char *)buf, n);
+            if (w > 0) p->stats.bytes_sent += (uint32_t)w;
+
+            // keep the FIFO shallow so a realtime byte never waits behind
+            // more than one message (~1 ms @31250)
+            (void)uart_wait_tx_done(p->uart, pdMS_TO_TICKS(20));
+        }
+    }
+}
+
+// continuous CC still waiting for the wire? -> new value in place (mux held)
+static bool coal_replace(din_port_t *p, const uint8_t *b)
+{
+    for (int i = 0; i < UART_MIDI_COAL_SLOTS; i++) {
+        coal_slot_t *c = &p->coal[i];
+        if (c->status != b[0] || c->cc != b[1]) continue;
+        if ((c->pos - p->tail) >= (p->head - p->tail)) return false;   // already sent
+
+        uart_midi_msg_t *m = &p->ring[c->pos & (UART_MIDI_TX_RING - 1)];
+        if (!m->coal || m->b[0] != b[0] || m->b[1] != b[1]) return false;
+        m->b[2] = b[2];
+        return true;
+    }
+    return false;
+}
+
+static void coal_note(din_port_t *p, const uint8_t *b, uint32_t pos)
+{
+    coal_slot_t *victim = NULL;
+    for (int i = 0; i < UART_MIDI_COAL_SLOTS; i++) {
+        coal_slot_t *c = &p->coal[i];
+        if (c->status == b[0] && c->cc == b[1]) { victim = c; break; }
+        if (!victim && c->status == 0) victim = c;
+    }
+    if (!victim) {
+        victim = &p->coal[p->coal_next];
+        p->coal_next = (uint8_t)((p->coal_next + 1) % UART_MIDI_COAL_SLOTS);
+    }
+    victim->status = b[0];
+    victim->cc = b[1];
+    victim->pos = pos;
+}
+
+static esp_err_t ring_push(din_port_t *p, const uint8_t *b, int n, bool coal)
+{
+    portENTER_CRITICAL(&p->mux);
+    if (coal && coal_replace(p, b)) {
+        portEXIT_CRITICAL(&p->mux);
+        p->stats.coalesced++;
+        return ESP_OK;
+    }
+
+    uint32_t depth = p->head - p->tail;
+    if (depth >= UART_MIDI_TX_RING) {
+        portEXIT_CRITICAL(&p->mux);
+        p->stats.overflow++;
+        return ESP_ERR_NO_MEM;
+    }
+
+    uart_midi_msg_t *m = &p->ring[p->head & (UART_MIDI_TX_RING - 1)];
+    m->n = (uint8_t)n;
+    m->raw = 0;
+    m->coal = coal ? 1 : 0;
+    memcpy(m->b, b, (size_t)n);
+    if (coal) coal_note(p, b, p->head);
+    p->head++;
+    depth++;
+    portEXIT_CRITICAL(&p->mux);
+
+    p->stats.enqueued++;
+    if (depth > p->stats.max_depth) p->stats.max_depth = depth;
+
+    if (p->tx_task) xTaskNotifyGive(p->tx_task);
+    return ESP_OK;
+}
+
+// whole pre-built stream in one critical section (one copy, one wake-up)
+static esp_err_t ring_push_stream(din_port_t *p, const uint8_t *b, int n)
+{
+    uint32_t pushed = 0;
+    uint32_t lost = 0;
+    uint32_t depth;
+
+    portENTER_CRITICAL(&p->mux);
+    int i = 0;
+    while (i < n) {
+        int len = msg_len(b[i]);
+        if (i + len > n) break;
+
+        if ((p->head - p->tail) >= UART_MIDI_TX_RING) {
+            lost++;
+        } else {
+            uart_midi_msg_t *m = &p->ring[p->head & (UART_MIDI_TX_RING - 1)];
+            m->n = (uint8_t)len;
+            m->raw = 0;
+            m->coal = 0;
+            memcpy(m->b, &b[i], (size_t)len);
+            p->head++;
+            pushed++;
+        }
+        i += len;
+    }
+    depth = p->head - p->tail;
+    portEXIT_CRITICAL(&p->mux);
+
+    p->stats.enqueued += pushed;
+    p->stats.overflow += lost;
+    if (depth > p->stats.max_depth) p->stats.max_depth = depth;
+
+    if (pushed && p->tx_task) xTaskNotifyGive(p->tx_task);
+    return lost ? ESP_ERR_NO_MEM : ESP_OK;
+}
+
+// sysex: as many 3-byte entries as the ring has room for (never drops, never waits)
+static int ring_push_raw(din_port_t *p, const uint8_t *b, int n)
+{
+    int i = 0;
+    uint32_t depth;
+
+    portENTER_CRITICAL(&p->mux);
+    while (i < n && (p->head - p->tail) < UART_MIDI_TX_RING) {
+        int len = (n - i > 3) ? 3 : (n - i);
+        uart_midi_msg_t *m = &p->ring[p->head & (UART_MIDI_TX_RING - 1)];
+        m->n = (uint8_t)len;
+        m->raw = 1;
+        m->coal = 0;
+        memcpy(m->b, &b[i], (size_t)len);
+        p->head++;
+        i += len;
     }
+    depth = p->head - p->tail;
+    portEXIT_CRITICAL(&p->mux);
+
+    p->stats.sysex_bytes += (uint32_t)i;
+    if (depth > p->stats.max_depth) p->stats.max_depth = depth;
+
+    if (i && p->tx_task) xTaskNotifyGive(p->tx_task);
+    return i;
+}
+
+static esp_err_t rt_push(din_port_t *p, uint8_t b)
+{
+    portENTER_CRITICAL(&p->mux);
+    if ((p->rt_head - p->rt_tail) >= UART_MIDI_RT_RING) {
+        portEXIT_CRITICAL(&p->mux);
+        p->stats.overflow++;
+        return ESP_ERR_NO_MEM;
+    }
+    p->rt[p->rt_head & (UART_MIDI_RT_RING - 1)] = b;
+    p->rt_head++;
+    portEXIT_CRITICAL(&p->mux);
+
+    p->stats.rt_bytes++;
+    if (p->tx_task) xTaskNotifyGive(p->tx_task);
+    return ESP_OK;
+}
+#endif
+
+static bool port_init(int i)
+{
+    din_port_t *p = &s_port[i];
+    const uart_midi_hw_t *hw = &HW[i];
+
+    memset(p, 0, sizeof(*p));
+    p->uart = hw->uart;
+    portMUX_INITIALIZE(&p->mux);
 
     uart_config_t cfg = {
         .baud_rate = UART_MIDI_BAUD,
@@ -44,54 +387,251 @@ void uart_midi_out_init(void)
         .source_clk = UART_SCLK_DEFAULT,
     };
 
-    esp_err_t e = uart_param_config(UART_MIDI_PORT, &cfg);
+    esp_err_t e = uart_param_config(hw->uart, &cfg);
     if (e != ESP_OK) {
-        ESP_LOGE(TAG, "uart_param_config failed: %s", esp_err_to_name(e));
-        return;
+        ESP_LOGE(TAG, "DIN %d: uart_param_config failed: %s", i + 1, esp_err_to_name(e));
+        return false;
     }
 
-    e = uart_set_pin(UART_MIDI_PORT,
-                     UART_MIDI_TX_GPIO,
-                     UART_MIDI_RX_GPIO,
-                     UART_MIDI_RTS_GPIO,
-                     UART_MIDI_CTS_GPIO);
+    e = uart_set_pin(hw->uart, hw->tx_gpio, hw->rx_gpio, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
     if (e != ESP_OK) {
-        ESP_LOGE(TAG, "uart_set_pin failed: %s", esp_err_to_name(e));
-        return;
+        ESP_LOGE(TAG, "DIN %d: uart_set_pin failed: %s", i + 1, esp_err_to_name(e));
+        return false;
     }
 
-    // ✅ แม้จะ TX อย่างเดียว ก็ใส่ RX buffer > 0 กัน ESP_ERR_INVALID_ARG
+    // opto output is open collector -> keep the line idle-high without the board pull-up
+    if (hw->rx_gpio >= 0) (void)gpio_set_pull_mode((gpio_num_t)hw->rx_gpio, GPIO_PULLUP_ONLY);
+
+    // ✅ แม้จะ TX อย่างเดียว ก็ใส่ RX buffer > 0 กัน ESP_ERR_INVALID_ARG (DIN 1: DIN IN ใช้ด้วย)
     // TX buffer = 0 => uart_write_bytes จะส่งแบบ blocking ได้
-    e = uart_driver_install(UART_MIDI_PORT, 256, 0, 0, NULL, 0);
+    e = uart_driver_install(hw->uart, 256, 0, 0, NULL, 0);
     if (e != ESP_OK && e != ESP_ERR_INVALID_STATE) {
-        ESP_LOGE(TAG, "uart_driver_install failed: %s", esp_err_to_name(e));
+        ESP_LOGE(TAG, "DIN %d: uart_driver_install failed: %s", i + 1, esp_err_to_name(e));
+        return false;
+    }
+
+#if UART_MIDI_NONBLOCKING
+    char name[16];
+    snprintf(name, sizeof(name), "uart_midi_tx%d", i);
+    if (xTaskCreatePinnedToCore(uart_midi_tx_task, name, 3072, p, 7, &p->tx_task, 1) != pdPASS) {
+        ESP_LOGE(TAG, "DIN %d: tx task create failed", i + 1);
+        p->tx_task = NULL;
+        return false;
+    }
+#endif
+
+    p->inited = 1;
+    ESP_LOGI(TAG, "DIN %d ready: uart=%d tx=GPIO%d rx=GPIO%d", i + 1, (int)hw->uart, hw->tx_gpio, hw->rx_gpio);
+    return true;
+}
+
+void uart_midi_out_init(void)
+{
+    if (s_ready_mask) {
+        ESP_LOGW(TAG, "already inited");
         return;
     }
 
-    s_inited = 1;
-    ESP_LOGI(TAG, "UART MIDI OUT ready: port=%d tx=GPIO%d baud=%d",
-             (int)UART_MIDI_PORT, UART_MIDI_TX_GPIO, UART_MIDI_BAUD);
+    uint8_t mask = 0;
+    for (int i = 0; i < UART_MIDI_PORTS; i++) {
+        if (port_init(i)) mask |= (uint8_t)(1u << i);
+    }
+    s_ready_mask = mask;
+
+    ESP_LOGI(TAG, "UART MIDI OUT ready: ports=0x%02x baud=%d nonblocking=%d",
+             mask, UART_MIDI_BAUD, UART_MIDI_NONBLOCKING);
 }
 
 int uart_midi_out_ready_fast(void)
 {
-    return s_inited;
+    return (s_ready_mask & (uint8_t)~s_reserved) != 0;
 }
 
-static esp_err_t uart_midi_send_bytes(const uint8_t *b, int n)
+uint8_t uart_midi_out_ready_mask(void)
 {
-    if (!s_inited) return ESP_ERR_INVALID_STATE;
-    if (!b || n <= 0) return ESP_ERR_INVALID_ARG;
+    return (uint8_t)(s_ready_mask & ~s_reserved);
+}
+
+#if !UART_MIDI_NONBLOCKING
+static esp_err_t write_now(din_port_t *p, const uint8_t *b, int n)
+{
+    uint8_t wire[3];
+    n = rs_encode(p, b, n, wire);
 
-    int w = uart_write_bytes(UART_MIDI_PORT, (const char *)b, n);
+    int w = uart_write_bytes(p->uart, (const char *)wire, n);
     if (w != n) return ESP_FAIL;
+    p->stats.enqueued++;
+    p->stats.bytes_sent += (uint32_t)w;
 
     // ไม่จำเป็นต้องรอ TX done ก็ได้ แต่ใส่ไว้ให้ชัวร์
-    (void)uart_wait_tx_done(UART_MIDI_PORT, pdMS_TO_TICKS(20));
+    (void)uart_wait_tx_done(p->uart, pdMS_TO_TICKS(20));
+    return ESP_OK;
+}
+#endif
+
+// every ready port in ports gets a copy; the first error is returned
+static esp_err_t uart_midi_send_bytes(uint8_t ports, const uint8_t *b, int n, bool coal)
+{
+    if (!b || n <= 0 || n > 3) return ESP_ERR_INVALID_ARG;
+    ports &= s_ready_mask;
+    if (!ports) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i < UART_MIDI_PORTS; i++) {
+        if (!(ports & (1u << i))) continue;
+#if UART_MIDI_NONBLOCKING
+        esp_err_t e = ring_push(&s_port[i], b, n, coal);
+#else
+        (void)coal;
+        esp_err_t e = write_now(&s_port[i], b, n);
+#endif
+        if (e != ESP_OK && ret == ESP_OK) ret = e;
+    }
+    return ret;
+}
+
+esp_err_t uart_midi_send_stream(uint8_t ports, const uint8_t *b, int n)
+{
+    if (!b || n <= 0) return ESP_ERR_INVALID_ARG;
+    ports &= s_ready_mask;
+    if (!ports) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i < UART_MIDI_PORTS; i++) {
+        if (!(ports & (1u << i))) continue;
+#if UART_MIDI_NONBLOCKING
+        esp_err_t e = ring_push_stream(&s_port[i], b, n);
+#else
+        esp_err_t e = ESP_OK;
+        int k = 0;
+        while (k < n) {
+            int len = msg_len(b[k]);
+            if (k + len > n) break;
+            e = write_now(&s_port[i], &b[k], len);
+            k += len;
+        }
+#endif
+        if (e != ESP_OK && ret == ESP_OK) ret = e;
+    }
+    return ret;
+}
+
+int uart_midi_send_sysex_chunk(int port, const uint8_t *b, int n)
+{
+    if ((unsigned)port >= UART_MIDI_PORTS || !(s_ready_mask & (1u << port)) || !b || n <= 0) return 0;
+    din_port_t *p = &s_port[port];
+
+#if UART_MIDI_NONBLOCKING
+    return ring_push_raw(p, b, n);
+#else
+    int w = uart_write_bytes(p->uart, (const char *)b, n);
+    if (w <= 0) return 0;
+    p->rs_status = 0;
+    p->stats.bytes_sent += (uint32_t)w;
+    p->stats.sysex_bytes += (uint32_t)w;
+    return w;
+#endif
+}
+
+int uart_midi_out_tx_idle(uint8_t ports)
+{
+    for (int i = 0; i < UART_MIDI_PORTS; i++) {
+        if (!(ports & (1u << i))) continue;
+        const din_port_t *p = &s_port[i];
+        if (p->tail != p->head || p->rt_tail != p->rt_head) return 0;
+    }
+    return 1;
+}
+
+esp_err_t uart_midi_out_flush(uint8_t ports, uint32_t timeout_ms)
+{
+    ports &= s_ready_mask;
+    if (!ports) return ESP_ERR_INVALID_STATE;
+
+    TickType_t t0 = xTaskGetTickCount();
+    TickType_t limit = pdMS_TO_TICKS(timeout_ms);
+
+    // wait until the tx tasks have drained both lanes into the FIFOs
+    while (!uart_midi_out_tx_idle(ports)) {
+        if ((xTaskGetTickCount() - t0) >= limit) return ESP_ERR_TIMEOUT;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    for (int i = 0; i < UART_MIDI_PORTS; i++) {
+        if (!(ports & (1u << i))) continue;
+        TickType_t used = xTaskGetTickCount() - t0;
+        esp_err_t e = uart_wait_tx_done(s_port[i].uart, (used < limit) ? (limit - used) : 0);
+        if (e != ESP_OK) return e;
+    }
+    return ESP_OK;
+}
+
+void uart_midi_out_set_running_status(int enable)
+{
+    s_rs_enabled = enable ? 1 : 0;
+}
+
+int uart_midi_out_get_running_status(void)
+{
+    return s_rs_enabled;
+}
+
+esp_err_t uart_midi_out_reserve(int port, bool on)
+{
+    if ((unsigned)port >= UART_MIDI_PORTS || !(s_ready_mask & (1u << port))) return ESP_ERR_INVALID_STATE;
+    din_port_t *p = &s_port[port];
+    const uint8_t bit = (uint8_t)(1u << port);
+
+    if (on) {
+        if (s_reserved & bit) return ESP_ERR_INVALID_STATE;
+        s_reserved |= bit;
+        return ESP_OK;
+    }
+    if (!(s_reserved & bit)) return ESP_OK;
+    p->rs_mode = RS_MODE_GLOBAL;
+    __atomic_add_fetch(&p->gen, 1, __ATOMIC_RELEASE);
+    s_reserved &= (uint8_t)~bit;
     return ESP_OK;
 }
 
-esp_err_t uart_midi_send_cc(uint8_t ch_1_16, uint8_t cc, uint8_t val)
+void uart_midi_out_force_running_status(int port, int enable)
+{
+    if ((unsigned)port >= UART_MIDI_PORTS) return;
+    s_port[port].rs_mode = (enable < 0) ? RS_MODE_GLOBAL : enable ? RS_MODE_ON : RS_MODE_OFF;
+}
+
+uint32_t uart_midi_out_port_gen(int port)
+{
+    if ((unsigned)port >= UART_MIDI_PORTS) return 0;
+    return __atomic_load_n(&s_port[port].gen, __ATOMIC_ACQUIRE);
+}
+
+esp_err_t uart_midi_out_set_loopback(int port, bool enable)
+{
+    if ((unsigned)port >= UART_MIDI_PORTS || !(s_ready_mask & (1u << port))) return ESP_ERR_INVALID_STATE;
+    return uart_set_loop_back(s_port[port].uart, enable);
+}
+
+void uart_midi_out_get_stats(int port, uart_midi_stats_t *out)
+{
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if ((unsigned)port >= UART_MIDI_PORTS) return;
+
+    din_port_t *p = &s_port[port];
+    *out = p->stats;
+
+    // wire time of what is still queued (before running status savings)
+    uint32_t bytes = 0;
+    portENTER_CRITICAL(&p->mux);
+    out->depth = p->head - p->tail;
+    for (uint32_t i = p->tail; i != p->head; i++) bytes += p->ring[i & (UART_MIDI_TX_RING - 1)].n;
+    bytes += p->rt_head - p->rt_tail;
+    portEXIT_CRITICAL(&p->mux);
+    out->backlog_us = bytes * UART_MIDI_BYTE_US;
+}
+
+esp_err_t uart_midi_send_cc(uint8_t ports, uint8_t ch_1_16, uint8_t cc, uint8_t val)
 {
     ch_1_16 = clampCh(ch_1_16);
     uint8_t pkt[3] = {
@@ -99,20 +639,31 @@ esp_err_t uart_midi_send_cc(uint8_t ch_1_16, uint8_t cc, uint8_t val)
         (uint8_t)(clamp7(cc) & 0x7F),
         (uint8_t)(clamp7(val) & 0x7F),
     };
-    return uart_midi_send_bytes(pkt, 3);
+    return uart_midi_send_bytes(ports, pkt, 3, false);
 }
 
-esp_err_t uart_midi_send_pc(uint8_t ch_1_16, uint8_t pc)
+esp_err_t uart_midi_send_cc_cont(uint8_t ports, uint8_t ch_1_16, uint8_t cc, uint8_t val)
+{
+    ch_1_16 = clampCh(ch_1_16);
+    uint8_t pkt[3] = {
+        (uint8_t)(0xB0 | ((ch_1_16 - 1) & 0x0F)),
+        (uint8_t)(clamp7(cc) & 0x7F),
+        (uint8_t)(clamp7(val) & 0x7F),
+    };
+    return uart_midi_send_bytes(ports, pkt, 3, true);
+}
+
+esp_err_t uart_midi_send_pc(uint8_t ports, uint8_t ch_1_16, uint8_t pc)
 {
     ch_1_16 = clampCh(ch_1_16);
     uint8_t pkt[2] = {
         (uint8_t)(0xC0 | ((ch_1_16 - 1) & 0x0F)),
         (uint8_t)(clamp7(pc) & 0x7F),
     };
-    return uart_midi_send_bytes(pkt, 2);
+    return uart_midi_send_bytes(ports, pkt, 2, false);
 }
 
-esp_err_t uart_midi_send_note_on(uint8_t ch_1_16, uint8_t note, uint8_t vel)
+esp_err_t uart_midi_send_note_on(uint8_t ports, uint8_t ch_1_16, uint8_t note, uint8_t vel)
 {
     ch_1_16 = clampCh(ch_1_16);
     uint8_t pkt[3] = {
@@ -120,10 +671,10 @@ esp_err_t uart_midi_send_note_on(uint8_t ch_1_16, uint8_t note, uint8_t vel)
         (uint8_t)(clamp7(note) & 0x7F),
         (uint8_t)(clamp7(vel) & 0x7F),
     };
-    return uart_midi_send_bytes(pkt, 3);
+    return uart_midi_send_bytes(ports, pkt, 3, false);
 }
 
-esp_err_t uart_midi_send_note_off(uint8_t ch_1_16, uint8_t note, uint8_t vel)
+esp_err_t uart_midi_send_note_off(uint8_t ports, uint8_t ch_1_16, uint8_t note, uint8_t vel)
 {
     ch_1_16 = clampCh(ch_1_16);
     uint8_t pkt[3] = {
@@ -131,11 +682,25 @@ esp_err_t uart_midi_send_note_off(uint8_t ch_1_16, uint8_t note, uint8_t vel)
         (uint8_t)(clamp7(note) & 0x7F),
         (uint8_t)(clamp7(vel) & 0x7F),
     };
-    return uart_midi_send_bytes(pkt, 3);
+    return uart_midi_send_bytes(ports, pkt, 3, false);
 }
 
-esp_err_t uart_midi_send_rt(uint8_t rt_byte)
+// realtime: priority lane, goes out before any queued channel message
+esp_err_t uart_midi_send_rt(uint8_t ports, uint8_t rt_byte)
 {
+#if UART_MIDI_NONBLOCKING
+    ports &= s_ready_mask;
+    if (!ports) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i < UART_MIDI_PORTS; i++) {
+        if (!(ports & (1u << i))) continue;
+        esp_err_t e = rt_push(&s_port[i], rt_byte);
+        if (e != ESP_OK && ret == ESP_OK) ret = e;
+    }
+    return ret;
+#else
     uint8_t b = rt_byte;
-    return uart_midi_send_bytes(&b, 1);
+    return uart_midi_send_bytes(ports, &b, 1, false);
+#endif
 }
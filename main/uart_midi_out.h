@@ -1,17 +1,75 @@
 // ===== FILE: main/uart_midi_out.h =====
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 
-// init UART MIDI OUT (31250 8N1)
+// DIN OUT ports (31250 8N1), each on its own UART with its own TX ring + task,
+// so one busy port never eats another's bandwidth. port table in uart_midi_out.c
+#define UART_MIDI_PORTS     2
+#define UART_MIDI_PORT_ALL  ((uint8_t)((1u << UART_MIDI_PORTS) - 1))
+
+// init every DIN port (a port that fails stays out of the ready mask)
 void uart_midi_out_init(void);
 
-// quick ready check
+// quick ready check (any port) / bit per ready port
 int uart_midi_out_ready_fast(void);
+uint8_t uart_midi_out_ready_mask(void);
+
+// sending helpers: ports = bit per DIN port, every ready one gets a copy
+esp_err_t uart_midi_send_cc(uint8_t ports, uint8_t ch_1_16, uint8_t cc, uint8_t val);
+// continuous controller (expression): last value wins. if this CC (same port,
+// channel, number) is still queued, its value is replaced in place instead of
+// queueing another message. plain uart_midi_send_cc() is never merged or dropped
+esp_err_t uart_midi_send_cc_cont(uint8_t ports, uint8_t ch_1_16, uint8_t cc, uint8_t val);
+esp_err_t uart_midi_send_pc(uint8_t ports, uint8_t ch_1_16, uint8_t pc);
+esp_err_t uart_midi_send_note_on(uint8_t ports, uint8_t ch_1_16, uint8_t note, uint8_t vel);
+esp_err_t uart_midi_send_note_off(uint8_t ports, uint8_t ch_1_16, uint8_t note, uint8_t vel);
+esp_err_t uart_midi_send_rt(uint8_t ports, uint8_t rt_byte);
+
+// pre-built stream of complete messages (every message carries its status byte)
+esp_err_t uart_midi_send_stream(uint8_t ports, const uint8_t *b, int n);
+
+// sysex bytes (any part of F0 .. F7) to one port: takes what fits in its TX ring
+// right now and returns how many bytes were accepted (caller sends the rest later).
+// realtime still goes out between them; running status restarts after.
+int uart_midi_send_sysex_chunk(int port, const uint8_t *b, int n);
+
+// nothing queued for the TX tasks of ports any more (the last bytes may still be in the FIFO)
+int uart_midi_out_tx_idle(uint8_t ports);
+
+// send_* are non-blocking: messages go into a TX ring drained by a tx task.
+// flush waits (up to timeout_ms) until everything queued on ports is on the wire.
+esp_err_t uart_midi_out_flush(uint8_t ports, uint32_t timeout_ms);
+
+typedef struct {
+    uint32_t enqueued;     // messages accepted
+    uint32_t bytes_sent;   // bytes handed to the UART
+    uint32_t overflow;     // messages dropped (ring full)
+    uint32_t depth;        // messages waiting now
+    uint32_t max_depth;    // high-water mark of depth
+    uint32_t bytes_saved;  // status bytes skipped by running status
+    uint32_t rt_bytes;     // realtime bytes sent through the priority lane
+    uint32_t sysex_bytes;  // sysex bytes queued
+    uint32_t coalesced;    // continuous CC values merged into a queued one
+    uint32_t backlog_us;   // wire time of everything queued now
+} uart_midi_stats_t;
+
+void uart_midi_out_get_stats(int port, uart_midi_stats_t *out);
+
+// self-test: TX of port looped back to its RX inside the UART
+esp_err_t uart_midi_out_set_loopback(int port, bool enable);
+
+// self-test: port taken out of ready_mask / ready_fast (the dispatcher stops sending
+// to it; uart_midi_send_* with its bit still work). releasing it bumps port_gen
+// (its receivers got the test pattern) and drops the running status override
+esp_err_t uart_midi_out_reserve(int port, bool on);
+uint32_t  uart_midi_out_port_gen(int port);
+
+// running status for one port regardless of the global switch (-1 = follow it again)
+void uart_midi_out_force_running_status(int port, int enable);
 
-// sending helpers
-esp_err_t uart_midi_send_cc(uint8_t ch_1_16, uint8_t cc, uint8_t val);
-esp_err_t uart_midi_send_pc(uint8_t ch_1_16, uint8_t pc);
-esp_err_t uart_midi_send_note_on(uint8_t ch_1_16, uint8_t note, uint8_t vel);
-esp_err_t uart_midi_send_note_off(uint8_t ch_1_16, uint8_t note, uint8_t vel);
-esp_err_t uart_midi_send_rt(uint8_t rt_byte);
+// running status for repeated CC/PC on one channel (all ports; tracked per port,
+// refreshed every 200 ms and after any system common / sysex byte; realtime keeps it)
+void uart_midi_out_set_running_status(int enable);
+int  uart_midi_out_get_running_status(void);
@@ -8,6 +8,7 @@
 
 #include "esp_log.h"
 #include "esp_err.h"
+#include "esp_timer.h"
 
 #include "usb/usb_host.h"
 #include "usb/usb_types_ch9.h"
@@ -16,10 +17,46 @@
 
 static const char *TAG = "USB_MIDI";
 
-#define SEND_ALL_CABLES 0
-
+// -------------------- TX packing --------------------
+// USB-MIDI event packet = 4 bytes, bulk OUT max packet = 64 bytes
+// => เก็บได้สูงสุด 16 event ต่อ 1 transfer แล้วค่อยส่งทีเดียว
+#define USB_MIDI_PKT_SIZE       4
+#define USB_MIDI_XFER_SIZE      64
+#define USB_MIDI_PKTS_PER_XFER  (USB_MIDI_XFER_SIZE / USB_MIDI_PKT_SIZE)
+#define USB_MIDI_FLUSH_US       1000   // partial batch deadline (1 ms = 1 USB frame)
+
+// pre-allocated OUT transfers (ring) -> หลาย transfer รอคิวที่ host controller ได้พร้อมกัน
+#define USB_MIDI_XFER_RING      4
+
+// IN: transfers kept submitted all the time (one completes -> parsed -> resubmitted)
+#define USB_MIDI_IN_RING        4
+// parsed IN events -> SPSC queue (producer: usb_client task, consumer: one reader task)
+#define USB_MIDI_IN_Q_LEN       128
+
+// client events (NEW_DEV / DEV_GONE) waiting for the client task loop
+#define USB_MIDI_EVT_Q_LEN      8
+
+// resolved MIDI interface/endpoints per device model (VID/PID/bcdDevice)
+#define USB_MIDI_DESC_CACHE     8
+
+// OUT error recovery: failed data stays in the ring and is resubmitted after
+// halt/flush/clear, backoff doubles per attempt (2, 4, 8, 16, 32 ms)
+#define USB_MIDI_TX_RETRY_MAX   5
+#define USB_MIDI_TX_BACKOFF_US  2000
+
+// close: max wait for cancelled transfers to come back before release/close
+#define USB_MIDI_CLOSE_DRAIN_US 100000
+
+typedef enum {
+    REC_IDLE = 0,
+    REC_FAILED,                         // error seen: halt + flush the pipe
+    REC_DRAIN,                          // waiting for the rest of the ring to come back
+    REC_CLEAR,                          // CLEAR_FEATURE(ENDPOINT_HALT) in flight (stall)
+    REC_BACKOFF,                        // waiting rec_at_us, then resubmit
+} usb_rec_t;
+
+// ✅ one slot per attached MIDI device (behind a hub: several at once)
 typedef struct {
-    usb_host_client_handle_t client_hdl;
     usb_device_handle_t dev_hdl;
 
     bool have_device;
@@ -28,17 +65,85 @@ typedef struct {
 
     uint8_t midi_intf_num;
     uint8_t midi_ep_out;
+    uint8_t midi_ep_in;                 // 0 = device has no IN endpoint
+    uint16_t in_mps;
+    uint32_t conn_gen;                  // ++ on every successful open
+    volatile uint32_t loss_gen;         // ++ whenever accepted packets are dropped later (give-up, flush fail)
+    bool ump;                           // MIDI 2.0 alt setting claimed: UMP words on both endpoints
+
+    // identity + attach timing (client task writes, readers only peek)
+    uint16_t vid;
+    uint16_t pid;
+    uint16_t bcd;
+    bool cache_hit;                     // endpoints came from the descriptor cache
+    int64_t t_new_us;                   // NEW_DEV seen
+    uint32_t open_us;                   // NEW_DEV -> claimed
+    uint32_t first_tx_us;               // NEW_DEV -> first OUT transfer completed (0 = none yet)
+    bool first_tx_pending;
+
+    // OUT error recovery (client task). senders only read rec: != REC_IDLE -> hold data in pend
+    volatile uint8_t rec;               // usb_rec_t
+    bool rec_stall;
+    uint8_t rec_back;                   // ring transfers returned since the failure (from tail)
+    uint8_t rec_retry;                  // resubmits of the same ring content so far
+    int64_t rec_at_us;
+    usb_transfer_t *ctrl;               // control transfer for CLEAR_FEATURE
+    volatile bool ctrl_busy;
+
+    // OUT transfer ring: submit at head, complete (in order) at tail
+    usb_transfer_t *xfer[USB_MIDI_XFER_RING];
+    bool xfer_ready;
+    uint8_t ring_head;
+    uint8_t ring_tail;
+    volatile uint8_t in_flight;
+
+    // pending batch (guarded by tx_lock)
+    uint8_t pend[USB_MIDI_XFER_SIZE];
+    uint8_t pend_n;                     // packets in pend
+
+    // IN ring (all slots submitted while the device is open)
+    usb_transfer_t *in_xfer[USB_MIDI_IN_RING];
+    bool in_ready;
+    bool in_run;                        // false -> completions are not resubmitted
+    uint8_t in_busy;                    // IN transfers submitted, callback not yet run (client task only)
+} usb_midi_dev_t;
+
+typedef struct {
+    usb_host_client_handle_t client_hdl;
+    usb_midi_dev_t dev[USB_MIDI_MAX_DEVS];
 
-    usb_transfer_t *xfer;
-    SemaphoreHandle_t tx_done_sem;
+    // every device's pending batch + ring head (one lock: the dispatcher is the only heavy user)
+    SemaphoreHandle_t tx_lock;
+    esp_timer_handle_t flush_tmr;       // shared deadline, flushes every device
 } usb_midi_host_state_t;
 
 static usb_midi_host_state_t s_usb;
+static usb_midi_stats_t s_stats;
+
+// claim a device's MIDI 2.0 alternate setting when it offers one (next attach)
+static bool s_ump_enable = true;
+
+// guards ring_tail/in_flight (touched by transfer_cb in usb_client task)
+static portMUX_TYPE s_ring_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// client events: the callback runs inside usb_host_client_handle_events() on the
+// client task, so producer and consumer are the same task (no lock needed)
+typedef struct {
+    usb_host_client_event_t event;
+    uint8_t addr;
+    usb_device_handle_t dev_hdl;
+    int64_t t_us;
+} usb_evt_t;
+
+static usb_evt_t s_evtq[USB_MIDI_EVT_Q_LEN];
+static uint8_t s_evt_head = 0;
+static uint8_t s_evt_tail = 0;
 
-// event flags from callback -> handled in client task
-static volatile bool s_evt_new_dev = false;
-static volatile bool s_evt_dev_gone = false;
-static volatile uint8_t s_evt_new_addr = 0;
+// IN event queue (SPSC, head = producer, tail = consumer)
+static usb_midi_in_evt_t s_inq[USB_MIDI_IN_Q_LEN];
+static uint32_t s_inq_head = 0;
+static uint32_t s_inq_tail = 0;
+static TaskHandle_t s_in_notify = NULL;
 
 // Minimal header for walking descriptors
 typedef struct __attribute__((packed)) {
@@ -46,40 +151,367 @@ typedef struct __attribute__((packed)) {
     uint8_t bDescriptorType;
 } usb_desc_header_t;
 
+static inline int dev_index(const usb_midi_dev_t *d)
+{
+    return (int)(d - s_usb.dev);
+}
+
+static inline bool dev_ready(const usb_midi_dev_t *d)
+{
+    return (d->have_device &&
+            d->dev_hdl != NULL &&
+            d->claimed &&
+            d->xfer_ready &&
+            d->midi_ep_out != 0);
+}
+
+static inline uint8_t clamp_ch(uint8_t ch_1_16)
+{
+    if (ch_1_16 < 1) return 1;
+    if (ch_1_16 > 16) return 16;
+    return ch_1_16;
+}
+
+// USB-MIDI event packet (4 bytes): [0]=(Cable<<4)|CIN [1]=status [2]=d1 [3]=d2
+static inline void build_pkt_3b(uint8_t *pkt, uint8_t cable, uint8_t cin, uint8_t status, uint8_t d1, uint8_t d2)
+{
+    pkt[0] = (uint8_t)(((cable & 0x0F) << 4) | (cin & 0x0F));
+    pkt[1] = status;
+    pkt[2] = d1;
+    pkt[3] = d2;
+}
+static inline void build_pkt_1b(uint8_t *pkt, uint8_t cable, uint8_t cin, uint8_t b0)
+{
+    pkt[0] = (uint8_t)(((cable & 0x0F) << 4) | (cin & 0x0F));
+    pkt[1] = b0;
+    pkt[2] = 0x00;
+    pkt[3] = 0x00;
+}
+
+// -------------------- UMP (USB MIDI 2.0 alternate setting) --------------------
+// everything above the device layer keeps building USB-MIDI 1.0 event packets;
+// for a UMP device they are rewritten here (cable = group). 32-bit words go
+// on the wire least significant byte first.
+static inline void ump_put(uint8_t *out, uint32_t w)
+{
+    out[0] = (uint8_t)w;
+    out[1] = (uint8_t)(w >> 8);
+    out[2] = (uint8_t)(w >> 16);
+    out[3] = (uint8_t)(w >> 24);
+}
+
+static inline uint32_t ump_get(const uint8_t *in)
+{
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// words per UMP message, by message type (top nibble of word 0)
+static const uint8_t k_ump_words[16] = { 1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4 };
+
+// one USB-MIDI 1.0 event packet -> UMP words (w[0..1]). returns words, 0 = nothing to send
+static int pkt_to_ump(const uint8_t *p, uint32_t *w)
+{
+    const uint32_t grp = (uint32_t)(p[0] >> 4);
+    const uint8_t cin = p[0] & 0x0F;
+
+    // sysex: MT 3 (7-bit data, F0/F7 implied by the packet status), up to 3 bytes each
+    if ((cin >= 0x4 && cin <= 0x7) && !(cin == 0x5 && p[1] != 0xF7 && p[1] >= 0xF0)) {
+        const int nb = (cin == 0x4) ? 3 : (cin - 0x4);
+        uint8_t b[3] = {0};
+        int n = 0;
+        bool start = false;
+        bool end = (cin != 0x4);
+        for (int i = 0; i < nb; i++) {
+            const uint8_t v = p[1 + i];
+            if (v == 0xF0) { start = true; continue; }
+            if (v == 0xF7) { end = true; continue; }
+            b[n++] = v;
+        }
+        const uint32_t st = start ? (end ? 0u : 1u) : (end ? 3u : 2u);   // complete/start/continue/end
+        w[0] = (0x3u << 28) | (grp << 24) | (st << 20) | ((uint32_t)n << 16) | ((uint32_t)b[0] << 8) | b[1];
+        w[1] = (uint32_t)b[2] << 24;
+        return 2;
+    }
+
+    switch (cin) {
+    case 0x8: case 0x9: case 0xA: case 0xB: case 0xC: case 0xD: case 0xE:
+        // MIDI 1.0 channel voice in UMP (MT 2)
+        w[0] = (0x2u << 28) | (grp << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        return 1;
+    case 0x2: case 0x3: case 0x5: case 0xF:
+        // system common / realtime (MT 1)
+        if (p[1] < 0xF0) return 0;
+        w[0] = (0x1u << 28) | (grp << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// one UMP message (nw words available) -> USB-MIDI 1.0 event packet for the IN queue.
+// returns 1 = pkt filled, 0 = nothing representable (sysex, MIDI 2.0 extras, utility)
+static int ump_to_pkt(const uint32_t *w, int nw, uint8_t *pkt)
+{
+    const uint8_t mt = (uint8_t)(w[0] >> 28);
+    const uint8_t grp = (uint8_t)((w[0] >> 24) & 0x0F);
+    const uint8_t st = (uint8_t)(w[0] >> 16);
+    const uint8_t b1 = (uint8_t)(w[0] >> 8) & 0x7F;
+    const uint8_t b2 = (uint8_t)w[0] & 0x7F;
+
+    if (mt == 0x1) {
+        uint8_t cin = 0xF;
+        if (st == 0xF1 || st == 0xF3) cin = 0x2;
+        else if (st == 0xF2) cin = 0x3;
+        else if (st == 0xF6) cin = 0x5;
+        build_pkt_3b(pkt, grp, cin, st, b1, b2);
+        return 1;
+    }
+    if (mt == 0x2) {
+        build_pkt_3b(pkt, grp, (uint8_t)(st >> 4), st, b1, b2);
+        return 1;
+    }
+    if (mt == 0x4 && nw >= 2) {
+        // MIDI 2.0 channel voice -> nearest MIDI 1.0 message (value scaled down)
+        const uint32_t v = w[1];
+        const uint8_t cin = (uint8_t)(st >> 4);
+        switch (cin) {
+        case 0x8: build_pkt_3b(pkt, grp, cin, st, b1, (uint8_t)(v >> 25)); return 1;
+        case 0x9: {
+            uint8_t vel = (uint8_t)(v >> 25);
+            if (vel == 0 && (v >> 16)) vel = 1;            // MIDI 2.0 non-zero -> not a note off
+            build_pkt_3b(pkt, grp, cin, st, b1, vel);
+            return 1;
+        }
+        case 0xA: case 0xB: build_pkt_3b(pkt, grp, cin, st, b1, (uint8_t)(v >> 25)); return 1;
+        case 0xC: build_pkt_3b(pkt, grp, cin, st, (uint8_t)((v >> 24) & 0x7F), 0); return 1;
+        case 0xD: build_pkt_3b(pkt, grp, cin, st, (uint8_t)(v >> 25), 0); return 1;
+        case 0xE: {
+            const uint16_t pb = (uint16_t)(v >> 18);
+            build_pkt_3b(pkt, grp, cin, st, (uint8_t)(pb & 0x7F), (uint8_t)(pb >> 7));
+            return 1;
+        }
+        default: return 0;
+        }
+    }
+    return 0;
+}
+
 // -------------------- Transfer callback --------------------
 static void transfer_cb(usb_transfer_t *transfer)
 {
-    if (transfer->status == USB_TRANSFER_STATUS_COMPLETED) {
-        // ok
+    usb_midi_dev_t *d = (usb_midi_dev_t *)transfer->context;
+    const usb_transfer_status_t st = transfer->status;
+
+    // recovering: whatever comes back (cancelled by the flush) stays in the ring for the resubmit
+    if (d->rec != REC_IDLE) {
+        d->rec_back++;
+        return;
+    }
+
+    if (st == USB_TRANSFER_STATUS_COMPLETED) {
+        if (d->rec_retry) {
+            s_stats.tx_recovered++;
+            d->rec_retry = 0;
+        }
+
+        // attach latency: NEW_DEV -> first transfer the device actually took
+        if (d->first_tx_pending) {
+            d->first_tx_pending = false;
+            d->first_tx_us = (uint32_t)(esp_timer_get_time() - d->t_new_us);
+            s_stats.last_first_tx_us = d->first_tx_us;
+            ESP_LOGI(TAG, "dev%d first transfer %u us after NEW_DEV (open %u us, %s)",
+                     dev_index(d), (unsigned)d->first_tx_us, (unsigned)d->open_us,
+                     d->cache_hit ? "cached descriptors" : "descriptor walk");
+        }
+    } else if (st != USB_TRANSFER_STATUS_CANCELED && st != USB_TRANSFER_STATUS_NO_DEVICE && d->claimed) {
+        // error / stall / timeout: keep it (and everything queued behind it), client task recovers
+        d->rec = REC_FAILED;
+        d->rec_stall = (st == USB_TRANSFER_STATUS_STALL);
+        d->rec_back = 1;
+        s_stats.tx_errors++;
+        if (d->rec_stall) s_stats.tx_stalls++;
+        ESP_LOGW(TAG, "dev%d TX status=%d -> recover (attempt %u)", dev_index(d), (int)st, (unsigned)d->rec_retry + 1);
+        return;
     } else {
-        ESP_LOGW(TAG, "TX status=%d", (int)transfer->status);
+        // device gone / closing: these packets are really lost
+        s_stats.dropped += (uint32_t)(transfer->num_bytes / USB_MIDI_PKT_SIZE);
+        d->loss_gen++;
+    }
+
+    // bulk OUT on one endpoint completes in submit order -> just advance tail
+    portENTER_CRITICAL(&s_ring_mux);
+    if (d->in_flight > 0) {
+        d->ring_tail = (uint8_t)((d->ring_tail + 1) % USB_MIDI_XFER_RING);
+        d->in_flight--;
+    }
+    portEXIT_CRITICAL(&s_ring_mux);
+
+    // batch ที่ค้างเพราะ ring เต็ม -> ส่งต่อทันทีจาก esp_timer task
+    if (d->pend_n && s_usb.flush_tmr) (void)esp_timer_start_once(s_usb.flush_tmr, 0);
+}
+
+// -------------------- IN transfers --------------------
+static void in_push(uint8_t dev, const uint8_t *pkt, int64_t t_us)
+{
+    uint32_t head = s_inq_head;
+    uint32_t tail = __atomic_load_n(&s_inq_tail, __ATOMIC_ACQUIRE);
+    if ((uint32_t)(head - tail) >= USB_MIDI_IN_Q_LEN) {
+        s_stats.in_dropped++;
+        return;
+    }
+
+    usb_midi_in_evt_t *e = &s_inq[head % USB_MIDI_IN_Q_LEN];
+    memcpy(e->pkt, pkt, USB_MIDI_PKT_SIZE);
+    e->dev = dev;
+    e->t_us = t_us;
+    __atomic_store_n(&s_inq_head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void in_submit(usb_midi_dev_t *d, usb_transfer_t *x)
+{
+    x->device_handle = d->dev_hdl;
+    x->bEndpointAddress = d->midi_ep_in;
+    // bulk IN: request a whole max-packet (device may return less)
+    x->num_bytes = d->in_mps;
+
+    if (usb_host_transfer_submit(x) != ESP_OK) s_stats.in_errors++;
+    else d->in_busy++;
+}
+
+// runs in usb_client task (inside usb_host_client_handle_events)
+static void in_transfer_cb(usb_transfer_t *transfer)
+{
+    usb_midi_dev_t *d = (usb_midi_dev_t *)transfer->context;
+    if (d->in_busy) d->in_busy--;
+
+    if (transfer->status == USB_TRANSFER_STATUS_COMPLETED) {
+        const int64_t now = esp_timer_get_time();
+        const uint8_t *p = transfer->data_buffer;
+        int pushed = 0;
+
+        s_stats.in_transfers++;
+        if (d->ump) {
+            // UMP words -> the same USB-MIDI 1.0 event packets readers already parse
+            const int nw = transfer->actual_num_bytes / USB_MIDI_PKT_SIZE;
+            for (int k = 0; k < nw;) {
+                uint32_t w[4] = {0};
+                w[0] = ump_get(&p[k * USB_MIDI_PKT_SIZE]);
+                const int len = k_ump_words[w[0] >> 28];
+                for (int j = 1; j < len && k + j < nw; j++) w[j] = ump_get(&p[(k + j) * USB_MIDI_PKT_SIZE]);
+
+                uint8_t pkt[4];
+                if (w[0] == 0) {
+                    // MT 0 NOOP / zero padding
+                } else if (ump_to_pkt(w, nw - k, pkt)) {
+                    in_push((uint8_t)dev_index(d), pkt, now);
+                    s_stats.in_packets++;
+                    pushed++;
+                } else {
+                    s_stats.in_ump_skipped++;
+                }
+                k += len;
+            }
+        } else {
+            for (int off = 0; off + USB_MIDI_PKT_SIZE <= transfer->actual_num_bytes; off += USB_MIDI_PKT_SIZE) {
+                // CIN 0 = reserved / zero padding after the last event
+                if ((p[off] & 0x0F) == 0x00) continue;
+                in_push((uint8_t)dev_index(d), &p[off], now);
+                s_stats.in_packets++;
+                pushed++;
+            }
+        }
+
+        if (pushed && s_in_notify) xTaskNotifyGive(s_in_notify);
+    } else if (transfer->status != USB_TRANSFER_STATUS_CANCELED &&
+               transfer->status != USB_TRANSFER_STATUS_NO_DEVICE) {
+        s_stats.in_errors++;
+        ESP_LOGW(TAG, "dev%d RX status=%d", dev_index(d), (int)transfer->status);
+        // stall etc. -> stop this slot (a resubmit would fail the same way)
+        return;
     }
-    if (s_usb.tx_done_sem) xSemaphoreGive(s_usb.tx_done_sem);
+
+    if (d->in_run && transfer->status == USB_TRANSFER_STATUS_COMPLETED) in_submit(d, transfer);
+}
+
+static void in_start(usb_midi_dev_t *d)
+{
+    if (!d->midi_ep_in || !d->in_ready) return;
+
+    d->in_run = true;
+    for (int i = 0; i < USB_MIDI_IN_RING; i++) in_submit(d, d->in_xfer[i]);
 }
 
 // -------------------- USB client event callback --------------------
 static void client_event_cb(const usb_host_client_event_msg_t *event_msg, void *arg)
 {
     (void)arg;
+
+    uint8_t next = (uint8_t)((s_evt_head + 1) % USB_MIDI_EVT_Q_LEN);
+    if (next == s_evt_tail) {
+        ESP_LOGW(TAG, "client event queue full (event %d lost)", (int)event_msg->event);
+        return;
+    }
+
+    usb_evt_t *e = &s_evtq[s_evt_head];
+    e->event = event_msg->event;
+    e->addr = 0;
+    e->dev_hdl = NULL;
+    e->t_us = esp_timer_get_time();
+
     if (event_msg->event == USB_HOST_CLIENT_EVENT_NEW_DEV) {
-        s_evt_new_addr = event_msg->new_dev.address;
-        s_evt_new_dev = true;
+        e->addr = event_msg->new_dev.address;
     } else if (event_msg->event == USB_HOST_CLIENT_EVENT_DEV_GONE) {
-        s_evt_dev_gone = true;
+        e->dev_hdl = event_msg->dev_gone.dev_hdl;
+    } else {
+        return;
     }
+    s_evt_head = next;
 }
 
-// -------------------- Find MIDI streaming interface + OUT endpoint --------------------
-static bool find_midi_out_ep(const usb_config_desc_t *cfg, uint8_t *out_intf, uint8_t *out_ep)
+// CLEAR_FEATURE done (either way: the resubmit shows whether the device took it)
+static void ctrl_transfer_cb(usb_transfer_t *transfer)
+{
+    usb_midi_dev_t *d = (usb_midi_dev_t *)transfer->context;
+    if (transfer->status != USB_TRANSFER_STATUS_COMPLETED) {
+        ESP_LOGW(TAG, "dev%d CLEAR_FEATURE status=%d", dev_index(d), (int)transfer->status);
+    }
+    d->ctrl_busy = false;
+}
+
+// -------------------- Find MIDI streaming interface + OUT/IN endpoints --------------------
+// OUT is required; IN is taken from the same interface (optional: some devices only listen)
+typedef struct {
+    uint8_t intf;
+    uint8_t alt;                        // alternate setting to claim
+    uint8_t ep_out;
+    uint8_t ep_in;
+    uint16_t in_mps;
+    bool out_bulk;
+    bool in_bulk;
+    bool ump;                           // MIDI 2.0 alternate setting (bcdMSC 2.0): UMP on the wire
+} midi_eps_t;
+
+// interface done -> keep it if better (bulk OUT > interrupt OUT, then has IN)
+static void keep_better(midi_eps_t *best, const midi_eps_t *cur)
+{
+    if (!cur->ep_out) return;
+    bool better = !best->ep_out ||
+                  (cur->out_bulk && !best->out_bulk) ||
+                  (cur->out_bulk == best->out_bulk && cur->ep_in && !best->ep_in);
+    if (better) *best = *cur;
+}
+
+// out = MIDI 1.0 setting (required), ump = MIDI 2.0 setting (ep_out 0 = none offered)
+static bool find_midi_eps(const usb_config_desc_t *cfg, midi_eps_t *out, midi_eps_t *ump)
 {
     const uint8_t *p = (const uint8_t *)cfg;
     const uint8_t *end = p + cfg->wTotalLength;
 
     const usb_intf_desc_t *cur_intf = NULL;
 
-    uint8_t found_intf = 0;
-    uint8_t found_ep   = 0;
-    bool found_bulk = false;
+    midi_eps_t best = {0};
+    midi_eps_t best_ump = {0};
+    midi_eps_t cur = {0};
 
     while (p + sizeof(usb_desc_header_t) <= end) {
         const usb_desc_header_t *hdr = (const usb_desc_header_t *)p;
@@ -87,14 +519,22 @@ static bool find_midi_out_ep(const usb_config_desc_t *cfg, uint8_t *out_intf, ui
         if (p + hdr->bLength > end) break;
 
         if (hdr->bDescriptorType == USB_B_DESCRIPTOR_TYPE_INTERFACE) {
+            keep_better(cur.ump ? &best_ump : &best, &cur);
+            memset(&cur, 0, sizeof(cur));
+
             cur_intf = (const usb_intf_desc_t *)p;
 
             // MIDI Streaming = Audio class(0x01), subclass(0x03)
             if (cur_intf->bInterfaceClass == 0x01 && cur_intf->bInterfaceSubClass == 0x03) {
-                // keep
+                cur.intf = cur_intf->bInterfaceNumber;
+                cur.alt = cur_intf->bAlternateSetting;
             } else {
                 cur_intf = NULL;
             }
+        } else if (hdr->bDescriptorType == 0x24 && cur_intf && hdr->bLength >= 5 && p[2] == 0x01) {
+            // CS_INTERFACE / MS_HEADER: bcdMSC 0x0200 on a non-zero alt setting = USB MIDI 2.0
+            const uint16_t bcd_msc = (uint16_t)(p[3] | (p[4] << 8));
+            if (bcd_msc == 0x0200 && cur.alt != 0) cur.ump = true;
         } else if (hdr->bDescriptorType == USB_B_DESCRIPTOR_TYPE_ENDPOINT && cur_intf) {
             const usb_ep_desc_t *ep = (const usb_ep_desc_t *)p;
 
@@ -103,218 +543,712 @@ static bool find_midi_out_ep(const usb_config_desc_t *cfg, uint8_t *out_intf, ui
             bool is_interrupt = (xfer_type == 0x03);
             bool is_out       = ((ep->bEndpointAddress & 0x80) == 0x00);
 
-            if (is_out && (is_bulk || is_interrupt)) {
-                if (is_bulk) {
-                    *out_intf = cur_intf->bInterfaceNumber;
-                    *out_ep   = ep->bEndpointAddress;
-                    return true;
-                }
-                if (!found_bulk) {
-                    found_bulk = false;
-                    found_intf = cur_intf->bInterfaceNumber;
-                    found_ep   = ep->bEndpointAddress;
+            if (is_bulk || is_interrupt) {
+                if (is_out) {
+                    if (!cur.ep_out || (is_bulk && !cur.out_bulk)) {
+                        cur.ep_out = ep->bEndpointAddress;
+                        cur.out_bulk = is_bulk;
+                    }
+                } else {
+                    if (!cur.ep_in || (is_bulk && !cur.in_bulk)) {
+                        cur.ep_in = ep->bEndpointAddress;
+                        cur.in_bulk = is_bulk;
+                        cur.in_mps = (uint16_t)(ep->wMaxPacketSize & 0x07FF);
+                    }
                 }
             }
         }
         p += hdr->bLength;
     }
 
-    if (found_ep) {
-        *out_intf = found_intf;
-        *out_ep   = found_ep;
-        return true;
-    }
-    return false;
-}
+    keep_better(cur.ump ? &best_ump : &best, &cur);
 
-static inline uint8_t clamp_ch(uint8_t ch_1_16)
-{
-    if (ch_1_16 < 1) return 1;
-    if (ch_1_16 > 16) return 16;
-    return ch_1_16;
-}
+    if (!best.ep_out) return false;
 
-// USB-MIDI event packet (4 bytes): [0]=(Cable<<4)|CIN [1]=status [2]=d1 [3]=d2
-static inline void build_pkt_3b(uint8_t *pkt, uint8_t cable, uint8_t cin, uint8_t status, uint8_t d1, uint8_t d2)
-{
-    pkt[0] = (uint8_t)(((cable & 0x0F) << 4) | (cin & 0x0F));
-    pkt[1] = status;
-    pkt[2] = d1;
-    pkt[3] = d2;
+    // transfer buffers are USB_MIDI_XFER_SIZE (full-speed max packet)
+    if (best.ep_in && (best.in_mps == 0 || best.in_mps > USB_MIDI_XFER_SIZE)) best.in_mps = USB_MIDI_XFER_SIZE;
+    if (best_ump.ep_in && (best_ump.in_mps == 0 || best_ump.in_mps > USB_MIDI_XFER_SIZE)) best_ump.in_mps = USB_MIDI_XFER_SIZE;
+
+    *out = best;
+    *ump = best_ump;
+    return true;
 }
-static inline void build_pkt_2b(uint8_t *pkt, uint8_t cable, uint8_t cin, uint8_t status, uint8_t d1)
+
+// -------------------- descriptor cache --------------------
+// a model seen once reconnects without re-reading / walking its config descriptor.
+// client task only, RAM only (first attach after boot always walks)
+typedef struct {
+    bool used;
+    uint16_t vid;
+    uint16_t pid;
+    uint16_t bcd;
+    uint32_t stamp;                     // last use (LRU eviction)
+    midi_eps_t eps;                     // MIDI 1.0 setting
+    midi_eps_t ump;                     // MIDI 2.0 setting (ep_out 0 = none)
+} desc_cache_t;
+
+static desc_cache_t s_dcache[USB_MIDI_DESC_CACHE];
+static uint32_t s_dcache_clock = 0;
+
+static desc_cache_t *dcache_find(uint16_t vid, uint16_t pid, uint16_t bcd)
 {
-    pkt[0] = (uint8_t)(((cable & 0x0F) << 4) | (cin & 0x0F));
-    pkt[1] = status;
-    pkt[2] = d1;
-    pkt[3] = 0x00;
+    for (int i = 0; i < USB_MIDI_DESC_CACHE; i++) {
+        desc_cache_t *c = &s_dcache[i];
+        if (c->used && c->vid == vid && c->pid == pid && c->bcd == bcd) return c;
+    }
+    return NULL;
 }
-static inline void build_pkt_1b(uint8_t *pkt, uint8_t cable, uint8_t cin, uint8_t b0)
+
+static void dcache_put(uint16_t vid, uint16_t pid, uint16_t bcd, const midi_eps_t *eps, const midi_eps_t *ump)
 {
-    pkt[0] = (uint8_t)(((cable & 0x0F) << 4) | (cin & 0x0F));
-    pkt[1] = b0;
-    pkt[2] = 0x00;
-    pkt[3] = 0x00;
+    desc_cache_t *c = dcache_find(vid, pid, bcd);
+    if (!c) {
+        // free entry, else least recently used
+        c = &s_dcache[0];
+        for (int i = 0; i < USB_MIDI_DESC_CACHE; i++) {
+            if (!s_dcache[i].used) { c = &s_dcache[i]; break; }
+            if (s_dcache[i].stamp < c->stamp) c = &s_dcache[i];
+        }
+    }
+    c->used = true;
+    c->vid = vid;
+    c->pid = pid;
+    c->bcd = bcd;
+    c->stamp = ++s_dcache_clock;
+    c->eps = *eps;
+    c->ump = *ump;
 }
 
-static void midi_close_device(void)
+
+// client task only. slot goes back to the free pool
+static void midi_close_device(usb_midi_dev_t *d)
 {
-    if (!s_usb.dev_hdl) {
-        s_usb.have_device = false;
-        s_usb.claimed = false;
-        s_usb.midi_ep_out = 0;
-        s_usb.midi_intf_num = 0;
-        if (s_usb.tx_done_sem) xSemaphoreGive(s_usb.tx_done_sem);
+    // senders check readiness under tx_lock -> nobody submits to a closing handle
+    if (s_usb.tx_lock) xSemaphoreTake(s_usb.tx_lock, portMAX_DELAY);
+    const bool was_claimed = d->claimed;
+    d->claimed = false;
+    s_stats.dropped += d->pend_n;
+    d->pend_n = 0;
+
+    // mid-recovery: the transfers already back are lost with the device, the
+    // rest drain through transfer_cb (cancelled by the halt/flush below)
+    if (d->rec != REC_IDLE) {
+        portENTER_CRITICAL(&s_ring_mux);
+        for (uint8_t k = 0; k < d->rec_back && d->in_flight > 0; k++) {
+            s_stats.dropped += (uint32_t)(d->xfer[d->ring_tail]->num_bytes / USB_MIDI_PKT_SIZE);
+            d->ring_tail = (uint8_t)((d->ring_tail + 1) % USB_MIDI_XFER_RING);
+            d->in_flight--;
+        }
+        portEXIT_CRITICAL(&s_ring_mux);
+        d->rec = REC_IDLE;
+    }
+    d->rec_back = 0;
+    d->rec_retry = 0;
+    if (s_usb.tx_lock) xSemaphoreGive(s_usb.tx_lock);
+
+    if (!d->dev_hdl) {
+        d->have_device = false;
+        d->midi_ep_out = 0;
+        d->midi_ep_in = 0;
+        d->midi_intf_num = 0;
+        d->ump = false;
+        d->ctrl_busy = false;
         return;
     }
 
-    if (s_usb.midi_ep_out) {
-        (void)usb_host_endpoint_halt(s_usb.dev_hdl, s_usb.midi_ep_out);
-        (void)usb_host_endpoint_flush(s_usb.dev_hdl, s_usb.midi_ep_out);
+    // stop resubmitting, then cancel whatever is still queued on IN
+    d->in_run = false;
+    if (d->midi_ep_in) {
+        (void)usb_host_endpoint_halt(d->dev_hdl, d->midi_ep_in);
+        (void)usb_host_endpoint_flush(d->dev_hdl, d->midi_ep_in);
     }
 
-    if (s_usb.claimed) {
-        (void)usb_host_interface_release(s_usb.client_hdl, s_usb.dev_hdl, s_usb.midi_intf_num);
-        s_usb.claimed = false;
+    if (d->midi_ep_out) {
+        (void)usb_host_endpoint_halt(d->dev_hdl, d->midi_ep_out);
+        (void)usb_host_endpoint_flush(d->dev_hdl, d->midi_ep_out);
     }
 
-    (void)usb_host_device_close(s_usb.client_hdl, s_usb.dev_hdl);
-    s_usb.dev_hdl = NULL;
+    // the cancelled transfers only come back through handle_events: release/close
+    // refuse (or free under a callback) while any OUT/IN/control transfer is out.
+    // close never runs inside handle_events (events are queued), so pumping here is safe
+    const int64_t t_end = esp_timer_get_time() + USB_MIDI_CLOSE_DRAIN_US;
+    while (d->in_flight || d->in_busy || d->ctrl_busy) {
+        if (esp_timer_get_time() >= t_end) {
+            ESP_LOGW(TAG, "dev%d close: transfers still pending (out=%u in=%u ctrl=%d)",
+                     dev_index(d), d->in_flight, d->in_busy, (int)d->ctrl_busy);
+            break;
+        }
+        usb_host_client_handle_events(s_usb.client_hdl, pdMS_TO_TICKS(5));
+    }
 
-    s_usb.have_device = false;
-    s_usb.midi_ep_out = 0;
-    s_usb.midi_intf_num = 0;
+    if (was_claimed) {
+        esp_err_t e = usb_host_interface_release(s_usb.client_hdl, d->dev_hdl, d->midi_intf_num);
+        if (e != ESP_OK) {
+            ESP_LOGE(TAG, "dev%d interface %u release failed: %s",
+                     dev_index(d), d->midi_intf_num, esp_err_to_name(e));
+        }
+    }
 
-    if (s_usb.xfer) {
-        s_usb.xfer->device_handle = NULL;
-        s_usb.xfer->bEndpointAddress = 0;
+    esp_err_t e = usb_host_device_close(s_usb.client_hdl, d->dev_hdl);
+    if (e != ESP_OK) ESP_LOGE(TAG, "dev%d device close failed: %s", dev_index(d), esp_err_to_name(e));
+    d->dev_hdl = NULL;
+
+    d->have_device = false;
+    d->midi_ep_out = 0;
+    d->midi_ep_in = 0;
+    d->midi_intf_num = 0;
+    d->ump = false;
+    d->ctrl_busy = false;
+    d->in_busy = 0;
+}
+
+// client task only: OUT ring always, IN ring once the device has an IN endpoint
+static esp_err_t alloc_rings(usb_midi_dev_t *d)
+{
+    esp_err_t e;
+    if (!d->xfer_ready) {
+        for (int i = 0; i < USB_MIDI_XFER_RING; i++) {
+            if (d->xfer[i]) continue;
+            e = usb_host_transfer_alloc(USB_MIDI_XFER_SIZE, 0, &d->xfer[i]);
+            if (e != ESP_OK) return e;
+            d->xfer[i]->callback = transfer_cb;
+            d->xfer[i]->context = d;
+        }
+        d->xfer_ready = true;
     }
 
-    if (s_usb.tx_done_sem) xSemaphoreGive(s_usb.tx_done_sem);
+    if (d->midi_ep_in && !d->in_ready) {
+        for (int i = 0; i < USB_MIDI_IN_RING; i++) {
+            if (d->in_xfer[i]) continue;
+            e = usb_host_transfer_alloc(USB_MIDI_XFER_SIZE, 0, &d->in_xfer[i]);
+            if (e != ESP_OK) return e;
+            d->in_xfer[i]->callback = in_transfer_cb;
+            d->in_xfer[i]->context = d;
+        }
+        d->in_ready = true;
+    }
+
+    // stall recovery (optional: without it only the host side of the pipe is cleared)
+    if (!d->ctrl && usb_host_transfer_alloc(USB_SETUP_PACKET_SIZE, 0, &d->ctrl) == ESP_OK) {
+        d->ctrl->callback = ctrl_transfer_cb;
+        d->ctrl->context = d;
+    }
+    return ESP_OK;
 }
 
-static esp_err_t ensure_midi_ready(void)
+// client task only: read + walk the active config descriptor
+static esp_err_t walk_eps(usb_midi_dev_t *d, midi_eps_t *eps, midi_eps_t *ump)
 {
-    if (!s_usb.have_device) return ESP_ERR_INVALID_STATE;
+    const usb_config_desc_t *cfg_desc = NULL;
+    esp_err_t e = usb_host_get_active_config_descriptor(d->dev_hdl, &cfg_desc);
+    if (e != ESP_OK) return e;
 
-    if (s_usb.dev_hdl == NULL) {
-        esp_err_t e = usb_host_device_open(s_usb.client_hdl, s_usb.dev_addr, &s_usb.dev_hdl);
-        if (e != ESP_OK) return e;
+    if (!find_midi_eps(cfg_desc, eps, ump)) {
+        ESP_LOGW(TAG, "addr %u: no MIDI OUT endpoint (not a MIDI device?)", d->dev_addr);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
 
-        const usb_config_desc_t *cfg_desc = NULL;
-        e = usb_host_get_active_config_descriptor(s_usb.dev_hdl, &cfg_desc);
-        if (e != ESP_OK) { midi_close_device(); return e; }
+static void use_eps(usb_midi_dev_t *d, const midi_eps_t *eps)
+{
+    d->midi_intf_num = eps->intf;
+    d->midi_ep_out = eps->ep_out;
+    d->midi_ep_in = eps->ep_in;
+    d->in_mps = eps->in_mps;
+    d->ump = eps->ump;
+}
 
-        uint8_t intf = 0, ep_out = 0;
-        if (!find_midi_out_ep(cfg_desc, &intf, &ep_out)) {
-            ESP_LOGE(TAG, "No MIDI OUT endpoint found");
-            midi_close_device();
-            return ESP_FAIL;
-        }
+// client task only: MIDI 2.0 setting when offered (and enabled), otherwise / if it
+// does not claim the MIDI 1.0 one
+static esp_err_t claim_eps(usb_midi_dev_t *d, const midi_eps_t *eps, const midi_eps_t *ump)
+{
+    esp_err_t e;
+    if (s_ump_enable && ump->ep_out) {
+        use_eps(d, ump);
+        e = alloc_rings(d);
+        if (e != ESP_OK) return e;
+        e = usb_host_interface_claim(s_usb.client_hdl, d->dev_hdl, ump->intf, ump->alt);
+        if (e == ESP_OK) return ESP_OK;
+        ESP_LOGW(TAG, "dev%d MIDI 2.0 alt %u did not claim (%s), using MIDI 1.0",
+                 dev_index(d), ump->alt, esp_err_to_name(e));
+    }
 
-        s_usb.midi_intf_num = intf;
-        s_usb.midi_ep_out = ep_out;
+    use_eps(d, eps);
+    e = alloc_rings(d);
+    if (e != ESP_OK) return e;
+    return usb_host_interface_claim(s_usb.client_hdl, d->dev_hdl, eps->intf, eps->alt);
+}
 
-        e = usb_host_interface_claim(s_usb.client_hdl, s_usb.dev_hdl, s_usb.midi_intf_num, 0);
-        if (e != ESP_OK) { midi_close_device(); return e; }
-        s_usb.claimed = true;
+// client task only: open + claim the device in slot d (d->dev_addr, d->t_new_us set)
+static esp_err_t midi_open_device(usb_midi_dev_t *d)
+{
+    esp_err_t e = usb_host_device_open(s_usb.client_hdl, d->dev_addr, &d->dev_hdl);
+    if (e != ESP_OK) { d->dev_hdl = NULL; midi_close_device(d); return e; }
+
+    // device descriptor is kept by the host stack (no bus traffic)
+    const usb_device_desc_t *dev_desc = NULL;
+    bool have_id = (usb_host_get_device_descriptor(d->dev_hdl, &dev_desc) == ESP_OK && dev_desc);
+    d->vid = have_id ? dev_desc->idVendor : 0;
+    d->pid = have_id ? dev_desc->idProduct : 0;
+    d->bcd = have_id ? dev_desc->bcdDevice : 0;
+
+    // pass 0: cached endpoints (known model). pass 1: walk the descriptor
+    // (unknown model, or the cached entry no longer claims)
+    desc_cache_t *c = have_id ? dcache_find(d->vid, d->pid, d->bcd) : NULL;
+    for (int pass = (c ? 0 : 1); pass < 2; pass++) {
+        midi_eps_t eps, ump;
+        if (pass == 0) {
+            eps = c->eps;
+            ump = c->ump;
+            c->stamp = ++s_dcache_clock;
+            s_stats.desc_cache_hits++;
+        } else {
+            e = walk_eps(d, &eps, &ump);
+            if (e != ESP_OK) { midi_close_device(d); return e; }
+            s_stats.desc_cache_misses++;
+        }
+        d->cache_hit = (pass == 0);
 
-        if (s_usb.xfer == NULL) {
-            e = usb_host_transfer_alloc(64, 0, &s_usb.xfer);
-            if (e != ESP_OK) { midi_close_device(); return e; }
-            s_usb.xfer->callback = transfer_cb;
-            s_usb.xfer->context = NULL;
+        e = claim_eps(d, &eps, &ump);
+        if (e == ESP_OK) {
+            if (pass == 1 && have_id) dcache_put(d->vid, d->pid, d->bcd, &eps, &ump);
+            break;
         }
+        if (pass == 1) { midi_close_device(d); return e; }
 
-        s_usb.xfer->device_handle = s_usb.dev_hdl;
-        s_usb.xfer->bEndpointAddress = s_usb.midi_ep_out;
+        ESP_LOGW(TAG, "dev%d cached intf %u did not claim (%s), walking descriptor",
+                 dev_index(d), d->midi_intf_num, esp_err_to_name(e));
+        c->used = false;
     }
 
+    xSemaphoreTake(s_usb.tx_lock, portMAX_DELAY);
+    d->pend_n = 0;
+    d->claimed = true;
+    d->conn_gen++;
+    xSemaphoreGive(s_usb.tx_lock);
+
+    d->open_us = (uint32_t)(esp_timer_get_time() - d->t_new_us);
+    d->first_tx_us = 0;
+    d->first_tx_pending = true;
+    s_stats.last_open_us = d->open_us;
+
+    ESP_LOGI(TAG, "dev%d addr=%u %04x:%04x rev %04x %s intf=%u out=0x%02x in=0x%02x (mps %u) open %u us%s",
+             dev_index(d), d->dev_addr, d->vid, d->pid, d->bcd, d->ump ? "MIDI 2.0 (UMP)" : "MIDI 1.0",
+             d->midi_intf_num, d->midi_ep_out, d->midi_ep_in, d->in_mps, (unsigned)d->open_us,
+             d->cache_hit ? " (cached)" : "");
+
+    in_start(d);
     return ESP_OK;
 }
 
+uint8_t usb_midi_ump_mask(void)
+{
+    uint8_t m = 0;
+    for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+        if (dev_ready(&s_usb.dev[i]) && s_usb.dev[i].ump) m |= (uint8_t)(1u << i);
+    }
+    return m;
+}
+
+void usb_midi_set_ump(bool enable)
+{
+    s_ump_enable = enable;
+}
+
 int usb_midi_ready_fast(void)
 {
-    return (s_usb.have_device &&
-            s_usb.dev_hdl != NULL &&
-            s_usb.claimed &&
-            s_usb.xfer != NULL &&
-            s_usb.midi_ep_out != 0);
+    return usb_midi_ready_mask() != 0;
 }
 
-static esp_err_t submit_pkt(const uint8_t pkt4[4])
+uint8_t usb_midi_ready_mask(void)
 {
-    if (ensure_midi_ready() != ESP_OK) return ESP_ERR_INVALID_STATE;
+    uint8_t m = 0;
+    for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+        if (dev_ready(&s_usb.dev[i])) m |= (uint8_t)(1u << i);
+    }
+    return m;
+}
 
-    if (s_usb.tx_done_sem) xSemaphoreTake(s_usb.tx_done_sem, pdMS_TO_TICKS(1000));
+// tx_lock must be held. ESP_ERR_NO_MEM = every ring slot in flight (nothing sent)
+static esp_err_t submit_buf_locked(usb_midi_dev_t *d, const uint8_t *buf, uint8_t n)
+{
+    // recovering: the ring holds data that must go first -> caller keeps this pending
+    if (d->rec != REC_IDLE) return ESP_ERR_NO_MEM;
 
-    memcpy(s_usb.xfer->data_buffer, pkt4, 4);
-    s_usb.xfer->num_bytes = 4;
+    portENTER_CRITICAL(&s_ring_mux);
+    bool full = (d->in_flight >= USB_MIDI_XFER_RING);
+    if (!full) d->in_flight++;
+    uint8_t depth = d->in_flight;
+    portEXIT_CRITICAL(&s_ring_mux);
 
-    esp_err_t err = usb_host_transfer_submit(s_usb.xfer);
+    if (full) return ESP_ERR_NO_MEM;
+
+    usb_transfer_t *x = d->xfer[d->ring_head];
+    memcpy(x->data_buffer, buf, (size_t)n * USB_MIDI_PKT_SIZE);
+    x->num_bytes = n * USB_MIDI_PKT_SIZE;
+    x->device_handle = d->dev_hdl;
+    x->bEndpointAddress = d->midi_ep_out;
+
+    esp_err_t err = usb_host_transfer_submit(x);
     if (err != ESP_OK) {
-        if (s_usb.tx_done_sem) xSemaphoreGive(s_usb.tx_done_sem);
+        portENTER_CRITICAL(&s_ring_mux);
+        d->in_flight--;
+        portEXIT_CRITICAL(&s_ring_mux);
+        s_stats.dropped += n;
+        d->loss_gen++;
+        return err;
     }
+    d->ring_head = (uint8_t)((d->ring_head + 1) % USB_MIDI_XFER_RING);
+
+    if (depth > s_stats.max_in_flight) s_stats.max_in_flight = depth;
+    s_stats.transfers++;
+    s_stats.packets += n;
+    if (n > s_stats.max_pkts_per_xfer) s_stats.max_pkts_per_xfer = n;
+    return ESP_OK;
+}
+
+// tx_lock must be held
+static esp_err_t flush_locked(usb_midi_dev_t *d)
+{
+    uint8_t n = d->pend_n;
+    if (n == 0) return ESP_OK;
+    d->pend_n = 0;
+
+    if (!dev_ready(d)) {
+        s_stats.dropped += n;
+        d->loss_gen++;
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // ring full -> keep batch pending (never block); transfer_cb kicks the flush
+    esp_err_t err = submit_buf_locked(d, d->pend, n);
+    if (err == ESP_ERR_NO_MEM) d->pend_n = n;
     return err;
 }
 
-esp_err_t usb_midi_send_cc(uint8_t ch_1_16, uint8_t cc, uint8_t val)
+// tx_lock must be held: flush every device, ESP_ERR_NO_MEM counts as queued
+static esp_err_t flush_all_locked(void)
 {
-    ch_1_16 = clamp_ch(ch_1_16);
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+        esp_err_t e = flush_locked(&s_usb.dev[i]);
+        if (e != ESP_OK && e != ESP_ERR_NO_MEM) err = e;
+    }
+    return err;
+}
+
+// deadline: partial batch ที่ไม่มีใคร flush ให้ส่งออกเองหลัง USB_MIDI_FLUSH_US
+static void flush_tmr_cb(void *arg)
+{
+    (void)arg;
+    if (!s_usb.tx_lock) return;
+    xSemaphoreTake(s_usb.tx_lock, portMAX_DELAY);
+    (void)flush_all_locked();
+    xSemaphoreGive(s_usb.tx_lock);
+}
 
-#if SEND_ALL_CABLES
-    esp_err_t last = ESP_OK;
+// tx_lock must be held: append n packets to d's batch
+static esp_err_t append_raw_locked(usb_midi_dev_t *d, const uint8_t *pkts, int n)
+{
+    esp_err_t err = ESP_OK;
+
+    // a block that fits one transfer (e.g. one message on several cables) is not
+    // split across two: start a fresh batch if it does not fit the current one
+    if (n <= USB_MIDI_PKTS_PER_XFER && d->pend_n + n > USB_MIDI_PKTS_PER_XFER) (void)flush_locked(d);
+
+    const bool was_empty = (d->pend_n == 0);
+    while (n > 0) {
+        // batch still full because every ring slot is in flight -> drop the rest
+        if (d->pend_n >= USB_MIDI_PKTS_PER_XFER) (void)flush_locked(d);
+        if (d->pend_n >= USB_MIDI_PKTS_PER_XFER) {
+            s_stats.dropped_full += (uint32_t)n;
+            err = ESP_ERR_NO_MEM;
+            break;
+        }
+
+        int k = USB_MIDI_PKTS_PER_XFER - d->pend_n;
+        if (k > n) k = n;
+        memcpy(&d->pend[d->pend_n * USB_MIDI_PKT_SIZE], pkts, (size_t)k * USB_MIDI_PKT_SIZE);
+        d->pend_n = (uint8_t)(d->pend_n + k);
+        pkts += k * USB_MIDI_PKT_SIZE;
+        n -= k;
+    }
+
+    if (d->pend_n >= USB_MIDI_PKTS_PER_XFER) {
+        esp_err_t e = flush_locked(d);
+        if (e != ESP_OK && e != ESP_ERR_NO_MEM) err = e;
+    } else if (was_empty && d->pend_n > 0 && s_usb.flush_tmr) {
+        (void)esp_timer_start_once(s_usb.flush_tmr, USB_MIDI_FLUSH_US);
+    }
+    return err;
+}
+
+// tx_lock must be held. USB-MIDI 1.0 event packets; a UMP device gets every
+// packet rewritten as its own (never split) block of 1-2 words
+static esp_err_t append_locked(usb_midi_dev_t *d, const uint8_t *pkts, int n)
+{
+    if (!d->ump) return append_raw_locked(d, pkts, n);
+
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < n; i++) {
+        uint32_t w[2];
+        uint8_t buf[2 * USB_MIDI_PKT_SIZE];
+        const int nw = pkt_to_ump(&pkts[i * USB_MIDI_PKT_SIZE], w);
+        for (int k = 0; k < nw; k++) ump_put(&buf[k * USB_MIDI_PKT_SIZE], w[k]);
+        if (nw == 0) continue;
+
+        esp_err_t e = append_raw_locked(d, buf, nw);
+        if (e != ESP_OK) err = e;
+    }
+    return err;
+}
+
+// same packets to every ready device in dev_mask
+static esp_err_t submit_pkts(uint8_t dev_mask, const uint8_t *pkts, int n)
+{
+    if (!pkts || n <= 0) return ESP_OK;
+    if (!s_usb.tx_lock) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    bool any = false;
+
+    xSemaphoreTake(s_usb.tx_lock, portMAX_DELAY);
+    for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+        if (!(dev_mask & (1u << i))) continue;
+        usb_midi_dev_t *d = &s_usb.dev[i];
+        if (!dev_ready(d)) continue;
+
+        esp_err_t e = append_locked(d, pkts, n);
+        if (!any || e != ESP_OK) err = e;
+        any = true;
+    }
+    xSemaphoreGive(s_usb.tx_lock);
+    return err;
+}
+
+// pre-built event packets: one lock, copied straight into each pending batch
+esp_err_t usb_midi_send_packets(uint8_t dev_mask, const uint8_t *pkts, int n)
+{
+    return submit_pkts(dev_mask, pkts, n);
+}
+
+esp_err_t usb_midi_flush(void)
+{
+    if (!s_usb.tx_lock) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_usb.tx_lock, portMAX_DELAY);
+    if (s_usb.flush_tmr) (void)esp_timer_stop(s_usb.flush_tmr);
+    esp_err_t err = flush_all_locked();
+    xSemaphoreGive(s_usb.tx_lock);
+    return err;
+}
+
+int usb_midi_tx_room(int dev)
+{
+    if (dev < 0 || dev >= USB_MIDI_MAX_DEVS || !s_usb.tx_lock) return 0;
+    const usb_midi_dev_t *d = &s_usb.dev[dev];
+
+    xSemaphoreTake(s_usb.tx_lock, portMAX_DELAY);
+    int room = 0;
+    if (dev_ready(d)) {
+        // current batch + a whole batch per idle ring slot (none while recovering)
+        int free_slots = USB_MIDI_XFER_RING - (int)d->in_flight;
+        if (free_slots < 0 || d->rec != REC_IDLE) free_slots = 0;
+        room = (USB_MIDI_PKTS_PER_XFER - d->pend_n) + free_slots * USB_MIDI_PKTS_PER_XFER;
+        // UMP: a sysex / MIDI 2.0 packet takes two slots
+        if (d->ump) room /= 2;
+    }
+    xSemaphoreGive(s_usb.tx_lock);
+    return room;
+}
+
+bool usb_midi_tx_idle(uint8_t dev_mask)
+{
+    for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+        if (!(dev_mask & (1u << i))) continue;
+        const usb_midi_dev_t *d = &s_usb.dev[i];
+        if (!dev_ready(d)) continue;
+        if (d->pend_n || d->in_flight) return false;
+    }
+    return true;
+}
+
+bool usb_midi_in_pop(usb_midi_in_evt_t *out)
+{
+    uint32_t tail = s_inq_tail;
+    uint32_t head = __atomic_load_n(&s_inq_head, __ATOMIC_ACQUIRE);
+    if (head == tail) return false;
+
+    if (out) *out = s_inq[tail % USB_MIDI_IN_Q_LEN];
+    __atomic_store_n(&s_inq_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void usb_midi_in_set_notify(TaskHandle_t task)
+{
+    s_in_notify = task;
+}
+
+uint32_t usb_midi_conn_gen(int dev)
+{
+    if (dev < 0 || dev >= USB_MIDI_MAX_DEVS) return 0;
+    return s_usb.dev[dev].conn_gen;
+}
+
+uint32_t usb_midi_loss_gen(int dev)
+{
+    if (dev < 0 || dev >= USB_MIDI_MAX_DEVS) return 0;
+    return s_usb.dev[dev].loss_gen;
+}
+
+void usb_midi_get_dev_info(int dev, usb_midi_dev_info_t *out)
+{
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (dev < 0 || dev >= USB_MIDI_MAX_DEVS) return;
+
+    const usb_midi_dev_t *d = &s_usb.dev[dev];
+    out->ready = dev_ready(d);
+    out->addr = d->have_device ? d->dev_addr : 0;
+    out->ep_out = d->midi_ep_out;
+    out->ep_in = d->midi_ep_in;
+    out->in_flight = d->in_flight;
+    out->vid = d->vid;
+    out->pid = d->pid;
+    out->bcd = d->bcd;
+    out->cache_hit = d->cache_hit;
+    out->open_us = d->open_us;
+    out->first_tx_us = d->first_tx_us;
+    out->ump = d->ump;
+}
+
+void usb_midi_get_stats(usb_midi_stats_t *out)
+{
+    if (!out) return;
+    *out = s_stats;
+    out->in_flight = 0;
+    for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) out->in_flight += s_usb.dev[i].in_flight;
+    out->in_depth = s_inq_head - s_inq_tail;
+    out->devices = 0;
+    for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+        if (dev_ready(&s_usb.dev[i])) out->devices++;
+    }
+}
+
+// one packet per cable in the mask (0 = cable 0) -> n packets, one submit (one transfer)
+static esp_err_t send_cables(uint8_t dev_mask, uint16_t cables, uint8_t cin, uint8_t status, uint8_t d1, uint8_t d2)
+{
+    uint8_t pkts[16 * USB_MIDI_PKT_SIZE];
+    int n = 0;
+
+    if (cables == 0) cables = 0x0001;
     for (uint8_t cable = 0; cable < 16; cable++) {
-        uint8_t pkt[4];
-        build_pkt_3b(pkt, cable, 0x0B, (uint8_t)(0xB0 | ((ch_1_16 - 1) & 0x0F)), (uint8_t)(cc & 0x7F), (uint8_t)(val & 0x7F));
-        last = submit_pkt(pkt);
-        if (last != ESP_OK) break;
-        vTaskDelay(pdMS_TO_TICKS(2));
+        if (!(cables & (1u << cable))) continue;
+        build_pkt_3b(&pkts[n * USB_MIDI_PKT_SIZE], cable, cin, status, d1, d2);
+        n++;
     }
-    return last;
-#else
-    uint8_t pkt[4];
-    build_pkt_3b(pkt, 0, 0x0B, (uint8_t)(0xB0 | ((ch_1_16 - 1) & 0x0F)), (uint8_t)(cc & 0x7F), (uint8_t)(val & 0x7F));
-    return submit_pkt(pkt);
-#endif
+    return submit_pkts(dev_mask, pkts, n);
 }
 
-esp_err_t usb_midi_send_pc(uint8_t ch_1_16, uint8_t pc)
+esp_err_t usb_midi_send_cc(uint8_t dev_mask, uint16_t cables, uint8_t ch_1_16, uint8_t cc, uint8_t val)
 {
     ch_1_16 = clamp_ch(ch_1_16);
+    // CIN 0x0B = Control Change (3 bytes)
+    return send_cables(dev_mask, cables, 0x0B, (uint8_t)(0xB0 | ((ch_1_16 - 1) & 0x0F)), (uint8_t)(cc & 0x7F), (uint8_t)(val & 0x7F));
+}
 
-    uint8_t pkt[4];
-    // CIN 0x0C = Program Change (2 bytes)
-    build_pkt_2b(pkt, 0, 0x0C, (uint8_t)(0xC0 | ((ch_1_16 - 1) & 0x0F)), (uint8_t)(pc & 0x7F));
-    return submit_pkt(pkt);
+esp_err_t usb_midi_send_cc32(uint8_t dev_mask, uint16_t cables, uint8_t ch_1_16, uint8_t cc, uint32_t val)
+{
+    // MIDI 1.0 devices: top 7 bits
+    const uint8_t ump = (uint8_t)(dev_mask & usb_midi_ump_mask());
+    esp_err_t err = ESP_OK;
+    if (dev_mask & (uint8_t)~ump) err = usb_midi_send_cc((uint8_t)(dev_mask & ~ump), cables, ch_1_16, cc, (uint8_t)(val >> 25));
+    if (!ump || !s_usb.tx_lock) return err;
+
+    // MIDI 2.0 control change (MT 4): index = cc, 32-bit value; one 2-word block per cable
+    const uint8_t ch = (uint8_t)(clamp_ch(ch_1_16) - 1);
+    if (cables == 0) cables = 0x0001;
+
+    xSemaphoreTake(s_usb.tx_lock, portMAX_DELAY);
+    for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+        usb_midi_dev_t *d = &s_usb.dev[i];
+        if (!(ump & (1u << i)) || !dev_ready(d) || !d->ump) continue;
+
+        for (uint32_t grp = 0; grp < 16; grp++) {
+            if (!(cables & (1u << grp))) continue;
+            uint8_t buf[2 * USB_MIDI_PKT_SIZE];
+            ump_put(&buf[0], (0x4u << 28) | (grp << 24) | ((0xB0u | ch) << 16) | ((uint32_t)(cc & 0x7F) << 8));
+            ump_put(&buf[USB_MIDI_PKT_SIZE], val);
+            esp_err_t e = append_raw_locked(d, buf, 2);
+            if (e != ESP_OK) err = e;
+        }
+    }
+    xSemaphoreGive(s_usb.tx_lock);
+    return err;
 }
 
-esp_err_t usb_midi_send_note_on(uint8_t ch_1_16, uint8_t note, uint8_t vel)
+esp_err_t usb_midi_send_pc(uint8_t dev_mask, uint16_t cables, uint8_t ch_1_16, uint8_t pc)
 {
     ch_1_16 = clamp_ch(ch_1_16);
+    // CIN 0x0C = Program Change (2 bytes)
+    return send_cables(dev_mask, cables, 0x0C, (uint8_t)(0xC0 | ((ch_1_16 - 1) & 0x0F)), (uint8_t)(pc & 0x7F), 0x00);
+}
 
-    uint8_t pkt[4];
+esp_err_t usb_midi_send_note_on(uint8_t dev_mask, uint16_t cables, uint8_t ch_1_16, uint8_t note, uint8_t vel)
+{
+    ch_1_16 = clamp_ch(ch_1_16);
     // CIN 0x09 = Note On (3 bytes)
-    build_pkt_3b(pkt, 0, 0x09, (uint8_t)(0x90 | ((ch_1_16 - 1) & 0x0F)), (uint8_t)(note & 0x7F), (uint8_t)(vel & 0x7F));
-    return submit_pkt(pkt);
+    return send_cables(dev_mask, cables, 0x09, (uint8_t)(0x90 | ((ch_1_16 - 1) & 0x0F)), (uint8_t)(note & 0x7F), (uint8_t)(vel & 0x7F));
 }
 
-esp_err_t usb_midi_send_note_off(uint8_t ch_1_16, uint8_t note, uint8_t vel)
+esp_err_t usb_midi_send_note_off(uint8_t dev_mask, uint16_t cables, uint8_t ch_1_16, uint8_t note, uint8_t vel)
 {
     ch_1_16 = clamp_ch(ch_1_16);
-
-    uint8_t pkt[4];
     // CIN 0x08 = Note Off (3 bytes)
-    build_pkt_3b(pkt, 0, 0x08, (uint8_t)(0x80 | ((ch_1_16 - 1) & 0x0F)), (uint8_t)(note & 0x7F), (uint8_t)(vel & 0x7F));
-    return submit_pkt(pkt);
+    return send_cables(dev_mask, cables, 0x08, (uint8_t)(0x80 | ((ch_1_16 - 1) & 0x0F)), (uint8_t)(note & 0x7F), (uint8_t)(vel & 0x7F));
 }
 
 // ✅ realtime: CIN 0x0F = single byte (system real-time เช่น F8 clock)
+// priority: slot in *ahead* of the pending batch, then push out immediately (every device)
 esp_err_t usb_midi_send_rt(uint8_t rt_byte)
 {
-    uint8_t pkt[4];
-    build_pkt_1b(pkt, 0, 0x0F, rt_byte);
-    return submit_pkt(pkt);
+    uint8_t pkt1[4], pkt2[4];
+    build_pkt_1b(pkt1, 0, 0x0F, rt_byte);
+    uint32_t w;
+    (void)pkt_to_ump(pkt1, &w);
+    ump_put(pkt2, w);
+
+    if (!s_usb.tx_lock) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_usb.tx_lock, portMAX_DELAY);
+
+    for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+        usb_midi_dev_t *d = &s_usb.dev[i];
+        if (!dev_ready(d)) continue;
+        const uint8_t *pkt = d->ump ? pkt2 : pkt1;      // MT 1 word is one 4-byte slot too
+
+        esp_err_t e;
+        if (d->pend_n < USB_MIDI_PKTS_PER_XFER) {
+            memmove(&d->pend[USB_MIDI_PKT_SIZE], d->pend, (size_t)d->pend_n * USB_MIDI_PKT_SIZE);
+            memcpy(d->pend, pkt, USB_MIDI_PKT_SIZE);
+            d->pend_n++;
+            e = flush_locked(d);
+            if (e == ESP_ERR_NO_MEM) e = ESP_OK; // head of the batch, next out on completion
+        } else {
+            // batch already full -> own transfer, submitted before the batch
+            e = submit_buf_locked(d, pkt, 1);
+            if (e == ESP_ERR_NO_MEM) s_stats.dropped_full++;
+        }
+
+        if (e == ESP_OK) s_stats.rt_packets++;
+        if (err == ESP_ERR_INVALID_STATE || e != ESP_OK) err = e;
+    }
+
+    xSemaphoreGive(s_usb.tx_lock);
+    return err;
 }
 
 // -------------------- tasks --------------------
@@ -330,6 +1264,161 @@ static void usb_host_daemon_task(void *arg)
     }
 }
 
+// -------------------- OUT error recovery (client task) --------------------
+// ring content from tail (in_flight transfers) is resent in order, or dropped after
+// USB_MIDI_TX_RETRY_MAX attempts
+static void rec_give_up(usb_midi_dev_t *d)
+{
+    xSemaphoreTake(s_usb.tx_lock, portMAX_DELAY);
+    uint32_t lost = 0;
+    portENTER_CRITICAL(&s_ring_mux);
+    while (d->in_flight > 0) {
+        lost += (uint32_t)(d->xfer[d->ring_tail]->num_bytes / USB_MIDI_PKT_SIZE);
+        d->ring_tail = (uint8_t)((d->ring_tail + 1) % USB_MIDI_XFER_RING);
+        d->in_flight--;
+    }
+    portEXIT_CRITICAL(&s_ring_mux);
+    d->rec = REC_IDLE;
+    d->rec_retry = 0;
+    xSemaphoreGive(s_usb.tx_lock);
+
+    s_stats.dropped += lost;
+    s_stats.tx_gave_up++;
+    d->loss_gen++;
+    ESP_LOGE(TAG, "dev%d TX: %d attempts failed, %u packets dropped", dev_index(d), USB_MIDI_TX_RETRY_MAX, (unsigned)lost);
+
+    if (d->pend_n && s_usb.flush_tmr) (void)esp_timer_start_once(s_usb.flush_tmr, 0);
+}
+
+static void rec_backoff(usb_midi_dev_t *d)
+{
+    if (d->rec_retry >= USB_MIDI_TX_RETRY_MAX) { rec_give_up(d); return; }
+    d->rec_at_us = esp_timer_get_time() + ((int64_t)USB_MIDI_TX_BACKOFF_US << d->rec_retry);
+    d->rec = REC_BACKOFF;
+}
+
+static void rec_resubmit(usb_midi_dev_t *d)
+{
+    // under tx_lock: no sender may slip a newer transfer in ahead of the retried ones
+    xSemaphoreTake(s_usb.tx_lock, portMAX_DELAY);
+    const uint8_t n = d->in_flight;
+    d->rec_retry++;
+    d->rec_back = 0;
+    for (uint8_t k = 0; k < n; k++) {
+        usb_transfer_t *x = d->xfer[(d->ring_tail + k) % USB_MIDI_XFER_RING];
+        s_stats.tx_retries++;
+        if (usb_host_transfer_submit(x) != ESP_OK) {
+            // the ones not submitted count as back already
+            d->rec_back = (uint8_t)(n - k);
+            d->rec_stall = false;
+            d->rec = REC_FAILED;
+            xSemaphoreGive(s_usb.tx_lock);
+            return;
+        }
+    }
+    d->rec = REC_IDLE;
+    xSemaphoreGive(s_usb.tx_lock);
+
+    if (d->pend_n && s_usb.flush_tmr) (void)esp_timer_start_once(s_usb.flush_tmr, 0);
+}
+
+static void rec_clear_host(usb_midi_dev_t *d)
+{
+    (void)usb_host_endpoint_clear(d->dev_hdl, d->midi_ep_out);
+    rec_backoff(d);
+}
+
+static void recover_step(usb_midi_dev_t *d)
+{
+    switch ((usb_rec_t)d->rec) {
+    case REC_IDLE:
+        return;
+
+    case REC_FAILED:
+        // the error halted the pipe; flush returns whatever is still queued (CANCELED)
+        (void)usb_host_endpoint_halt(d->dev_hdl, d->midi_ep_out);
+        (void)usb_host_endpoint_flush(d->dev_hdl, d->midi_ep_out);
+        d->rec = REC_DRAIN;
+        return;
+
+    case REC_DRAIN:
+        if (d->rec_back < d->in_flight) return;
+
+        // device-side STALL: CLEAR_FEATURE(ENDPOINT_HALT) resets its data toggle too
+        if (d->rec_stall && d->ctrl && !d->ctrl_busy) {
+            usb_setup_packet_t *sp = (usb_setup_packet_t *)d->ctrl->data_buffer;
+            sp->bmRequestType = USB_BM_REQUEST_TYPE_DIR_OUT | USB_BM_REQUEST_TYPE_TYPE_STANDARD | USB_BM_REQUEST_TYPE_RECIP_ENDPOINT;
+            sp->bRequest = USB_B_REQUEST_CLEAR_FEATURE;
+            sp->wValue = 0;                 // ENDPOINT_HALT
+            sp->wIndex = d->midi_ep_out;
+            sp->wLength = 0;
+            d->ctrl->device_handle = d->dev_hdl;
+            d->ctrl->bEndpointAddress = 0;
+            d->ctrl->num_bytes = USB_SETUP_PACKET_SIZE;
+
+            d->ctrl_busy = true;
+            if (usb_host_transfer_submit_control(s_usb.client_hdl, d->ctrl) == ESP_OK) {
+                d->rec = REC_CLEAR;
+                return;
+            }
+            d->ctrl_busy = false;
+        }
+        rec_clear_host(d);
+        return;
+
+    case REC_CLEAR:
+        if (d->ctrl_busy) return;
+        rec_clear_host(d);
+        return;
+
+    case REC_BACKOFF:
+        if (esp_timer_get_time() < d->rec_at_us) return;
+        rec_resubmit(d);
+        return;
+    }
+}
+
+static void handle_new_dev(uint8_t addr, int64_t t_us)
+{
+    // same address already in a slot (re-enumeration) -> reopen there
+    usb_midi_dev_t *d = NULL;
+    for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+        if (s_usb.dev[i].have_device && s_usb.dev[i].dev_addr == addr) { d = &s_usb.dev[i]; break; }
+    }
+    if (d) {
+        midi_close_device(d);
+    } else {
+        for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+            if (!s_usb.dev[i].have_device) { d = &s_usb.dev[i]; break; }
+        }
+    }
+
+    if (!d) {
+        ESP_LOGW(TAG, "NEW_DEV addr=%u ignored: all %d device slots in use", addr, USB_MIDI_MAX_DEVS);
+        return;
+    }
+
+    d->dev_addr = addr;
+    d->have_device = true;
+    d->t_new_us = t_us;
+    ESP_LOGI(TAG, "NEW_DEV addr=%u -> dev%d", addr, dev_index(d));
+
+    esp_err_t e = midi_open_device(d);
+    if (e != ESP_OK) ESP_LOGW(TAG, "dev%d open failed: %s", dev_index(d), esp_err_to_name(e));
+}
+
+static void handle_dev_gone(usb_device_handle_t hdl)
+{
+    for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+        usb_midi_dev_t *d = &s_usb.dev[i];
+        if (d->dev_hdl && d->dev_hdl == hdl) {
+            ESP_LOGW(TAG, "DEV_GONE dev%d addr=%u", i, d->dev_addr);
+            midi_close_device(d);
+            return;
+        }
+    }
+}
+
 static void usb_client_task(void *arg)
 {
     (void)arg;
@@ -352,20 +1441,22 @@ static void usb_client_task(void *arg)
     ESP_LOGI(TAG, "USB client registered");
 
     while (1) {
-        usb_host_client_handle_events(s_usb.client_hdl, pdMS_TO_TICKS(20));
+        // recovery backoff is timed from here -> don't sleep 20 ms on events meanwhile
+        bool recovering = false;
+        for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) recovering |= (s_usb.dev[i].rec != REC_IDLE);
+        usb_host_client_handle_events(s_usb.client_hdl, recovering ? 1 : pdMS_TO_TICKS(20));
+
+        while (s_evt_tail != s_evt_head) {
+            usb_evt_t ev = s_evtq[s_evt_tail];
+            s_evt_tail = (uint8_t)((s_evt_tail + 1) % USB_MIDI_EVT_Q_LEN);
 
-        if (s_evt_dev_gone) {
-            s_evt_dev_gone = false;
-            ESP_LOGW(TAG, "DEV_GONE");
-            midi_close_device();
+            if (ev.event == USB_HOST_CLIENT_EVENT_DEV_GONE) handle_dev_gone(ev.dev_hdl);
+            else if (ev.event == USB_HOST_CLIENT_EVENT_NEW_DEV) handle_new_dev(ev.addr, ev.t_us);
         }
 
-        if (s_evt_new_dev) {
-            s_evt_new_dev = false;
-            s_usb.dev_addr = s_evt_new_addr;
-            s_usb.have_device = true;
-            ESP_LOGI(TAG, "NEW_DEV addr=%u", s_usb.dev_addr);
-            (void)ensure_midi_ready();
+        for (int i = 0; i < USB_MIDI_MAX_DEVS; i++) {
+            usb_midi_dev_t *d = &s_usb.dev[i];
+            if (d->rec != REC_IDLE && d->claimed) recover_step(d);
         }
 
         vTaskDelay(pdMS_TO_TICKS(1));
@@ -374,13 +1465,22 @@ static void usb_client_task(void *arg)
 
 void usb_midi_host_init(void)
 {
-    // binary semaphore for TX serialize
-    s_usb.tx_done_sem = xSemaphoreCreateBinary();
-    if (!s_usb.tx_done_sem) {
-        ESP_LOGE(TAG, "tx_done_sem alloc failed");
+    s_usb.tx_lock = xSemaphoreCreateMutex();
+    if (!s_usb.tx_lock) {
+        ESP_LOGE(TAG, "tx_lock alloc failed");
         return;
     }
-    xSemaphoreGive(s_usb.tx_done_sem);
+
+    const esp_timer_create_args_t targs = {
+        .callback = flush_tmr_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "usb_midi_flush",
+    };
+    if (esp_timer_create(&targs, &s_usb.flush_tmr) != ESP_OK) {
+        ESP_LOGW(TAG, "flush timer alloc failed -> partial batch waits for explicit flush");
+        s_usb.flush_tmr = NULL;
+    }
 
     usb_host_config_t host_cfg = {
         .intr_flags = ESP_INTR_FLAG_LEVEL1,
@@ -393,7 +1493,7 @@ void usb_midi_host_init(void)
         ESP_LOGE(TAG, "usb_host_install failed: %s", esp_err_to_name(e));
         return; // ✅ no abort → avoid reboot loop
     } else {
-        ESP_LOGI(TAG, "USB Host installed");
+        ESP_LOGI(TAG, "USB Host installed (up to %d MIDI devices)", USB_MIDI_MAX_DEVS);
     }
 
     xTaskCreatePinnedToCore(usb_host_daemon_task, "usb_daemon", 4096, NULL, 20, NULL, 0);
@@ -1,18 +1,119 @@
 ﻿// ===== FILE: main/usb_midi_host.h =====
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// ✅ several MIDI devices at once (through a hub). each gets a slot 0..N-1 in
+// attach order; dev_mask bit i = slot i
+#define USB_MIDI_MAX_DEVS  3
+#define USB_MIDI_DEV_ALL   ((uint8_t)((1u << USB_MIDI_MAX_DEVS) - 1))
 
 void usb_midi_host_init(void);
 
-// ready check
+// ready check (any device / bit per ready slot)
 int usb_midi_ready_fast(void);
+uint8_t usb_midi_ready_mask(void);
+
+// ✅ USB MIDI 2.0: a device offering a MIDI 2.0 alternate setting is claimed on
+// it (UMP on the wire) unless disabled; takes effect on the next attach.
+// all send* below are translated for such devices, received UMP is turned back
+// into USB-MIDI 1.0 event packets
+void usb_midi_set_ump(bool enable);
+uint8_t usb_midi_ump_mask(void);         // bit per ready slot running UMP
+
+// changes whenever the device in slot dev (re)opens -> receiver state starts from scratch
+uint32_t usb_midi_conn_gen(int dev);
+
+// changes whenever packets a send_* already accepted for slot dev are dropped
+// afterwards (recovery gave up, batch could not be submitted) -> what that
+// receiver has is no longer known
+uint32_t usb_midi_loss_gen(int dev);
 
-// sending
-esp_err_t usb_midi_send_cc(uint8_t ch_1_16, uint8_t cc, uint8_t val);
-esp_err_t usb_midi_send_pc(uint8_t ch_1_16, uint8_t pc);
-esp_err_t usb_midi_send_note_on(uint8_t ch_1_16, uint8_t note, uint8_t vel);
-esp_err_t usb_midi_send_note_off(uint8_t ch_1_16, uint8_t note, uint8_t vel);
+typedef struct {
+    bool ready;
+    uint8_t addr;        // USB address (0 = slot free)
+    uint8_t ep_out;
+    uint8_t ep_in;       // 0 = no IN endpoint
+    uint8_t in_flight;   // OUT transfers queued now
+    uint16_t vid;
+    uint16_t pid;
+    uint16_t bcd;        // bcdDevice (firmware revision)
+    bool cache_hit;      // endpoints came from the descriptor cache
+    uint32_t open_us;    // NEW_DEV -> interface claimed
+    uint32_t first_tx_us;// NEW_DEV -> first OUT transfer completed (0 = none yet)
+    bool ump;            // MIDI 2.0 alternate setting in use
+} usb_midi_dev_info_t;
 
-// ✅ realtime (midi clock etc.)
+void usb_midi_get_dev_info(int dev, usb_midi_dev_info_t *out);
+
+// sending (to every ready device in dev_mask). cables = cable mask (bit n = cable n,
+// 0 = cable 0): one packet per cable, all of them in the same transfer
+esp_err_t usb_midi_send_cc(uint8_t dev_mask, uint16_t cables, uint8_t ch_1_16, uint8_t cc, uint8_t val);
+// high-resolution CC: MIDI 2.0 32-bit value on UMP devices, val >> 25 on the rest
+esp_err_t usb_midi_send_cc32(uint8_t dev_mask, uint16_t cables, uint8_t ch_1_16, uint8_t cc, uint32_t val);
+esp_err_t usb_midi_send_pc(uint8_t dev_mask, uint16_t cables, uint8_t ch_1_16, uint8_t pc);
+esp_err_t usb_midi_send_note_on(uint8_t dev_mask, uint16_t cables, uint8_t ch_1_16, uint8_t note, uint8_t vel);
+esp_err_t usb_midi_send_note_off(uint8_t dev_mask, uint16_t cables, uint8_t ch_1_16, uint8_t note, uint8_t vel);
+
+// ✅ realtime (midi clock etc.) - every device, ahead of any batch not yet submitted
 esp_err_t usb_midi_send_rt(uint8_t rt_byte);
+
+// pre-built 4-byte event packets (n packets, e.g. a compiled action program)
+esp_err_t usb_midi_send_packets(uint8_t dev_mask, const uint8_t *pkts, int n);
+
+// packets device dev accepts right now without dropping (0 = not ready / ring full)
+int usb_midi_tx_room(int dev);
+
+// nothing pending or in flight for the ready devices in dev_mask
+bool usb_midi_tx_idle(uint8_t dev_mask);
+
+// send* only queue event packets (up to 16 per 64-byte transfer, per device);
+// flush pushes every pending batch out now (otherwise they go after ~1 ms)
+esp_err_t usb_midi_flush(void);
+
+// ✅ receiving: the IN endpoint is read continuously while a device is open.
+// every 4-byte event packet lands in a lock-free queue (single consumer task).
+typedef struct {
+    uint8_t pkt[4];      // raw USB-MIDI event: [0]=(cable<<4)|CIN [1..3]=MIDI bytes
+    uint8_t dev;         // device slot it came from
+    int64_t t_us;        // esp_timer time the transfer completed
+} usb_midi_in_evt_t;
+
+// false = queue empty (exactly one task may pop)
+bool usb_midi_in_pop(usb_midi_in_evt_t *out);
+
+// consumer task gets xTaskNotifyGive() whenever new events were queued (NULL = off)
+void usb_midi_in_set_notify(TaskHandle_t task);
+
+// stats
+typedef struct {
+    uint32_t transfers;          // bulk OUT transfers submitted
+    uint32_t packets;            // event packets carried by those transfers
+    uint32_t max_pkts_per_xfer;  // largest batch seen (1..16)
+    uint32_t dropped;            // packets really lost (device gone, submit error, retries exhausted)
+    uint32_t dropped_full;       // packets refused: batch full and every transfer in flight
+    uint32_t in_flight;          // transfers queued at the host controller now (all devices)
+    uint32_t max_in_flight;      // high-water mark of in_flight
+    uint32_t rt_packets;         // realtime packets sent through the priority path
+    uint32_t in_transfers;       // IN transfers completed with data
+    uint32_t in_packets;         // event packets received
+    uint32_t in_dropped;         // received packets lost (event queue full)
+    uint32_t in_errors;          // IN submit / transfer errors
+    uint32_t in_depth;           // events waiting in the queue now
+    uint32_t in_ump_skipped;     // received UMP with no MIDI 1.0 equivalent (sysex, MIDI 2.0 extras)
+    uint32_t devices;            // MIDI devices ready now
+    uint32_t desc_cache_hits;    // opens that reused cached endpoints
+    uint32_t desc_cache_misses;  // opens that walked the config descriptor
+    uint32_t last_open_us;       // last NEW_DEV -> claimed
+    uint32_t last_first_tx_us;   // last NEW_DEV -> first OUT transfer completed
+    uint32_t tx_errors;          // OUT transfers that failed (kept and retried, not lost)
+    uint32_t tx_stalls;          // ... of those: endpoint STALL (CLEAR_FEATURE sent)
+    uint32_t tx_retries;         // transfers resubmitted
+    uint32_t tx_recovered;       // recoveries that got through
+    uint32_t tx_gave_up;         // recoveries abandoned after USB_MIDI_TX_RETRY_MAX tries
+} usb_midi_stats_t;
+
+void usb_midi_get_stats(usb_midi_stats_t *out);
@@ -248,12 +248,40 @@ function mkField(labelText, controlEl) {
   return wrap;
 }
 
+// cable mask <-> "1,3-4" (cables shown 1..16, mask bit 0 = cable 1)
+function cablesToText(mask) {
+  mask = (mask | 0) & 0xFFFF;
+  if (!mask) mask = 1;
+  const parts = [];
+  for (let i = 0; i < 16; i++) {
+    if (!(mask & (1 << i))) continue;
+    let j = i;
+    while (j + 1 < 16 && (mask & (1 << (j + 1)))) j++;
+    parts.push(i === j ? String(i + 1) : (i + 1) + "-" + (j + 1));
+    i = j;
+  }
+  return parts.join(",");
+}
+
+function textToCables(text) {
+  let mask = 0;
+  String(text || "").split(",").forEach((p) => {
+    const m = p.trim().match(/^(\d+)(?:\s*-\s*(\d+))?$/);
+    if (!m) return;
+    let lo = clampInt(m[1], 1, 16);
+    let hi = clampInt(m[2] ?? m[1], 1, 16);
+    if (hi < lo) [lo, hi] = [hi, lo];
+    for (let i = lo; i <= hi; i++) mask |= (1 << (i - 1));
+  });
+  return mask || 1;
+}
+
 function mkActionRow(action, onRemove, onDirtyBtn, onFinishBtn, onImmediateSaveBtn) {
   const row = document.createElement("div");
   row.className = "action";
 
   const type = document.createElement("select");
-  ["cc", "pc"].forEach((t) => {
+  ["cc", "pc", "sysex", "delay"].forEach((t) => {
     const o = document.createElement("option");
     o.value = t;
     o.textContent = t;
@@ -261,13 +289,20 @@ function mkActionRow(action, onRemove, onDirtyBtn, onFinishBtn, onImmediateSaveB
   });
   type.value = action.type || "cc";
 
+  // delay: ms = a + b*128 (firmware format)
+  const DELAY_MAX_MS = 16383;
+  // sysex: a = payload slot (firmware MIDI_SYSEX_SLOTS, see /api/sysex)
+  const SYSEX_SLOTS = 32;
+
   const ch = document.createElement("input");
   ch.type = "number"; ch.min = 1; ch.max = 16;
   ch.value = (action.ch ?? 1);
 
   const a = document.createElement("input");
   a.type = "number"; a.min = 0; a.max = 127;
-  a.value = (action.a ?? 0);
+  a.value = (action.type === "delay")
+    ? (action.ms ?? ((action.a ?? 0) + (action.b ?? 0) * 128))
+    : (action.a ?? 0);
 
   const b = document.createElement("input");
   b.type = "number"; b.min = 0; b.max = 127;
@@ -277,6 +312,54 @@ function mkActionRow(action, onRemove, onDirtyBtn, onFinishBtn, onImmediateSaveB
   c.type = "number"; c.min = 0; c.max = 0;
   c.value = "0";
 
+  // flags (firmware ACTION_F_*): bit0 = always send (skip redundant-message suppression)
+  // bits1-3 = USB device mask (device 1..3, none checked = every device)
+  // bits4-5 = DIN port mask (port 1..2, none checked = every port)
+  // bits6-7 = route: 0 = USB + DIN, 1 = USB only, 2 = DIN only
+  const alw = document.createElement("input");
+  alw.type = "checkbox";
+  alw.checked = !!((action.flags ?? 0) & 1);
+
+  // USB cables (firmware action.cables bitmask): "1" / "1,3" / "1-4", empty = cable 1
+  const cab = document.createElement("input");
+  cab.type = "text";
+  cab.placeholder = "1";
+  cab.style.width = "64px";
+  cab.value = cablesToText(action.cables ?? 0);
+
+  const usbBox = document.createElement("div");
+  usbBox.style.display = "flex";
+  usbBox.style.gap = "4px";
+  const usbDev = [0, 1, 2].map((d) => {
+    const cb = document.createElement("input");
+    cb.type = "checkbox";
+    cb.title = "USB device " + (d + 1);
+    cb.checked = !!((action.flags ?? 0) & (2 << d));
+    usbBox.appendChild(cb);
+    return cb;
+  });
+
+  const route = document.createElement("select");
+  [["0", "usb+din"], ["1", "usb"], ["2", "din"]].forEach(([v, t]) => {
+    const o = document.createElement("option");
+    o.value = v; o.textContent = t;
+    route.appendChild(o);
+  });
+  route.value = String(((action.flags ?? 0) >> 6) & 3);
+  if (!route.value) route.value = "0";
+
+  const dinBox = document.createElement("div");
+  dinBox.style.display = "flex";
+  dinBox.style.gap = "4px";
+  const dinPort = [0, 1].map((p) => {
+    const cb = document.createElement("input");
+    cb.type = "checkbox";
+    cb.title = "DIN port " + (p + 1);
+    cb.checked = !!((action.flags ?? 0) & (16 << p));
+    dinBox.appendChild(cb);
+    return cb;
+  });
+
   const rm = document.createElement("button");
   rm.className = "x";
   rm.textContent = "×";
@@ -294,6 +377,11 @@ function mkActionRow(action, onRemove, onDirtyBtn, onFinishBtn, onImmediateSaveB
   const fCh   = mkField("ch", ch);
   const fA    = mkField("cc#", a);
   const fB    = mkField("value", b);
+  const fAlw  = mkField("always", alw);
+  const fOut  = mkField("out", route);
+  const fUsb  = mkField("usb 1·2·3", usbBox);
+  const fDin  = mkField("din 1·2", dinBox);
+  const fCab  = mkField("cable", cab);
 
   function refresh() {
     setInputVisible(ch, true);
@@ -301,6 +389,9 @@ function mkActionRow(action, onRemove, onDirtyBtn, onFinishBtn, onImmediateSaveB
     setInputVisible(b, true);
     setInputVisible(c, false);
 
+    const toUsb = route.value !== "2";
+    const toDin = route.value !== "1";
+
     if (type.value === "cc") {
       ch.placeholder = "ch";
       a.placeholder = "cc#";
@@ -311,6 +402,40 @@ function mkActionRow(action, onRemove, onDirtyBtn, onFinishBtn, onImmediateSaveB
       fA._lbl.textContent = "cc#";
       fB._lbl.textContent = "value";
       fB.style.display = "";
+      fCh.style.display = "";
+      fAlw.style.display = "";
+      fOut.style.display = "";
+      fUsb.style.display = toUsb ? "" : "none";
+      fDin.style.display = toDin ? "" : "none";
+      fCab.style.display = toUsb ? "" : "none";
+    } else if (type.value === "delay") {
+      a.placeholder = "ms";
+      a.min = 0; a.max = DELAY_MAX_MS;
+
+      setInputVisible(ch, false);
+      setInputVisible(b, false);
+      fCh.style.display = "none";
+      fA._lbl.textContent = "wait ms";
+      fB.style.display = "none";
+      fAlw.style.display = "none";
+      fOut.style.display = "none";
+      fUsb.style.display = "none";
+      fDin.style.display = "none";
+      fCab.style.display = "none";
+    } else if (type.value === "sysex") {
+      a.placeholder = "slot";
+      a.min = 0; a.max = SYSEX_SLOTS - 1;
+
+      setInputVisible(ch, false);
+      setInputVisible(b, false);
+      fCh.style.display = "none";
+      fA._lbl.textContent = "slot";
+      fB.style.display = "none";
+      fAlw.style.display = "none";
+      fOut.style.display = "";
+      fUsb.style.display = toUsb ? "" : "none";
+      fDin.style.display = toDin ? "" : "none";
+      fCab.style.display = toUsb ? "" : "none";
     } else {
       ch.placeholder = "ch";
       a.placeholder = "program";
@@ -320,13 +445,26 @@ function mkActionRow(action, onRemove, onDirtyBtn, onFinishBtn, onImmediateSaveB
       setInputVisible(b, false);
       fA._lbl.textContent = "program";
       fB.style.display = "none";
+      fCh.style.display = "";
+      fAlw.style.display = "";
+      fOut.style.display = "";
+      fUsb.style.display = toUsb ? "" : "none";
+      fDin.style.display = toDin ? "" : "none";
+      fCab.style.display = toUsb ? "" : "none";
     }
   }
 
   function getClamped() {
     const t = type.value;
+
+    if (t === "delay") {
+      const ms = clampInt(a.value || 0, 0, DELAY_MAX_MS);
+      a.value = String(ms);
+      return { type: t, ch: 1, a: ms & 127, b: ms >> 7, c: 0, ms };
+    }
+
     let _ch = clampInt(ch.value || 1, 1, 16);
-    let _a = clampInt(a.value || 0, 0, 127);
+    let _a = clampInt(a.value || 0, 0, (t === "sysex") ? SYSEX_SLOTS - 1 : 127);
     let _b = clampInt(b.value || 0, 0, 127);
 
     if (t !== "cc") _b = 0;
@@ -336,7 +474,13 @@ function mkActionRow(action, onRemove, onDirtyBtn, onFinishBtn, onImmediateSaveB
     b.value = String(_b);
     c.value = "0";
 
-    return { type: t, ch: _ch, a: _a, b: _b, c: 0 };
+    let flags = alw.checked ? 1 : 0;
+    usbDev.forEach((cb, d) => { if (cb.checked) flags |= (2 << d); });
+    dinPort.forEach((cb, p) => { if (cb.checked) flags |= (16 << p); });
+    flags |= (clampInt(route.value || 0, 0, 2) << 6);
+    const cables = textToCables(cab.value);
+    cab.value = cablesToText(cables);
+    return { type: t, ch: _ch, a: _a, b: _b, c: 0, flags, cables };
   }
 
   row._get = () => getClamped();
@@ -350,10 +494,29 @@ function mkActionRow(action, onRemove, onDirtyBtn, onFinishBtn, onImmediateSaveB
     }
   };
 
-  [ch, a, b].forEach((inp) => hookFinishedTypingInput(inp, onDirtyBtn, onFinishBtn));
+  [ch, a, b, cab].forEach((inp) => hookFinishedTypingInput(inp, onDirtyBtn, onFinishBtn));
+
+  route.onchange = async () => {
+    try {
+      refresh();
+      await onImmediateSaveBtn?.();
+    } catch (e) {
+      setMsg("save failed: " + e.message, false);
+    }
+  };
+
+  [alw, ...usbDev, ...dinPort].forEach((cb) => {
+    cb.onchange = async () => {
+      try {
+        await onImmediateSaveBtn?.();
+      } catch (e) {
+        setMsg("save failed: " + e.message, false);
+      }
+    };
+  });
 
   refresh();
-  row.append(fType, fCh, fA, fB, c, rm);
+  row.append(fType, fCh, fA, fB, fAlw, fOut, fUsb, fDin, fCab, c, rm);
   return row;
 }
 
@@ -431,6 +594,13 @@ function updateModeUI() {
 
     abWrap.style.display = "block";
     ensureAbLedDefaultIfNeeded();
+  } else if (pm === 4) {
+    // tap tempo: no commands (tap = tempo, hold = clock start/stop)
+    paneRight.style.display = "none";
+    addRight.style.display = "none";
+    leftTitle.textContent = "tap tempo (hold = start/stop)";
+    addLeft.textContent = `+ add (max ${maxActions()})`;
+    abWrap.style.display = "none";
   } else {
     paneRight.style.display = "none";
     addRight.style.display = "none";